@@ -24,171 +24,24 @@
  *
  * For more information, please refer to <http://unlicense.org/>
  */
+#ifdef EHTTP_BENCH
+// clock_gettime() and syscall() for the benchmark at the end
+#define _GNU_SOURCE
+#endif
 #include "ehttp.h"
+#include "ehttp_internal.h"
 
-enum ihttp_states {
-  // undetermined
-  S_NOSTATE = 0,
-  S_UND_H,
-  S_UND_HT,
-  S_UND_HTT,
-  S_UND_HTTP,
-
-  S_REQUEST_REQUIRED,
-  S_METHOD_CHAR,
-
-  S_REQUEST_URI,
-  S_REQUEST_URI_CHAR,
-  S_REQUEST_URI_ASTERISK,
-
-  S_REQUEST_URI_1ST_HEX,
-  S_REQUEST_URI_2ND_HEX,
-
-  S_REQUEST_REQUIRE_VERSION,
-  S_REQUEST_H,
-  S_REQUEST_HT,
-  S_REQUEST_HTT,
-  S_REQUEST_HTTP,
-  S_REQUEST_HTTP_MAJORV,
-  S_REQUEST_HTTP_DOT,
-  S_REQUEST_HTTP_MINORV,
-
-  S_REQUEST_EOL,
-  S_REQUEST_CRLF,
-
- /*
-  * Http response states
-  */
-  S_RESPONSE_REQUIRED,
-
-  S_RESPONSE_H,
-  S_RESPONSE_HT,
-  S_RESPONSE_HTT,
-  S_RESPONSE_HTTP,
-  S_RESPONSE_HTTP_SLASH,
-
-  S_RESPONSE_HTTP_MAJORV,
-  S_RESPONSE_HTTP_DOT,
-  S_RESPONSE_HTTP_MINORV,
-
-  S_STATUS_REQUIRED,
-  S_STATUS_1ST,
-  S_STATUS_2ND,
-  S_STATUS_3RD,
-
-  S_RESPONSE_REASON,
-  S_RESPONSE_EOL,
-
- /*
-  * Http headers
-  */
-  S_HEADER_NAME,
-  S_HEADER_NAME_CHAR,
-  S_HEADER_NAME_CHAR_CHECK,
-
-  S_HEADER_VALUE,
-  S_HEADER_VALUE_CHAR,
-
-  S_HEADER_VALUE_LF_CLOSE,
-  S_HEADER_VALUE_LF_CHUNKED,
-  S_HEADER_VALUE_LF_CHUNKED_CHAR,
-
-  S_HEADER_VALUE_CONTENT_LENGTH,
-  S_HEADER_VALUE_END_TRIM,
-
-  S_HEADER_EOL,
-  S_HEADER_CRLF,
-
- /*
-  * Last CRLF (end of headers)
-  */
-  S_HEADER_EOH,
-  S_HEADERS_DONE,
-
- /*
-  * Content body
-  */
-  S_BODY_CONTENT_LENGHT,
-
-  S_BODY_CHUNKED,
-  S_BODY_CHUNKLEN,
-  S_BODY_CHUNKLEN_CRLF,
-
-  S_BODY_CHUNK,
-  S_BODY_CHUNK_CR,
-  S_BODY_CHUNK_CRLF,
-
-  S_BODY_CHUNKED_EOS,
+// ehttp_pool.c aligns each parser to a cache line
+_Static_assert(sizeof(ehttp_parser) <= 64, "ehttp_parser outgrew a cache line");
 
-  S_STATE_END,
-};
-
-
-// header names
-enum {
-  SH_IGNORE = 0,
-  SH_NOSTATE,
-
-  SH_C, SH_CO, SH_CON, SH_CONN, SH_CONNE, SH_CONNEC, SH_CONNECT, SH_CONNECTI,
-  SH_CONNECTIO, SH_CONNECTION,
-
-  SH_CONT, SH_CONTE, SH_CONTEN, SH_CONTENT, SH_CONTENT_, SH_CONTENT_L,
-  SH_CONTENT_LE, SH_CONTENT_LEN, SH_CONTENT_LENG, SH_CONTENT_LENGT,
-  SH_CONTENT_LENGTH,
-
-  SH_H, SH_HO, SH_HOS, SH_HOST,
-
-  SH_T, SH_TR, SH_TRA, SH_TRAN, SH_TRANS, SH_TRANSF, SH_TRANSFE, SH_TRANSFER,
-  SH_TRANSFER_, SH_TRANSFER_E, SH_TRANSFER_EN, SH_TRANSFER_ENC, SH_TRANSFER_ENCO,
-  SH_TRANSFER_ENCOD, SH_TRANSFER_ENCODI, SH_TRANSFER_ENCODIN,
-  SH_TRANSFER_ENCODING,
-
-  SH_U, SH_UP, SH_UPG, SH_UPGR, SH_UPGRA, SH_UPGRAD, SH_UPGRADE,
-
-  SH_STATE_MAX,
-};
-
-enum {
-  SCLOSE_NOSTATE = 0,
-  SCLOSE_WAIT,
-  SCLOSE_C,
-  SCLOSE_CL,
-  SCLOSE_CLO,
-  SCLOSE_CLOS,
-  SCLOSE_CLOSE,
-
-  SCLOSE_CONFIRMED
-};
-
-enum {
-  SCHUNKED_WAIT = 0,
-  SCHUNKED_TRIM,
-  SCHUNKED_NOSTATE,
-  SCHUNKED_C,
-  SCHUNKED_CH,
-  SCHUNKED_CHU,
-  SCHUNKED_CHUN,
-  SCHUNKED_CHUNK,
-  SCHUNKED_CHUNKE,
-  SCHUNKED_CHUNKED,
-  SCHUNKED_CONFIRMED,
-
-  SCHUNKED_ILLEGAL,
-};
-
-/**
- * @bug Requires at least one header
- */
-
-static const uint8_t token[0x100];
-static const uint8_t vchar[0x100];
-static const uint8_t urichar[0x100];
-static const uint8_t hexchar[0x100];
-
-static uint8_t header_name_lookup(uint8_t state, uint8_t c);
-static uint8_t header_lf_close(uint8_t state, uint8_t c);
-static uint8_t header_lf_chunked(uint8_t state, uint8_t c);
+static void noop_span(ehttp_parser *s, const uint8_t *at, size_t len) {
+  (void) s; (void) at; (void) len;
+}
 
+static ehttp_ctrl noop_ctrl(ehttp_parser *s) {
+  (void) s;
+  return EHTTP_PARSER_CONTINUE;
+}
 
 const eversion *ehhtp_version(void) {
   static const eversion version = { .minor = 1 };
@@ -223,7 +76,40 @@ ehttp_parser *ehttp_init(ehttp_parser * const restrict out,
  */
 ehttp_parser *ehttp_reset(ehttp_parser * const restrict out,
                           void * const restrict ctx) {
-  return ehttp_init(out, out->mode, ctx);
+  uint8_t flags = out->flags;
+
+  ehttp_init(out, out->mode, ctx);
+  out->flags = flags;
+  return out;
+}
+
+/**
+ * True between messages: the parser holds no partial state and may be
+ * released (see ehttp_pool.h) until the connection becomes readable again.
+ */
+bool ehttp_is_idle(const ehttp_parser * const s) {
+  switch (s->state) {
+    case S_NOSTATE:
+    case S_REQUEST_REQUIRED:
+    case S_RESPONSE_REQUIRED:
+    case S_STATE_END:
+      return true;
+  }
+
+  return false;
+}
+
+/**
+ * True when the connection may carry another message after this one:
+ * HTTP/1.1 unless "Connection: close", HTTP/1.0 only with "Connection:
+ * keep-alive". Meaningful once the headers are parsed.
+ */
+bool ehttp_keep_alive(const ehttp_parser * const s) {
+  if (s->shouldClose) {
+    return false;
+  }
+
+  return s->majorVersion > 1 || s->minorVersion > 0 || s->keepAlive;
 }
 
 /**
@@ -231,1018 +117,298 @@ ehttp_parser *ehttp_reset(ehttp_parser * const restrict out,
  */
 ehttp_callbacks *ehttp_defaults(ehttp_callbacks * const out) {
   *out = (ehttp_callbacks) {
-    .on_error = NULL
+    .on_method = noop_span,
+    .on_method_done = noop_ctrl,
+    .on_request_uri = noop_span,
+    .on_request_uri_done = noop_ctrl,
+    .on_status_line_done = noop_ctrl,
+    .on_header_name = noop_span,
+    .on_header_name_done = noop_ctrl,
+    .on_header_value = noop_span,
+    .on_header_value_done = noop_ctrl,
+    .on_headers_done = noop_ctrl,
+    .on_content = noop_span,
+    .on_parser_done = noop_ctrl,
+    .on_error = noop_ctrl,
   };
 
   return out;
 }
 
-
-int ehttp_parse(ehttp_parser * const restrict s,
-                  const void * restrict in, size_t size,
-                  const ehttp_callbacks * const restrict callbacks)
-{
-  ehttp_ctrl ctrl;
-
-#ifdef CORE_HTTP_CHECKS
-  if (!s || !in || !size || !callbacks || s->mode < EHTTP_MODE_REQUEST || s->mode > EHTTP_MODE_RESPONSE) {
-    return -1;
-  }
+#if defined(__GNUC__)
+#define prefetch(p, rw) __builtin_prefetch((p), (rw))
+#else
+#define prefetch(p, rw) ((void) 0)
 #endif
 
-  s->end = (const uint8_t *) in + size;
-  s->mark = in;
-  s->p = in;
-
-  for (; s->p < s->end; s->p++) {
-    size_t tmp;
-check_again:
-    switch (s->state) {
-      case S_NOSTATE:
-        s->mark = s->p;
-        if (*s->p == 'H') {
-          s->state = S_UND_H;
-          continue;
-        }
-        else if (token[*s->p]) {
-          s->requestType = EHTTP_MODE_REQUEST;
-          s->state = S_METHOD_CHAR;
-          continue;
-        }
-
-        break;
-
-      case S_UND_H:
-        if (*s->p == 'T') {
-          s->state = S_UND_HT;
-          continue;
-        }
-        else if (token[*s->p]) {
-          s->requestType = EHTTP_MODE_REQUEST;
-          s->state = S_METHOD_CHAR;
-          continue;
-        }
-
-        break;
-
-      case S_UND_HT:
-        if (*s->p == 'T') {
-          s->state = S_UND_HTT;
-          continue;
-        }
-        else if (token[*s->p]) {
-          s->requestType = EHTTP_MODE_REQUEST;
-          s->state = S_METHOD_CHAR;
-          continue;
-        }
-
-        break;
-
-      case S_UND_HTT:
-        if (*s->p == 'P') {
-          s->state = S_UND_HTTP;
-          continue;
-        }
-        else if (token[*s->p]) {
-          s->requestType = EHTTP_MODE_REQUEST;
-          s->state = S_METHOD_CHAR;
-          continue;
-        }
-
-        break;
-
-      case S_UND_HTTP:
-        if (*s->p == '/') {
-          s->state = S_RESPONSE_HTTP_MAJORV;
-          s->requestType = EHTTP_MODE_RESPONSE;
-          continue;
-        }
-        else if (token[*s->p]) {
-          s->requestType = EHTTP_MODE_REQUEST;
-          s->state = S_METHOD_CHAR;
-          continue;
-        }
-
-        break;
-
-      case S_REQUEST_REQUIRED:
-        s->mark = s->p;
-        if (token[*s->p]) {
-          s->state = S_METHOD_CHAR;
-          continue;
-        }
-
-        break;
-
-      case S_METHOD_CHAR:
-        if (token[*s->p]) {
-          continue;
-        }
-        else if (*s->p == ' ') {
-          callbacks->on_method(s, s->mark, s->p - s->mark);
-          s->state = S_REQUEST_URI;
-          if ( (ctrl = callbacks->on_method_done(s) ) != EHTTP_PARSER_CONTINUE) {
-            goto early_return;
-          }
-          continue;
-        }
-
-        break;
-
-      case S_REQUEST_URI:
-        // legal chars at 1st
-        s->mark = s->p;
-        if (*s->p == '/' || *s->p == 'h' || *s->p == 'H') {
-          s->state = S_REQUEST_URI_CHAR;
-          continue;
-        }
-        else if (*s->p == '*') {
-          s->state = S_REQUEST_URI_ASTERISK;
-          continue;
-        }
-
-        break;
-
-      case S_REQUEST_URI_CHAR:
-        if (urichar[*s->p]) {
-          continue;
-        }
-        else if (*s->p == '%') {
-          s->state = S_REQUEST_URI_1ST_HEX;
-          continue;
-        }
-        else if (*s->p == ' ') {
-          callbacks->on_request_uri(s, s->mark, s->p - s->mark);
-          s->state = S_REQUEST_REQUIRE_VERSION;
-          if ( (ctrl = callbacks->on_request_uri_done(s) ) != EHTTP_PARSER_CONTINUE) {
-            goto early_return;
-          }
-          continue;
-        }
-
-        break;
-
-      case S_REQUEST_URI_1ST_HEX:
-        if (hexchar[*s->p]) {
-          s->state = S_REQUEST_URI_2ND_HEX;
-          continue;
-        }
-
-        break;
-
-      case S_REQUEST_URI_2ND_HEX:
-        if (hexchar[*s->p]) {
-          s->state = S_REQUEST_URI_CHAR;
-          continue;
-        }
-
-        break;
-
-      case S_REQUEST_URI_ASTERISK:
-        if (*s->p == ' ') {
-          s->state = S_REQUEST_REQUIRE_VERSION;
-          continue;
-        }
-
-        break;
-
-      case S_REQUEST_REQUIRE_VERSION:
-        if (*s->p == 'H') {
-          s->state = S_REQUEST_H;
-          continue;
-        }
-
-        break;
-
-      case S_REQUEST_H:
-        if (*s->p == 'T') {
-          s->state = S_REQUEST_HT;
-          continue;
-        }
-
-        break;
-
-      case S_REQUEST_HT:
-        if (*s->p == 'T') {
-          s->state = S_REQUEST_HTT;
-          continue;
-        }
-
-        break;
-
-      case S_REQUEST_HTT:
-        if (*s->p == 'P') {
-          s->state = S_REQUEST_HTTP;
-          continue;
-        }
-
-        break;
-
-      case S_REQUEST_HTTP:
-        if (*s->p == '/') {
-          s->state = S_REQUEST_HTTP_MAJORV;
-          continue;
-        }
-
-        break;
-
-      case S_REQUEST_HTTP_MAJORV:
-        if (*s->p >= '0' && *s->p <= '9') {
-          s->majorVersion = *s->p - '0';
-          s->state = S_REQUEST_HTTP_DOT;
-          continue;
-        }
-
-        break;
-
-      case S_REQUEST_HTTP_DOT:
-        if (*s->p == '.') {
-          s->state = S_REQUEST_HTTP_MINORV;
-          continue;
-        }
-
-        break;
-
-      case S_REQUEST_HTTP_MINORV:
-        if (*s->p >= '0' && *s->p <= '9') {
-          s->minorVersion = *s->p - '0';
-          s->state = S_REQUEST_EOL;
-          continue;
-        }
-
-        break;
-
-      case S_REQUEST_EOL:
-        if (*s->p == '\r') {
-          s->state = S_REQUEST_CRLF;
-          continue;
-        }
-
-        break;
-
-      case S_REQUEST_CRLF:
-        if (*s->p == '\n') {
-          s->state = S_HEADER_NAME;
-          if ( (ctrl = callbacks->on_status_line_done(s) ) != EHTTP_PARSER_CONTINUE) {
-            goto early_return;
-          }
-          continue;
-        }
-
-        break;
-
-      case S_RESPONSE_REQUIRED:
-        if (*s->p == 'H') {
-          s->state = S_RESPONSE_H;
-          continue;
-        }
-
-        break;
-
-      case S_RESPONSE_H:
-        if (*s->p == 'T') {
-          s->state = S_RESPONSE_HT;
-          continue;
-        }
-
-        break;
-
-      case S_RESPONSE_HT:
-        if (*s->p == 'T') {
-          s->state = S_RESPONSE_HTT;
-          continue;
-        }
-
-        break;
-
-      case S_RESPONSE_HTT:
-        if (*s->p == 'P') {
-          s->state = S_RESPONSE_HTTP;
-          continue;
-        }
-
-        break;
-
-      case S_RESPONSE_HTTP:
-        if (*s->p == '/') {
-          s->state = S_RESPONSE_HTTP_MAJORV;
-          continue;
-        }
-
-        break;
-
-      case S_RESPONSE_HTTP_MAJORV:
-        if (*s->p >= '0' && *s->p <= '9') {
-          s->majorVersion = *s->p - '0';
-          s->state = S_RESPONSE_HTTP_DOT;
-          continue;
-        }
-
-        break;
-
-      case S_RESPONSE_HTTP_DOT:
-        if (*s->p == '.') {
-          s->state = S_RESPONSE_HTTP_MINORV;
-          continue;
-        }
-
-        break;
-
-      case S_RESPONSE_HTTP_MINORV:
-        if (*s->p >= '0' && *s->p <= '9') {
-          s->minorVersion = *s->p - '0';
-          s->state = S_STATUS_REQUIRED;
-          continue;
-        }
-
-        break;
-
-      case S_STATUS_REQUIRED:
-        if (*s->p == ' ') {
-          s->state = S_STATUS_1ST;
-          continue;
-        }
-
-        break;
-
-      case S_STATUS_1ST:
-        if (*s->p >= '1' && *s->p <= '9') {
-          s->statusCode = (*s->p - '0') * 100;
-          s->state = S_STATUS_2ND;
-          continue;
-        }
-
-        break;
-
-      case S_STATUS_2ND:
-        if (*s->p >= '0' && *s->p <= '9') {
-          s->statusCode += (*s->p - '0') * 10;
-          s->state = S_STATUS_3RD;
-          continue;
-        }
-
-        break;
-
-      case S_STATUS_3RD:
-        if (*s->p >= '0' && *s->p <= '9') {
-          s->statusCode += (*s->p - '0');
-          s->state = S_RESPONSE_REASON;
-          continue;
-        }
-
-        break;
-
-      case S_RESPONSE_REASON:
-        if (vchar[*s->p]) {
-          continue;
-        }
-        else if (*s->p == '\r') {
-          s->state = S_RESPONSE_EOL;
-          continue;
-        }
-
-        break;
-
-      case S_RESPONSE_EOL:
-        if (*s->p == '\n') {
-          s->state = S_HEADER_NAME;
-          if ( (ctrl = callbacks->on_status_line_done(s) ) != EHTTP_PARSER_CONTINUE) {
-            goto early_return;
-          }
-          continue;
-        }
-
-        break;
-
-      case S_HEADER_NAME:
-        s->mark = s->p;
-        if (token[*s->p]) {
-          if ( (s->hnstate = header_name_lookup(SH_NOSTATE, *s->p) ) == 0) {
-            s->state = S_HEADER_NAME_CHAR;
-          }
-          else {
-            s->state = S_HEADER_NAME_CHAR_CHECK;
-          }
-          continue;
-        }
-        // no headers
-        else if (*s->p == '\r') {
-          s->state = S_HEADER_EOH;
-          continue;
-        }
-
-        break;
-
-      case S_HEADER_NAME_CHAR:
-        if (token[*s->p]) {
-          continue;
-        }
-        else if (*s->p == ':') {
-          callbacks->on_header_name(s, s->mark, s->p - s->mark);
-          s->state = S_HEADER_VALUE;
-          if ( (ctrl = callbacks->on_header_name_done(s) ) != EHTTP_PARSER_CONTINUE) {
-            goto early_return;
-          }
-          continue;
-        }
-
-        break;
-
-      case S_HEADER_NAME_CHAR_CHECK:
-        if (token[*s->p]) {
-          if ( (s->hnstate = header_name_lookup(s->hnstate, *s->p) ) == 0) {
-            s->state = S_HEADER_NAME_CHAR;
-          }
-
-          continue;
-        }
-        else if (*s->p == ':') {
-          callbacks->on_header_name(s, s->mark, s->p - s->mark);
-          s->state = S_HEADER_VALUE;
-          if ( (ctrl = callbacks->on_header_name_done(s) ) != EHTTP_PARSER_CONTINUE) {
-            goto early_return;
-          }
-          continue;
-        }
-
-        break;
-
-      case S_HEADER_VALUE:
-        // trim ows
-        if (*s->p == ' ' || *s->p == '\t') {
-          continue;
-        }
-        else if (vchar[*s->p]) {
-          s->mark = s->p;
-
-          switch (s->hnstate) {
-            case SH_CONNECTION:
-              s->state = S_HEADER_VALUE_LF_CLOSE;
-              goto check_again;
-
-            case SH_HOST:
-              s->state = S_HEADER_VALUE_CHAR;
-              s->haveHostHeader = 1;
-              goto check_again;
-
-            case SH_TRANSFER_ENCODING:
-              s->state = S_HEADER_VALUE_LF_CHUNKED;
-              goto check_again;
-
-            case SH_CONTENT_LENGTH:
-              if (s->contentLength) {
-                break;
-              }
-
-              s->state = S_HEADER_VALUE_CONTENT_LENGTH;
-              goto check_again;
-
-            case SH_UPGRADE:
-              s->state = S_HEADER_VALUE_CHAR;
-              s->isUpgrade = 1;
-              goto check_again;
-
-            default:
-              s->state = S_HEADER_VALUE_CHAR;
-              goto check_again;
-          }
-        }
-
-        break;
-
-      case S_HEADER_VALUE_CHAR:
-        if (vchar[*s->p]) {
-          continue;
-        }
-        else if (*s->p == '\r') {
-          callbacks->on_header_value(s, s->mark, s->p - s->mark);
-          s->state = S_HEADER_EOL;
-          if ( (ctrl = callbacks->on_header_value_done(s) ) != EHTTP_PARSER_CONTINUE) {
-            goto early_return;
-          }
-          continue;
-        }
-
-        break;
-
-      case S_HEADER_VALUE_LF_CLOSE:
-        if (vchar[*s->p]) {
-          s->hvstate = header_lf_close(s->hvstate, *s->p);
-          continue;
-        }
-        else if (*s->p == '\r') {
-          s->hvstate = header_lf_close(s->hvstate, *s->p);
-
-          if (s->hvstate == SCLOSE_CONFIRMED) {
-            s->shouldClose = 1;
-          }
-
-          callbacks->on_header_value(s, s->mark, s->p - s->mark);
-          s->state = S_HEADER_EOL;
-          if ( (ctrl = callbacks->on_header_value_done(s) ) != EHTTP_PARSER_CONTINUE) {
-            goto early_return;
-          }
-          continue;
-        }
-
-        break;
-
-      case S_HEADER_VALUE_LF_CHUNKED:
-        if (vchar[*s->p]) {
-          s->hvstate = header_lf_chunked(SCHUNKED_NOSTATE, *s->p);
-          s->state = S_HEADER_VALUE_LF_CHUNKED_CHAR;
-          continue;
-        }
-
-        break;
-
-      case S_HEADER_VALUE_LF_CHUNKED_CHAR:
-        if (vchar[*s->p]) {
-          s->hvstate = header_lf_chunked(s->hvstate, *s->p);
-          continue;
-        }
-        else if (*s->p == '\r') {
-          s->hvstate = header_lf_chunked(s->hvstate, *s->p);
-          if (s->hvstate == SCHUNKED_CONFIRMED) {
-            s->isChunked = 1;
-          }
-
-          callbacks->on_header_value(s, s->mark, s->p - s->mark);
-          s->state = S_HEADER_EOL;
-          if ( (ctrl = callbacks->on_header_value_done(s) ) != EHTTP_PARSER_CONTINUE) {
-            goto early_return;
-          }
-          continue;
-        }
-
-        break;
-
-      case S_HEADER_VALUE_CONTENT_LENGTH:
-        if (*s->p >= '0' && *s->p <= '9') {
-          s->contentLength *= 10;
-          s->contentLength += (*s->p - '0');
-          continue;
-        }
-        else if (*s->p == ' ' || *s->p == '\t') {
-          callbacks->on_header_value(s, s->mark, s->p - s->mark);
-          s->state = S_HEADER_VALUE_END_TRIM;
-          if ( (ctrl = callbacks->on_header_value_done(s) ) != EHTTP_PARSER_CONTINUE) {
-            goto early_return;
-          }
-          continue;
-        }
-        else if (*s->p == '\r') {
-          callbacks->on_header_value(s, s->mark, s->p - s->mark);
-          s->state = S_HEADER_EOL;
-          if ( (ctrl = callbacks->on_header_value_done(s) ) != EHTTP_PARSER_CONTINUE) {
-            goto early_return;
-          }
-          continue;
-        }
-
-        break;
-
-      case S_HEADER_VALUE_END_TRIM:
-        if (*s->p == ' ' || *s->p == '\t') {
-          continue;
-        }
-        else if (*s->p == '\r') {
-          s->state = S_HEADER_EOL;
-          continue;
-        }
-
-        break;
-
-      case S_HEADER_EOL:
-        if (*s->p == '\n') {
-          s->state = S_HEADER_CRLF;
-          continue;
-        }
-
-        break;
-
-      case S_HEADER_CRLF:
-        if (*s->p == '\r') {
-          s->state = S_HEADER_EOH;
-          continue;
-        }
-
-        else if (token[*s->p]) {
-          s->state = S_HEADER_NAME;
-          goto check_again;
-        }
-
-        break;
-
-      case S_HEADER_EOH:
-        if (*s->p == '\n') {
-          s->state = S_HEADERS_DONE;
-
-          // prepare state for headers done
-
-          if (s->contentLength && !s->isChunked) {
-            s->hasContent = 1;
-          }
-
-          else if (s->isChunked && !s->contentLength) {
-            s->hasContent = 1;
-          }
-
-          if (!s->hasContent && (s->contentLength || s->isChunked) ) {
-            // ambigous transfer encoding
-            break;
-          }
-
-          if (s->contentLength) {
-            s->state = S_BODY_CONTENT_LENGHT;
-            if ( (ctrl = callbacks->on_headers_done(s) ) != EHTTP_PARSER_CONTINUE) {
-              goto early_return;
-            }
-            continue;
-          }
-          else if (s->isChunked) {
-            s->state = S_BODY_CHUNKED;
-            if ( (ctrl = callbacks->on_headers_done(s) ) != EHTTP_PARSER_CONTINUE) {
-              goto early_return;
-            }
-            continue;
-          }
-
-          if ( (ctrl = callbacks->on_headers_done(s) ) != EHTTP_PARSER_CONTINUE) {
-            goto early_return;
-          }
+/**
+ * Runs ehttp_parse() on n connections made readable by one event loop
+ * wakeup, storing each result in its entry. The parser and the first input
+ * line of the entries ahead are prefetched while the current one is parsed.
+ */
+void ehttp_parse_batch(ehttp_batch * const restrict batch, size_t n,
+                       const ehttp_callbacks * const restrict callbacks) {
+  for (size_t i = 0; i < n && i < EHTTP_BATCH_PREFETCH; i++) {
+    prefetch(batch[i].parser, 1);
+    prefetch(batch[i].data, 0);
+  }
 
-          s->state = S_STATE_END;
-          if ( (ctrl = callbacks->on_parser_done(s) ) != EHTTP_PARSER_CONTINUE) {
-            goto early_return;
-          }
-          continue;
-        }
+  for (size_t i = 0; i < n; i++) {
+    if (i + EHTTP_BATCH_PREFETCH < n) {
+      const ehttp_batch *ahead = &batch[i + EHTTP_BATCH_PREFETCH];
 
-        break;
+      prefetch(ahead->parser, 1);
+      prefetch(ahead->data, 0);
+      prefetch((const uint8_t *) ahead->data + 64, 0);
+    }
 
-      case S_BODY_CONTENT_LENGHT:
-        s->mark = s->p;
-        tmp = size - (s->mark - (const uint8_t *) in);
+    batch[i].result = ehttp_parse(batch[i].parser, batch[i].data,
+                                  batch[i].size, callbacks);
+  }
+}
 
-        if (s->contentLength > tmp) {
-          callbacks->on_content(s, s->mark, tmp);
-          s->contentLength -= tmp;
-          s->p += tmp - 1;
-          continue;
-        }
-        else {
-          callbacks->on_content(s, s->mark, s->contentLength);
-          s->contentLength = 0;
-          if ( (ctrl = callbacks->on_parser_done(s) ) != EHTTP_PARSER_CONTINUE) {
-            goto early_return;
-          }
-          return 0;
-        }
+#undef prefetch
+
+#define EHTTP_PARSE_NAME ehttp_parse
+#define EHTTP_PARSE_END_NAME ehttp_parse_end
+#define EHTTP_PARSE_PARAMS , const ehttp_callbacks * const restrict callbacks
+#define EHTTP_PARSE_CHECKS !callbacks
+#define EHTTP_ON_METHOD(s, at, len) callbacks->on_method(s, at, len)
+#define EHTTP_ON_METHOD_DONE(s) callbacks->on_method_done(s)
+#define EHTTP_ON_REQUEST_URI(s, at, len) callbacks->on_request_uri(s, at, len)
+#define EHTTP_ON_REQUEST_URI_DONE(s) callbacks->on_request_uri_done(s)
+#define EHTTP_ON_STATUS_LINE_DONE(s) callbacks->on_status_line_done(s)
+#define EHTTP_ON_HEADER_NAME(s, at, len) callbacks->on_header_name(s, at, len)
+#define EHTTP_ON_HEADER_NAME_DONE(s) callbacks->on_header_name_done(s)
+#define EHTTP_ON_HEADER_VALUE(s, at, len) callbacks->on_header_value(s, at, len)
+#define EHTTP_ON_HEADER_VALUE_DONE(s) callbacks->on_header_value_done(s)
+#define EHTTP_ON_HEADERS_DONE(s) callbacks->on_headers_done(s)
+#define EHTTP_ON_CONTENT(s, at, len) callbacks->on_content(s, at, len)
+#define EHTTP_ON_PARSER_DONE(s) callbacks->on_parser_done(s)
+#define EHTTP_ON_ERROR(s) callbacks->on_error(s)
+#include "ehttp_parse.h"
+
+#ifdef EHTTP_BENCH
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 
-        break;
+/*
+ * Parses one request per connection, fragment by fragment across all the
+ * connections, as an event loop with that many slow clients would, and
+ * reports the throughput and, where perf events are allowed, the L1 data
+ * cache misses. Usage: [connections] [fragment bytes] [rounds]
+ *
+ * With "batch" as first argument, compares ehttp_parse() called per
+ * connection with ehttp_parse_batch() for wakeups of 1 to 1000 readable
+ * connections picked among many. Usage: batch [connections]
+ */
 
-      case S_BODY_CHUNKED:
-        if (*s->p >= '0' && *s->p <= '9') {
-          s->contentLength = *s->p - '0';
-          s->state = S_BODY_CHUNKLEN;
-          continue;
-        }
-        else if (*s->p >= 'a' && *s->p <= 'f') {
-          s->contentLength = (*s->p - 'a') + 10;
-          s->state = S_BODY_CHUNKLEN;
-          continue;
-        }
-        else if (*s->p >= 'A' && *s->p <= 'F') {
-          s->contentLength = (*s->p - 'A') + 10;
-          s->state = S_BODY_CHUNKLEN;
-          continue;
-        }
+static const char benchRequest[] =
+  "GET /api/v1/items/12345?fields=name,price HTTP/1.1\r\n"
+  "Host: shop.example.com\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:120.0) Gecko/20100101\r\n"
+  "Accept: text/html,application/xhtml+xml,application/xml;q=0.9\r\n"
+  "Accept-Language: en-US,en;q=0.5\r\n"
+  "Accept-Encoding: gzip, deflate, br\r\n"
+  "Cookie: session=0123456789abcdef; theme=dark\r\n"
+  "Connection: keep-alive\r\n"
+  "\r\n";
+
+static size_t benchMessages;
+
+static ehttp_ctrl bench_done(ehttp_parser *s) {
+  (void) s;
+  benchMessages++;
+  return EHTTP_PARSER_CONTINUE;
+}
 
-        break;
+static double bench_now(void) {
+  struct timespec ts;
 
-      case S_BODY_CHUNKLEN:
-        if (*s->p >= '0' && *s->p <= '9') {
-          s->contentLength = s->contentLength << 4;
-          s->contentLength += *s->p - '0';
-          continue;
-        }
-        else if (*s->p >= 'a' && *s->p <= 'f') {
-          s->contentLength = s->contentLength << 4;
-          s->contentLength += (*s->p - 'a') + 10;
-          continue;
-        }
-        else if (*s->p >= 'A' && *s->p <= 'F') {
-          s->contentLength = s->contentLength << 4;
-          s->contentLength += (*s->p - 'A') + 10;
-          continue;
-        }
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
-        else if (*s->p == '\r') {
-          if (s->contentLength == 0) {
-            s->state = S_BODY_CHUNKED_EOS;
-            continue;
-          }
+// L1 data cache read misses of this thread, -1 when not permitted
+static int bench_l1_open(void) {
+  struct perf_event_attr attr = {
+    .type = PERF_TYPE_HW_CACHE,
+    .size = sizeof(attr),
+    .config = PERF_COUNT_HW_CACHE_L1D |
+              PERF_COUNT_HW_CACHE_OP_READ << 8 |
+              PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+    .disabled = 1,
+    .exclude_kernel = 1,
+    .exclude_hv = 1,
+  };
 
-          s->state = S_BODY_CHUNKLEN_CRLF;
-          continue;
-        }
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
 
-        break;
+// a wakeup of n connections taken from order, parsed one way or the other
+static double bench_wakeup(ehttp_batch *batch, size_t n, bool batched,
+                           const ehttp_callbacks *cb) {
+  double start = bench_now();
 
-      case S_BODY_CHUNKLEN_CRLF:
-        if (*s->p == '\n') {
-          s->state = S_BODY_CHUNK;
-          continue;
-        }
+  if (batched) {
+    ehttp_parse_batch(batch, n, cb);
+  }
+  else {
+    for (size_t i = 0; i < n; i++) {
+      batch[i].result = ehttp_parse(batch[i].parser, batch[i].data,
+                                    batch[i].size, cb);
+    }
+  }
 
-        break;
+  return bench_now() - start;
+}
 
-      case S_BODY_CHUNK:
-        s->mark = s->p;
-        tmp = size - (s->mark - (const uint8_t *) in);
+static int bench_batch(int argc, char **argv) {
+  static const size_t sizes[] = { 1, 10, 100, 1000 };
+  // requests parsed for each wakeup size and way
+  const size_t total = 500000;
+  size_t conns = argc > 1 ? (size_t) atol(argv[1]) : 100000;
+  size_t len = sizeof(benchRequest) - 1;
+  ehttp_parser *parsers = aligned_alloc(64, sizeof(*parsers) * conns);
+  uint8_t *buffers = malloc(len * conns);
+  ehttp_batch *batch = malloc(sizeof(*batch) * 1000);
+  ehttp_callbacks cb;
+
+  if (conns < 1000 || !parsers || !buffers || !batch) {
+    fprintf(stderr, "usage: batch [connections, at least 1000]\n");
+    return 2;
+  }
 
-        if (s->contentLength >= tmp) {
-          s->p += tmp - 1;
-          callbacks->on_content(s, s->mark, tmp);
-          s->contentLength -= tmp;
-          continue;
-        }
+  ehttp_defaults(&cb);
+  cb.on_parser_done = bench_done;
+  for (size_t c = 0; c < conns; c++) {
+    ehttp_init(&parsers[c], EHTTP_MODE_REQUEST, NULL);
+    memcpy(buffers + c * len, benchRequest, len);
+  }
 
-        callbacks->on_content(s, s->mark, s->contentLength);
-        s->p += s->contentLength - 1;
-        s->contentLength = 0;
-        s->state = S_BODY_CHUNK_CR;
-        continue;
+  srand(7);
+  for (size_t k = 0; k < sizeof(sizes) / sizeof(*sizes); k++) {
+    size_t n = sizes[k];
+    double elapsed[2] = { 0, 0 };
 
-      // require \r after chunk
-      case S_BODY_CHUNK_CR:
-        if (*s->p == '\r') {
-          s->state = S_BODY_CHUNK_CRLF;
-          continue;
-        }
+    for (size_t done = 0; done < total; done += n) {
+      // each way parses its own randomly picked, cold connections
+      for (int batched = 0; batched < 2; batched++) {
+        unsigned seed = done * 2 + batched;
 
-        break;
+        for (size_t i = 0; i < n; i++) {
+          size_t c = (rand_r(&seed) * (size_t) RAND_MAX + rand_r(&seed)) %
+                     conns;
 
-      case S_BODY_CHUNK_CRLF:
-        if (*s->p == '\n') {
-          s->state = S_BODY_CHUNKED;
-          continue;
+          batch[i] = (ehttp_batch) {
+            .parser = &parsers[c],
+            .data = buffers + c * len,
+            .size = len,
+          };
         }
-
-        break;
-
-      case S_BODY_CHUNKED_EOS:
-        if (*s->p == '\n') {
-          s->state = S_STATE_END;
-          if ( (ctrl = callbacks->on_parser_done(s) ) != EHTTP_PARSER_CONTINUE) {
-            goto early_return;
-          }
-          continue;
+        elapsed[batched] += bench_wakeup(batch, n, batched, &cb);
+        // ready for the next wakeup; one picked twice in this one ended once
+        for (size_t i = 0; i < n; i++) {
+          ehttp_reset(batch[i].parser, NULL);
         }
-
-        break;
-
-      case S_STATE_END:
-        return size - (s->p - (uint8_t *) in);
+      }
     }
 
-    callbacks->on_error(s);
-    return -1;
+    printf("%4zu connections per wakeup: %.1f ns per request with "
+           "ehttp_parse(), %.1f ns with ehttp_parse_batch()\n", n,
+           elapsed[0] * 1e9 / total, elapsed[1] * 1e9 / total);
   }
 
-  if (s->state == S_METHOD_CHAR)
-    callbacks->on_method(s, s->mark, s->p - s->mark);
-  else if (s->state > S_REQUEST_URI && s->state < S_REQUEST_REQUIRE_VERSION)
-    callbacks->on_request_uri(s, s->mark, s->p - s->mark);
-  else if (s->state >= S_HEADER_NAME && s->state < S_HEADER_VALUE)
-    callbacks->on_header_name(s, s->mark, s->p - s->mark);
-  else if (s->state >= S_HEADER_VALUE && s->state < S_HEADER_EOL)
-    callbacks->on_header_value(s, s->mark, s->p - s->mark);
-
+  free(parsers);
+  free(buffers);
+  free(batch);
   return 0;
-
-early_return:
-  if (ctrl == EHTTP_PARSER_RETURN)
-    return size - (s->p - (uint8_t *) in);
-
-  return 1;
 }
 
-static uint8_t header_name_lookup(uint8_t state, uint8_t c) {
-  static const uint8_t table[][0x100] = {
-    [SH_NOSTATE] = {
-      ['C'] = SH_C, ['H'] = SH_H, ['T'] = SH_T, ['U'] = SH_U,
-      ['c'] = SH_C, ['h'] = SH_H, ['t'] = SH_T, ['u'] = SH_U,
-    },
-    [SH_C] = { ['O'] = SH_CO, ['o'] = SH_CO },
-    [SH_CO] = { ['N'] = SH_CON, ['n'] = SH_CON },
-    [SH_CON] = {
-      ['N'] = SH_CONN, ['T'] = SH_CONT,
-      ['n'] = SH_CONN, ['t'] = SH_CONT,
-    },
-    [SH_CONN] = { ['E'] = SH_CONNE, ['e'] = SH_CONNE },
-    [SH_CONNE] = { ['C'] = SH_CONNEC, ['c'] = SH_CONNEC },
-    [SH_CONNEC] = { ['T'] = SH_CONNECT, ['t'] = SH_CONNECT },
-    [SH_CONNECT] = { ['I'] = SH_CONNECTI, ['i'] = SH_CONNECTI },
-    [SH_CONNECTI] = { ['O'] = SH_CONNECTIO, ['o'] = SH_CONNECTIO },
-    [SH_CONNECTIO] = { ['N'] = SH_CONNECTION, ['n'] = SH_CONNECTION },
-
-    [SH_CONT] = { ['E'] = SH_CONTE, ['e'] = SH_CONTE },
-    [SH_CONTE] = { ['N'] = SH_CONTEN, ['n'] = SH_CONTEN },
-    [SH_CONTEN] = { ['T'] = SH_CONTENT, ['t'] = SH_CONTENT },
-    [SH_CONTENT] = { ['-'] = SH_CONTENT_ },
-    [SH_CONTENT_] = { ['L'] = SH_CONTENT_L, ['l'] = SH_CONTENT_L },
-    [SH_CONTENT_L] = { ['E'] = SH_CONTENT_LE, ['e'] = SH_CONTENT_LE },
-    [SH_CONTENT_LE] = { ['N'] = SH_CONTENT_LEN, ['n'] = SH_CONTENT_LEN },
-    [SH_CONTENT_LEN] = { ['G'] = SH_CONTENT_LENG, ['g'] = SH_CONTENT_LENG },
-    [SH_CONTENT_LENG] = { ['T'] = SH_CONTENT_LENGT, ['t'] = SH_CONTENT_LENGT },
-    [SH_CONTENT_LENGT] = {
-      ['H'] = SH_CONTENT_LENGTH, ['h'] = SH_CONTENT_LENGTH
-    },
-
-    [SH_H] = { ['O'] = SH_HO, ['o'] = SH_HO },
-    [SH_HO] = { ['S'] = SH_HOS, ['s'] = SH_HOS },
-    [SH_HOS] = { ['T'] = SH_HOST, ['t'] = SH_HOST },
-
-    [SH_T] = { ['R'] = SH_TR, ['r'] = SH_TR },
-    [SH_TR] = { ['A'] = SH_TRA, ['a'] = SH_TRA},
-    [SH_TRA] = { ['N'] = SH_TRAN, ['n'] = SH_TRAN},
-    [SH_TRAN] = { ['S'] = SH_TRANS, ['s'] = SH_TRANS },
-    [SH_TRANS] = { ['F'] = SH_TRANSF, ['f'] = SH_TRANSF },
-    [SH_TRANSF] = { ['E'] = SH_TRANSFE, ['e'] = SH_TRANSFE },
-    [SH_TRANSFE] = { ['R'] = SH_TRANSFER, ['r'] = SH_TRANSFER },
-    [SH_TRANSFER] = { ['-'] = SH_TRANSFER_ },
-    [SH_TRANSFER_] = { ['E'] = SH_TRANSFER_E, ['e'] = SH_TRANSFER_E },
-    [SH_TRANSFER_E] = { ['N'] = SH_TRANSFER_EN, ['n'] = SH_TRANSFER_EN },
-    [SH_TRANSFER_EN] = { ['C'] = SH_TRANSFER_ENC, ['c'] = SH_TRANSFER_ENC },
-    [SH_TRANSFER_ENC] = { ['O'] = SH_TRANSFER_ENCO, ['o'] = SH_TRANSFER_ENCO },
-    [SH_TRANSFER_ENCO] = {
-      ['D'] = SH_TRANSFER_ENCOD, ['d'] = SH_TRANSFER_ENCOD
-    },
-    [SH_TRANSFER_ENCOD] = {
-      ['I'] = SH_TRANSFER_ENCODI, ['i'] = SH_TRANSFER_ENCODI
-    },
-    [SH_TRANSFER_ENCODI] = {
-      ['N'] = SH_TRANSFER_ENCODIN, ['n'] = SH_TRANSFER_ENCODIN
-    },
-    [SH_TRANSFER_ENCODIN] = {
-      ['G'] = SH_TRANSFER_ENCODING, ['g'] = SH_TRANSFER_ENCODING
-    },
-
-    [SH_U] = { ['P'] = SH_UP, ['p'] = SH_UP },
-    [SH_UP] = { ['G'] = SH_UPG, ['g'] = SH_UPG },
-    [SH_UPG] = { ['R'] = SH_UPGR, ['r'] = SH_UPGR },
-    [SH_UPGR] = { ['A'] = SH_UPGRA, ['a'] = SH_UPGRA },
-    [SH_UPGRA] = { ['D'] = SH_UPGRAD, ['d'] = SH_UPGRAD },
-    [SH_UPGRAD] = { ['E'] = SH_UPGRADE, ['e'] = SH_UPGRADE },
-  };
-
-  return table[state][c];
-}
-
-// looking for "close" token
-static uint8_t header_lf_close(uint8_t state, uint8_t c) {
-  switch (state) {
-    case SCLOSE_NOSTATE:
-      if (c == 'C' || c == 'c') {
-        return SCLOSE_C;
-      }
-      else if (c == ',' || c == ' ' || c == '\t') {
-        return SCLOSE_NOSTATE;
-      }
-
-      return SCLOSE_WAIT;
-
-    // wait for ,
-    case SCLOSE_WAIT:
-      if (c == ',') {
-        return SCLOSE_NOSTATE;
-      }
-
-      return SCLOSE_WAIT;
-
-    case SCLOSE_C:
-      if (c == 'L' || c == 'l') {
-        return SCLOSE_CL;
-      }
-
-      return SCLOSE_WAIT;
-
-    case SCLOSE_CL:
-      if (c == 'O' || c == 'o') {
-        return SCLOSE_CLO;
-      }
-
-      return SCLOSE_WAIT;
-
-    case SCLOSE_CLO:
-      if (c == 'S' || c == 's') {
-        return SCLOSE_CLOS;
-      }
+static int bench_interleaved(int argc, char **argv) {
+  size_t conns = argc > 1 ? (size_t) atol(argv[1]) : 10000;
+  size_t frag = argc > 2 ? (size_t) atol(argv[2]) : 32;
+  size_t rounds = argc > 3 ? (size_t) atol(argv[3]) : 20;
+  size_t len = sizeof(benchRequest) - 1;
+  ehttp_parser *parsers = aligned_alloc(64, sizeof(*parsers) * conns);
+  // one copy of the request per connection, as each has its own buffer
+  uint8_t *buffers = malloc(len * conns);
+  ehttp_callbacks cb;
+  uint64_t misses = 0;
+  double elapsed;
+  int fd;
+
+  if (!conns || !frag || !parsers || !buffers) {
+    fprintf(stderr, "usage: %s [connections] [fragment bytes] [rounds]\n",
+            argv[0]);
+    return 2;
+  }
 
-      return SCLOSE_WAIT;
+  ehttp_defaults(&cb);
+  cb.on_parser_done = bench_done;
+  for (size_t c = 0; c < conns; c++) {
+    ehttp_init(&parsers[c], EHTTP_MODE_REQUEST, NULL);
+    memcpy(buffers + c * len, benchRequest, len);
+  }
 
-    case SCLOSE_CLOS:
-      if (c == 'E' || c == 'e') {
-        return SCLOSE_CLOSE;
-      }
+  fd = bench_l1_open();
+  if (fd >= 0) {
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  elapsed = bench_now();
 
-      return SCLOSE_WAIT;
+  for (size_t r = 0; r < rounds; r++) {
+    for (size_t off = 0; off < len; off += frag) {
+      size_t n = len - off < frag ? len - off : frag;
 
-    case SCLOSE_CLOSE:
-      if (c == ' ' || c == '\t' || c == '\t' || c == '\r' || c == ',') {
-        return SCLOSE_CONFIRMED;
+      for (size_t c = 0; c < conns; c++) {
+        if (ehttp_parse(&parsers[c], buffers + c * len + off, n, &cb)) {
+          fprintf(stderr, "parse error on connection %zu\n", c);
+          return 1;
+        }
       }
+    }
+    for (size_t c = 0; c < conns; c++) {
+      ehttp_reset(&parsers[c], NULL);
+    }
+  }
 
-      return SCLOSE_WAIT;
+  elapsed = bench_now() - elapsed;
+  if (fd >= 0) {
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &misses, sizeof(misses)) != sizeof(misses)) {
+      fd = -1;
+    }
+  }
 
-    case SCLOSE_CONFIRMED:
-      return SCLOSE_CONFIRMED;
+  printf("%zu connections, %zu byte fragments: %zu requests in %.3f s, "
+         "%.0f requests/s, %.1f MB/s", conns, frag, benchMessages, elapsed,
+         benchMessages / elapsed, len * benchMessages / elapsed / 1e6);
+  if (fd >= 0) {
+    printf(", %.1f L1d misses per request\n",
+           (double) misses / benchMessages);
+  }
+  else {
+    printf(", L1d misses not available\n");
   }
 
-  return 0;
+  free(parsers);
+  free(buffers);
+  return benchMessages != conns * rounds;
 }
 
-// looking for "chunked" token (must be the last one)
-static uint8_t header_lf_chunked(uint8_t state, uint8_t c) {
-  //fprintf(stderr, "%s %u:%c\n", __func__, state, c);
-  const uint8_t table[][0x100] = {
-    [SCHUNKED_WAIT] = {
-      [','] = SCHUNKED_TRIM
-    },
-    [SCHUNKED_TRIM] = {
-      [' '] = SCHUNKED_TRIM, ['\t'] = SCHUNKED_TRIM,
-      ['C'] = SCHUNKED_C, ['c'] = SCHUNKED_C,
-    },
-
-    [SCHUNKED_NOSTATE] = { ['C'] = SCHUNKED_C, ['c'] = SCHUNKED_C },
-    [SCHUNKED_C] = { ['H'] = SCHUNKED_CH, ['h'] = SCHUNKED_CH },
-    [SCHUNKED_CH] = { ['U'] = SCHUNKED_CHU, ['u'] = SCHUNKED_CHU },
-    [SCHUNKED_CHU] = { ['N'] = SCHUNKED_CHUN, ['n'] = SCHUNKED_CHUN },
-    [SCHUNKED_CHUN] = { ['K'] = SCHUNKED_CHUNK, ['k'] = SCHUNKED_CHUNK },
-    [SCHUNKED_CHUNK] = { ['E'] = SCHUNKED_CHUNKE, ['e'] = SCHUNKED_CHUNKE },
-    [SCHUNKED_CHUNKE] = { ['D'] = SCHUNKED_CHUNKED, ['d'] = SCHUNKED_CHUNKED },
-    [SCHUNKED_CHUNKED] = {
-      // QWS at the end
-      [' '] = SCHUNKED_CHUNKED,
-      ['\t'] = SCHUNKED_CHUNKED,
-      ['\r'] = SCHUNKED_CONFIRMED,
-      // chunk not last
-      [','] = SCHUNKED_ILLEGAL,
-    },
-  };
-  if (state == SCHUNKED_ILLEGAL) {
-    return SCHUNKED_ILLEGAL;
+int main(int argc, char **argv) {
+  if (argc > 1 && !strcmp(argv[1], "batch")) {
+    return bench_batch(argc - 1, argv + 1);
   }
-  return (state == SCHUNKED_CONFIRMED) ? SCHUNKED_CONFIRMED : table[state][c];
-}
-
-static const uint8_t token[0x100] = {
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 1, 0, 1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 1, 1, 0,
-  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
-  0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 1,
-  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0,
-};
 
-static const uint8_t vchar[0x100] = {
-  ['\t'] = 1,
-  [' '] = 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-#ifndef CORE_HTTP_STRICT
- [0x80] = 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  return bench_interleaved(argc, argv);
+}
 #endif
-};
-
-static const uint8_t urichar[0x100] = {
-  ['-'] = 1, ['.'] = 1, ['_'] = 1, ['~'] = 1, [':'] = 1, ['/'] = 1,
-  ['?'] = 1, ['#'] = 1, ['['] = 1, [']'] = 1, ['@'] = 1, ['!'] = 1,
-  ['$'] = 1, ['&'] = 1, ['\''] = 1, ['('] = 1, [')'] = 1, ['*'] = 1,
-  ['+'] = 1, [','] = 1, [';'] = 1, ['='] = 1,
-  ['0'] = 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-  ['A'] = 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-  ['a'] = 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-};
-
-static const uint8_t hexchar[0x100] = {
-  ['0'] = 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-  ['A'] = 1, 1, 1, 1, 1, 1,
-  ['a'] = 1, 1, 1, 1, 1, 1,
-};
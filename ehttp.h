@@ -31,41 +31,136 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#ifdef __cplusplus
+// C++ has no restrict, the common extension has the same meaning
+#ifndef restrict
+#define restrict __restrict
+#endif
+extern "C" {
+#endif
+
 typedef enum {
   EHTTP_MODE_REQUEST = 1,
   EHTTP_MODE_RESPONSE,
   EHTTP_MODE_DETECT,
 } ehttp_mode;
 
+/*
+ * EHTTP_PARSER_RETURN stops ehttp_parse(), which returns the number of bytes
+ * left unconsumed. Returned from on_headers_done the parser stops at the
+ * first body byte, e.g. to answer Expect: 100-continue first.
+ *
+ * EHTTP_PARSER_SKIP, only from on_headers_done, sets parser->skipBody.
+ */
 typedef enum {
   EHTTP_PARSER_ERROR = -1,
   EHTTP_PARSER_CONTINUE = 0,
   EHTTP_PARSER_RETURN,
+  EHTTP_PARSER_SKIP,
 } ehttp_ctrl;
 
+typedef enum {
+  EHTTP_ERR_NONE = 0,
+  EHTTP_ERR_SYNTAX,
+  EHTTP_ERR_BARE_LF,
+  EHTTP_ERR_OBS_FOLD,
+  EHTTP_ERR_HEADER_NAME_WHITESPACE,
+  EHTTP_ERR_INVALID_CONTENT_LENGTH,
+  EHTTP_ERR_DUPLICATE_CONTENT_LENGTH,
+  EHTTP_ERR_TRANSFER_ENCODING_CONTENT_LENGTH,
+  EHTTP_ERR_CHUNKED_NOT_LAST,
+  EHTTP_ERR_CHUNKED_TWICE,
+  EHTTP_ERR_INVALID_CHUNK_SIZE,
+  // end of input inside a message, see ehttp_parse_end()
+  EHTTP_ERR_TRUNCATED,
+} ehttp_error;
+
+// parser->flags
+enum {
+  // reject any message whose framing could be read differently by a peer
+  EHTTP_FLAG_STRICT = 1 << 0,
+  // accept bare '\n' line endings and obs-fold, unless strict; each folded
+  // line is reported as a further value of the same header
+  EHTTP_FLAG_LENIENT = 1 << 1,
+};
+
+typedef enum {
+  EHTTP_METHOD_UNKNOWN = 0,
+  EHTTP_METHOD_GET,
+  EHTTP_METHOD_HEAD,
+  EHTTP_METHOD_POST,
+  EHTTP_METHOD_PUT,
+  EHTTP_METHOD_PATCH,
+  EHTTP_METHOD_DELETE,
+  EHTTP_METHOD_CONNECT,
+  EHTTP_METHOD_OPTIONS,
+  EHTTP_METHOD_TRACE,
+
+  EHTTP_METHOD_MAX,
+} ehttp_method;
+
+typedef enum {
+  EHTTP_ENCODING_IDENTITY = 0,
+  EHTTP_ENCODING_GZIP,
+  EHTTP_ENCODING_DEFLATE,
+  EHTTP_ENCODING_UNKNOWN,
+} ehttp_encoding;
+
 typedef struct _ehttp_parser ehttp_parser;
 struct _ehttp_parser {
-  void *context;
-  /* parser state */
+  /* parser state, touched for every byte: keep it in the first cache line */
   const uint8_t *p;
   const uint8_t *end;
   const uint8_t *mark;
+  size_t contentLength;
   uint8_t state;
+  // sub states
+  uint8_t hnstate;
+  uint8_t hvstate;
   /* http info */
-  uint8_t majorVersion;
-  uint8_t minorVersion;
-  uint16_t statusCode;
-  ehttp_mode mode;
-  uint8_t requestType;
   uint8_t hasContent;
   uint8_t isChunked;
   uint8_t isUpgrade;
   uint8_t shouldClose;
   uint8_t haveHostHeader;
-  size_t contentLength;
-  // sub states
-  uint8_t hnstate;
-  uint8_t hvstate;
+  void *context;
+  uint8_t majorVersion;
+  uint8_t minorVersion;
+  uint16_t statusCode;
+  ehttp_mode mode;
+  uint8_t requestType;
+  // ehttp_method of the request line, set before on_method
+  uint8_t method;
+  // ehttp_encoding of the Content-Encoding header
+  uint8_t contentEncoding;
+  // EHTTP_FLAG_*, kept by ehttp_reset()
+  uint8_t flags;
+  // ehttp_error, set when ehttp_parse() fails
+  uint8_t error;
+  /* single bits share a byte so the parser stays within 64 bytes */
+  uint8_t haveContentLength : 1;
+  uint8_t haveTransferEncoding : 1;
+  // a Transfer-Encoding value named chunked
+  uint8_t haveChunked : 1;
+  // an HTTP/1.1 request with "Expect: 100-continue"
+  uint8_t expectContinue : 1;
+  /*
+   * Consume the body without on_content; chunk sizes are still parsed so
+   * the next message on the connection starts at the right byte. Set from
+   * on_headers_done (or EHTTP_PARSER_SKIP), or from on_content to drop
+   * the rest. Cleared by ehttp_reset().
+   */
+  uint8_t skipBody : 1;
+  // sampled by a parser built with EHTTP_TRACE, see ehttp_trace.h
+  uint8_t traced : 1;
+  // "Connection: keep-alive", see ehttp_keep_alive()
+  uint8_t keepAlive : 1;
+  /*
+   * ehttp_method of the request a response answers, set by the caller
+   * after ehttp_init()/ehttp_reset(): responses to HEAD have no content
+   * and 2xx responses to CONNECT start a tunnel.
+   */
+  uint8_t requestMethod;
 };
 
 typedef struct _ehttp_callbacks ehttp_callbacks;
@@ -102,20 +197,69 @@ ehttp_parser *ehttp_init(ehttp_parser * const restrict,
                          ehttp_mode, void * const restrict);
 
 /**
- *
+ * Runtime callback entry point. See ehttp_parse.h to instantiate a parser
+ * with the callbacks bound at compile time.
  */
 int ehttp_parse(ehttp_parser * const restrict,
                 const void * const restrict, size_t,
                 const ehttp_callbacks * const restrict);
 
+/**
+ * Signals the end of input (the peer closed the connection). Completes a
+ * close-delimited response body with on_parser_done and returns 0. Also
+ * returns 0 between messages. Inside any other message it fails with
+ * EHTTP_ERR_TRUNCATED and returns -1.
+ */
+int ehttp_parse_end(ehttp_parser * const restrict,
+                    const ehttp_callbacks * const restrict);
+
 /**
  *
  */
 ehttp_parser *ehttp_reset(ehttp_parser * const restrict, void * const restrict);
 
+/**
+ * True between messages: the parser holds no partial state and may be
+ * released (see ehttp_pool.h) until the connection becomes readable again.
+ */
+bool ehttp_is_idle(const ehttp_parser * const);
+
+/**
+ * True when the connection may carry another message after this one:
+ * HTTP/1.1 unless "Connection: close", HTTP/1.0 only with "Connection:
+ * keep-alive". Meaningful once the headers are parsed.
+ */
+bool ehttp_keep_alive(const ehttp_parser * const);
+
 /**
  * Sets empty default handlers for callbacks.
  */
 ehttp_callbacks *ehttp_defaults(ehttp_callbacks * const);
 
+typedef struct _ehttp_batch ehttp_batch;
+struct _ehttp_batch {
+  ehttp_parser *parser;
+  const void *data;
+  size_t size;
+  // ehttp_parse() result
+  int result;
+};
+
+#ifndef EHTTP_BATCH_PREFETCH
+// how many entries ahead parser and input are prefetched
+#define EHTTP_BATCH_PREFETCH 2
+#endif
+
+/**
+ * Runs ehttp_parse() on n connections made readable by one event loop
+ * wakeup, storing each result in its entry. The parser and the first input
+ * line of the entries ahead are prefetched while the current one is parsed.
+ */
+void ehttp_parse_batch(ehttp_batch * const restrict, size_t n,
+                       const ehttp_callbacks * const restrict);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
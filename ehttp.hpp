@@ -0,0 +1,610 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_HPP_VESTOL
+#define EHTTP_HPP_VESTOL
+
+#include <cerrno>
+#include <coroutine>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+#include <strings.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "ehttp.h"
+
+/*
+ * C++20 coroutine layer.
+ *
+ * A connection reads its socket into a fixed buffer and parses it in
+ * place: co_await conn.read_request() suspends until the head of the next
+ * request is parsed (on_headers_done returns EHTTP_PARSER_RETURN) and
+ * gives a view whose method, URI and header spans point into the buffer.
+ * co_await conn.read_body() then gives the body one read at a time, with
+ * chunk framing removed in place. The view stays valid until the next
+ * read_request(); a body left unread is skipped.
+ *
+ * Suspended connections wait on an epoll_loop. Coroutine frames of
+ * ehttp::task come from a per-thread frame_pool, so once the pool is warm
+ * handling a request allocates nothing.
+ *
+ *   ehttp::task serve(ehttp::connection<> &conn) {
+ *     while (const ehttp::request *req = co_await conn.read_request()) {
+ *       ...
+ *     }
+ *   }
+ */
+
+namespace ehttp {
+
+/**
+ * Recycles coroutine frames by size class. Frames freed on another thread
+ * go to that thread's pool.
+ */
+class frame_pool {
+ public:
+  static constexpr std::size_t min_size = 256;
+  static constexpr std::size_t classes = 7;
+  // larger frames use operator new
+  static constexpr std::size_t max_size = min_size << (classes - 1);
+
+  frame_pool() = default;
+  frame_pool(const frame_pool &) = delete;
+  frame_pool &operator=(const frame_pool &) = delete;
+
+  ~frame_pool() {
+    for (block *&head : free_) {
+      while (head) {
+        block *next = head->next;
+        ::operator delete(head);
+        head = next;
+      }
+    }
+  }
+
+  static frame_pool &local() {
+    static thread_local frame_pool pool;
+    return pool;
+  }
+
+  void *allocate(std::size_t size) {
+    std::size_t c = size_class(size);
+
+    if (c == classes) {
+      return ::operator new(size);
+    }
+    if (block *b = free_[c]) {
+      free_[c] = b->next;
+      return b;
+    }
+    return ::operator new(min_size << c);
+  }
+
+  void deallocate(void *p, std::size_t size) noexcept {
+    std::size_t c = size_class(size);
+
+    if (c == classes) {
+      ::operator delete(p);
+      return;
+    }
+    block *b = static_cast<block *>(p);
+    b->next = free_[c];
+    free_[c] = b;
+  }
+
+ private:
+  struct block {
+    block *next;
+  };
+
+  static std::size_t size_class(std::size_t size) {
+    std::size_t c = 0;
+
+    while (c < classes && (min_size << c) < size) {
+      c++;
+    }
+    return c;
+  }
+
+  block *free_[classes] = {};
+};
+
+/**
+ * Detached coroutine, started at once and destroyed when it returns.
+ */
+struct task {
+  struct promise_type {
+    task get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+
+    static void *operator new(std::size_t size) {
+      return frame_pool::local().allocate(size);
+    }
+
+    static void operator delete(void *p, std::size_t size) noexcept {
+      frame_pool::local().deallocate(p, size);
+    }
+  };
+};
+
+/**
+ * Minimal reactor: one shot readiness notifications on an epoll instance.
+ */
+class epoll_loop {
+ public:
+  struct watch {
+    void (*fn)(void *);
+    void *arg;
+  };
+
+  epoll_loop() : fd_(epoll_create1(EPOLL_CLOEXEC)) {}
+  epoll_loop(const epoll_loop &) = delete;
+  epoll_loop &operator=(const epoll_loop &) = delete;
+
+  ~epoll_loop() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  int fd() const { return fd_; }
+
+  /**
+   * Calls w->fn(w->arg) once fd is readable. Returns false with errno set
+   * when fd cannot be watched.
+   */
+  bool wait_readable(int fd, watch *w) {
+    epoll_event ev = {};
+
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = w;
+    if (epoll_ctl(fd_, EPOLL_CTL_MOD, fd, &ev) == 0) {
+      return true;
+    }
+    return errno == ENOENT && epoll_ctl(fd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+  }
+
+  /**
+   * Waits at most timeout milliseconds (-1 for ever) and runs the ready
+   * watches. Returns their count, or -1 with errno set.
+   */
+  int run_once(int timeout) {
+    epoll_event events[64];
+    int n = epoll_wait(fd_, events, 64, timeout);
+
+    for (int i = 0; i < n; i++) {
+      watch *w = static_cast<watch *>(events[i].data.ptr);
+      w->fn(w->arg);
+    }
+    return n;
+  }
+
+ private:
+  int fd_;
+};
+
+struct header {
+  std::string_view name;
+  std::string_view value;
+};
+
+struct request {
+  // ehttp_method, EHTTP_METHOD_UNKNOWN for extension methods
+  ehttp_method method;
+  std::string_view method_name;
+  std::string_view uri;
+  unsigned major;
+  unsigned minor;
+  bool has_content;
+  bool keep_alive;
+  bool expect_continue;
+  std::span<const header> headers;
+
+  /**
+   * The value of the first header called name (case insensitive), empty
+   * when missing.
+   */
+  std::string_view get(std::string_view name) const {
+    for (const header &h : headers) {
+      if (h.name.size() == name.size() &&
+          !strncasecmp(h.name.data(), name.data(), name.size())) {
+        return h.value;
+      }
+    }
+    return {};
+  }
+};
+
+/**
+ * A server connection on a non-blocking socket, owned by the caller.
+ * Buffer is the largest request head accepted, MaxHeaders the most header
+ * lines.
+ */
+template <std::size_t Buffer = 16384, std::size_t MaxHeaders = 64>
+class connection {
+ public:
+  connection(epoll_loop &loop, int fd) : loop_(loop), fd_(fd) {
+    ehttp_init(&parser_, EHTTP_MODE_REQUEST, this);
+  }
+
+  connection(const connection &) = delete;
+  connection &operator=(const connection &) = delete;
+
+  int fd() const { return fd_; }
+
+  // errno of the last failure, 0 at end of input, EMSGSIZE for a head too
+  // large, EPROTO when the request was invalid
+  int error() const { return error_; }
+
+  const ehttp_parser &parser() const { return parser_; }
+
+  /**
+   * Awaits the head of the next request. Gives nullptr at the end of the
+   * connection: see error().
+   */
+  auto read_request() { return awaiter<&connection::pump_request,
+                                       const request *>(*this); }
+
+  /**
+   * Awaits the next part of the body: empty once it is complete, or on
+   * failure (see error()).
+   */
+  auto read_body() { return awaiter<&connection::pump_body,
+                                    std::string_view>(*this); }
+
+ private:
+  enum class stage { idle, head, body, closed };
+  enum class step { pending, done };
+
+  template <step (connection::*Pump)(), class T>
+  struct awaiter {
+    connection &conn;
+    std::coroutine_handle<> handle;
+    epoll_loop::watch watch;
+
+    explicit awaiter(connection &c) : conn(c) {}
+
+    bool await_ready() { return (conn.*Pump)() == step::done; }
+
+    bool await_suspend(std::coroutine_handle<> h) {
+      handle = h;
+      watch = { &awaiter::ready, this };
+      if (conn.loop_.wait_readable(conn.fd_, &watch)) {
+        return true;
+      }
+      conn.fail(errno);
+      return false;
+    }
+
+    T await_resume() {
+      if constexpr (std::is_same_v<T, const request *>) {
+        return conn.stage_ == stage::closed ? nullptr : &conn.request_;
+      }
+      else {
+        return conn.body();
+      }
+    }
+
+    static void ready(void *arg) {
+      awaiter *self = static_cast<awaiter *>(arg);
+
+      if ((self->conn.*Pump)() == step::pending) {
+        if (self->conn.loop_.wait_readable(self->conn.fd_, &self->watch)) {
+          return;
+        }
+        self->conn.fail(errno);
+      }
+      self->handle.resume();
+    }
+  };
+
+  static const ehttp_callbacks *callbacks() {
+    static const ehttp_callbacks cb = [] {
+      ehttp_callbacks c;
+
+      ehttp_defaults(&c);
+      c.on_method = on_method;
+      c.on_request_uri = on_request_uri;
+      c.on_header_name = on_header_name;
+      c.on_header_name_done = on_header_name_done;
+      c.on_header_value = on_header_value;
+      c.on_headers_done = on_headers_done;
+      c.on_content = on_content;
+      c.on_parser_done = on_parser_done;
+      return c;
+    }();
+
+    return &cb;
+  }
+
+  static connection &self(ehttp_parser *s) {
+    return *static_cast<connection *>(s->context);
+  }
+
+  static std::string_view extend(std::string_view span, const uint8_t *at,
+                                 std::size_t len) {
+    const char *p = reinterpret_cast<const char *>(at);
+
+    if (span.empty()) {
+      return { p, len };
+    }
+    // pieces are contiguous: the head is never moved while parsed
+    return { span.data(), static_cast<std::size_t>(p + len - span.data()) };
+  }
+
+  static void on_method(ehttp_parser *s, const uint8_t *at, std::size_t len) {
+    request &r = self(s).request_;
+    r.method_name = extend(r.method_name, at, len);
+  }
+
+  static void on_request_uri(ehttp_parser *s, const uint8_t *at,
+                             std::size_t len) {
+    request &r = self(s).request_;
+    r.uri = extend(r.uri, at, len);
+  }
+
+  static void on_header_name(ehttp_parser *s, const uint8_t *at,
+                             std::size_t len) {
+    connection &c = self(s);
+
+    if (c.nameDone_ || !c.count_) {
+      c.nameDone_ = false;
+      if (c.count_ == MaxHeaders) {
+        c.overflow_ = true;
+        return;
+      }
+      c.headers_[c.count_++] = {};
+    }
+    if (!c.overflow_) {
+      header &h = c.headers_[c.count_ - 1];
+      h.name = extend(h.name, at, len);
+    }
+  }
+
+  static ehttp_ctrl on_header_name_done(ehttp_parser *s) {
+    self(s).nameDone_ = true;
+    return EHTTP_PARSER_CONTINUE;
+  }
+
+  static void on_header_value(ehttp_parser *s, const uint8_t *at,
+                              std::size_t len) {
+    connection &c = self(s);
+
+    if (!c.overflow_) {
+      header &h = c.headers_[c.count_ - 1];
+      h.value = extend(h.value, at, len);
+    }
+  }
+
+  static ehttp_ctrl on_headers_done(ehttp_parser *s) {
+    connection &c = self(s);
+
+    if (c.overflow_) {
+      return EHTTP_PARSER_ERROR;
+    }
+    c.stage_ = stage::body;
+    return EHTTP_PARSER_RETURN;
+  }
+
+  static void on_content(ehttp_parser *s, const uint8_t *at, std::size_t len) {
+    connection &c = self(s);
+
+    // framing bytes are dropped: the body only moves backwards
+    std::memmove(c.buffer_ + c.bodyEnd_, at, len);
+    c.bodyEnd_ += len;
+  }
+
+  static ehttp_ctrl on_parser_done(ehttp_parser *s) {
+    self(s).stage_ = stage::idle;
+    return EHTTP_PARSER_RETURN;
+  }
+
+  void fail(int error) {
+    error_ = error;
+    stage_ = stage::closed;
+  }
+
+  // parses the buffered bytes, true when the stage changed
+  bool parse() {
+    stage before = stage_;
+    int r = ehttp_parse(&parser_, buffer_ + pos_, filled_ - pos_,
+                        callbacks());
+
+    if (r < 0 || overflow_) {
+      fail(overflow_ ? EMSGSIZE : EPROTO);
+      return true;
+    }
+    pos_ = filled_ - r;
+    return stage_ != before;
+  }
+
+  // reads more input, pending when the socket would block
+  step fill() {
+    for (;;) {
+      ssize_t n = ::read(fd_, buffer_ + filled_, Buffer - filled_);
+
+      if (n > 0) {
+        filled_ += n;
+        return step::done;
+      }
+      if (n == 0) {
+        // a clean end between requests, or a truncated one
+        fail(ehttp_is_idle(&parser_) ? 0 : EPROTO);
+        return step::done;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return step::pending;
+      }
+      fail(errno);
+      return step::done;
+    }
+  }
+
+  void begin_request() {
+    std::size_t left = filled_ - pos_;
+
+    std::memmove(buffer_, buffer_ + pos_, left);
+    pos_ = 0;
+    filled_ = left;
+    ehttp_reset(&parser_, this);
+    request_ = {};
+    count_ = 0;
+    nameDone_ = false;
+    overflow_ = false;
+    stage_ = stage::head;
+  }
+
+  void end_head() {
+    request_.method = static_cast<ehttp_method>(parser_.method);
+    request_.major = parser_.majorVersion;
+    request_.minor = parser_.minorVersion;
+    request_.has_content = parser_.hasContent;
+    // HTTP/1.0 closes unless the client asked for keep-alive
+    request_.keep_alive = ehttp_keep_alive(&parser_);
+    last_ = !request_.keep_alive;
+    request_.expect_continue = parser_.expectContinue;
+    request_.headers = { headers_, count_ };
+    headEnd_ = pos_;
+    bodyEnd_ = pos_;
+    if (!parser_.hasContent) {
+      // the message ended with its head
+      stage_ = stage::idle;
+    }
+  }
+
+  step pump_request() {
+    // skip what is left of the previous body
+    if (stage_ == stage::body) {
+      parser_.skipBody = 1;
+      if (pump_body() == step::pending) {
+        return step::pending;
+      }
+    }
+
+    if (stage_ == stage::idle) {
+      if (last_) {
+        fail(0);
+        return step::done;
+      }
+      begin_request();
+    }
+
+    while (stage_ == stage::head) {
+      if ((pos_ < filled_ && parse()) || stage_ != stage::head) {
+        break;
+      }
+      if (filled_ == Buffer) {
+        fail(EMSGSIZE);
+        break;
+      }
+      if (fill() == step::pending) {
+        return step::pending;
+      }
+    }
+
+    // a message without a body is already idle
+    if (stage_ != stage::closed) {
+      end_head();
+    }
+    return step::done;
+  }
+
+  std::string_view body() const {
+    return { reinterpret_cast<const char *>(buffer_) + headEnd_,
+             bodyEnd_ - headEnd_ };
+  }
+
+  step pump_body() {
+    if (stage_ != stage::body) {
+      bodyEnd_ = headEnd_;
+      return step::done;
+    }
+
+    // the previous part has been consumed
+    std::size_t left = filled_ - pos_;
+
+    std::memmove(buffer_ + headEnd_, buffer_ + pos_, left);
+    pos_ = headEnd_;
+    filled_ = headEnd_ + left;
+    bodyEnd_ = headEnd_;
+
+    for (;;) {
+      if (pos_ < filled_) {
+        parse();
+      }
+      if (stage_ != stage::body || bodyEnd_ > headEnd_) {
+        return step::done;
+      }
+      // nothing kept: reuse the space
+      pos_ = filled_ = headEnd_;
+      if (headEnd_ == Buffer) {
+        fail(EMSGSIZE);
+        return step::done;
+      }
+      if (fill() == step::pending) {
+        return step::pending;
+      }
+    }
+  }
+
+  epoll_loop &loop_;
+  int fd_;
+  int error_ = 0;
+  stage stage_ = stage::idle;
+  // the current request closes the connection
+  bool last_ = false;
+  // the next header name piece starts a header
+  bool nameDone_ = false;
+  bool overflow_ = false;
+  ehttp_parser parser_;
+  request request_ = {};
+  header headers_[MaxHeaders];
+  std::size_t count_ = 0;
+  // parsed up to pos_, read up to filled_
+  std::size_t pos_ = 0;
+  std::size_t filled_ = 0;
+  // the body part is buffer_[headEnd_ .. bodyEnd_)
+  std::size_t headEnd_ = 0;
+  std::size_t bodyEnd_ = 0;
+  uint8_t buffer_[Buffer];
+};
+
+} // namespace ehttp
+
+#endif
@@ -0,0 +1,269 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ehttp_accesslog.h"
+
+static const char magic[4] = { 'E', 'H', 'A', 'L' };
+
+static const char * const methods[EHTTP_METHOD_MAX] = {
+  [EHTTP_METHOD_UNKNOWN] = "-",
+  [EHTTP_METHOD_GET] = "GET",
+  [EHTTP_METHOD_HEAD] = "HEAD",
+  [EHTTP_METHOD_POST] = "POST",
+  [EHTTP_METHOD_PUT] = "PUT",
+  [EHTTP_METHOD_PATCH] = "PATCH",
+  [EHTTP_METHOD_DELETE] = "DELETE",
+  [EHTTP_METHOD_CONNECT] = "CONNECT",
+  [EHTTP_METHOD_OPTIONS] = "OPTIONS",
+  [EHTTP_METHOD_TRACE] = "TRACE",
+};
+
+static uint64_t now_nanos(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+/**
+ * Creates (or truncates) the ring file path holding records records,
+ * rounded up to a power of two, and maps it. Returns NULL with errno set
+ * on failure.
+ */
+ehttp_accesslog *ehttp_accesslog_open(ehttp_accesslog * const restrict log,
+                                      const char * const restrict path,
+                                      size_t records) {
+  size_t capacity = 1;
+  size_t size;
+  void *map;
+  int fd;
+
+  while (capacity < records) {
+    capacity <<= 1;
+  }
+  if (capacity > UINT32_MAX) {
+    errno = EINVAL;
+    return NULL;
+  }
+  size = EHTTP_ACCESSLOG_DATA + capacity * sizeof(ehttp_access_record);
+
+  fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (ftruncate(fd, size) < 0 ||
+      (map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0))
+          == MAP_FAILED) {
+    int e = errno;
+
+    close(fd);
+    errno = e;
+    return NULL;
+  }
+  close(fd);
+
+  *log = (ehttp_accesslog) {
+    .header = map,
+    .records = (ehttp_access_record *) ((uint8_t *) map + EHTTP_ACCESSLOG_DATA),
+    .mapped = size,
+    .mask = capacity - 1,
+  };
+  *log->header = (ehttp_accesslog_header) {
+    .version = EHTTP_ACCESSLOG_VERSION,
+    .recordSize = sizeof(ehttp_access_record),
+    .capacity = capacity,
+    .pid = getpid(),
+  };
+  // written last: a file with the magic is complete
+  memcpy(log->header->magic, magic, sizeof(magic));
+
+  return log;
+}
+
+/**
+ * Returns the ring of the calling thread, opened on first use as
+ * dir/access-<pid>-<tid>.bin. NULL with errno set when it cannot be
+ * opened.
+ */
+ehttp_accesslog *ehttp_accesslog_local(const char * const dir,
+                                       size_t records) {
+  static _Thread_local ehttp_accesslog local;
+  char path[PATH_MAX];
+
+  if (local.header) {
+    return &local;
+  }
+
+  if (snprintf(path, sizeof(path), "%s/access-%ld-%ld.bin", dir,
+               (long) getpid(), (long) syscall(SYS_gettid))
+      >= (int) sizeof(path)) {
+    errno = ENAMETOOLONG;
+    return NULL;
+  }
+
+  return ehttp_accesslog_open(&local, path, records);
+}
+
+/**
+ * Unmaps the ring.
+ */
+void ehttp_accesslog_close(ehttp_accesslog * const log) {
+  if (log->header) {
+    munmap(log->header, log->mapped);
+    log->header = NULL;
+    log->records = NULL;
+  }
+}
+
+/**
+ * Call when a request starts, e.g. from on_method.
+ */
+void ehttp_access_start(ehttp_access_record * const rec) {
+  rec->time = now_nanos();
+  rec->uriHash = 2166136261u;
+  rec->uriLength = 0;
+  rec->uriCopied = 0;
+}
+
+/**
+ * Sets the response status and the duration, and appends the record.
+ */
+void ehttp_accesslog_commit(ehttp_accesslog * const restrict log,
+                            const ehttp_access_record * const restrict rec,
+                            uint16_t status) {
+  uint64_t head = log->header->head;
+  ehttp_access_record *slot = &log->records[head & log->mask];
+  uint64_t now = now_nanos();
+  uint64_t elapsed = now > rec->time ? (now - rec->time) / 1000 : 0;
+
+  *slot = *rec;
+  slot->status = status;
+  slot->duration = elapsed < UINT32_MAX ? elapsed : UINT32_MAX;
+
+  // a reader of the live ring sees whole records
+  __atomic_store_n(&log->header->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void print(FILE *out, const ehttp_access_record *r) {
+  time_t seconds = r->time / 1000000000u;
+  unsigned micros = r->time % 1000000000u / 1000;
+  const char *method = r->method < EHTTP_METHOD_MAX ? methods[r->method]
+                                                    : "-";
+  unsigned copied = r->uriCopied <= sizeof(r->uri) ? r->uriCopied
+                                                   : sizeof(r->uri);
+  struct tm tm;
+  char date[32];
+
+  gmtime_r(&seconds, &tm);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &tm);
+
+  fprintf(out, "%s.%06uZ %s %.*s%s HTTP/%u.%u %u %" PRIu32 "us len=%"
+          PRIu64 " uri=%08" PRIx32 "%s%s%s\n",
+          date, micros, method, (int) copied, r->uri,
+          r->uriLength > copied ? "..." : "", r->version >> 4,
+          r->version & 0xf, r->status, r->duration, r->contentLength,
+          r->uriHash,
+          r->flags & EHTTP_ACCESS_CLOSE ? " close" : "",
+          r->flags & EHTTP_ACCESS_CHUNKED ? " chunked" : "",
+          r->flags & EHTTP_ACCESS_UPGRADE ? " upgrade" : "");
+}
+
+/**
+ * Prints the records of a ring file, oldest first. Returns their count,
+ * or -1 with errno set.
+ */
+long ehttp_accesslog_dump(const char * const restrict path,
+                          FILE * const restrict out) {
+  ehttp_accesslog_header header;
+  ehttp_access_record record;
+  uint64_t first;
+  uint64_t i;
+  long n = 0;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0) {
+    return -1;
+  }
+
+  if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      memcmp(header.magic, magic, sizeof(magic)) ||
+      header.version != EHTTP_ACCESSLOG_VERSION ||
+      header.recordSize != sizeof(ehttp_access_record) ||
+      !header.capacity || (header.capacity & (header.capacity - 1))) {
+    close(fd);
+    errno = EINVAL;
+    return -1;
+  }
+
+  first = header.head > header.capacity ? header.head - header.capacity : 0;
+  for (i = first; i < header.head; i++) {
+    off_t offset = EHTTP_ACCESSLOG_DATA
+        + (off_t) (i & (header.capacity - 1)) * sizeof(record);
+
+    if (pread(fd, &record, sizeof(record), offset) != sizeof(record)) {
+      break;
+    }
+    print(out, &record);
+    n++;
+  }
+
+  close(fd);
+  return n;
+}
+
+#ifdef EHTTP_ACCESSLOG_MAIN
+int main(int argc, char **argv) {
+  int i;
+  int rc = 0;
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s ring-file...\n", argv[0]);
+    return 2;
+  }
+
+  for (i = 1; i < argc; i++) {
+    if (ehttp_accesslog_dump(argv[i], stdout) < 0) {
+      perror(argv[i]);
+      rc = 1;
+    }
+  }
+
+  return rc;
+}
+#endif
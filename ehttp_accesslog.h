@@ -0,0 +1,178 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_ACCESSLOG_VESTOL
+#define EHTTP_ACCESSLOG_VESTOL
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ehttp.h"
+
+/*
+ * Binary access log.
+ *
+ * A request is logged as one fixed size record of a cache line, filled
+ * from the parser callbacks into the connection state and copied by
+ * ehttp_accesslog_commit() into a ring file mapped with MAP_SHARED: no
+ * formatting, no system call and no lock, as every thread writes its own
+ * ring (see ehttp_accesslog_local()). The page cache keeps the records
+ * when the process dies. Once full, a ring overwrites its oldest records.
+ *
+ * ehttp_accesslog_dump() prints a ring as text, offline; build this file
+ * with -DEHTTP_ACCESSLOG_MAIN for a command line decoder.
+ */
+
+#define EHTTP_ACCESSLOG_VERSION 1
+// offset of the first record in a ring file
+#define EHTTP_ACCESSLOG_DATA 4096
+
+enum {
+  EHTTP_ACCESS_CLOSE = 1 << 0,
+  EHTTP_ACCESS_CHUNKED = 1 << 1,
+  EHTTP_ACCESS_UPGRADE = 1 << 2,
+};
+
+typedef struct _ehttp_access_record ehttp_access_record;
+struct _ehttp_access_record {
+  // start of the request, nanoseconds since the epoch
+  uint64_t time;
+  // of the request body
+  uint64_t contentLength;
+  // microseconds, saturated
+  uint32_t duration;
+  // FNV-1a of the whole URI
+  uint32_t uriHash;
+  // of the whole URI, saturated
+  uint16_t uriLength;
+  uint16_t status;
+  uint8_t method;
+  // EHTTP_ACCESS_*
+  uint8_t flags;
+  // major << 4 | minor
+  uint8_t version;
+  // bytes of uri used
+  uint8_t uriCopied;
+  char uri[32];
+};
+
+_Static_assert(sizeof(ehttp_access_record) == 64,
+               "a record is one cache line");
+
+typedef struct _ehttp_accesslog_header ehttp_accesslog_header;
+struct _ehttp_accesslog_header {
+  char magic[4];
+  uint16_t version;
+  uint16_t recordSize;
+  // records, a power of two
+  uint32_t capacity;
+  uint32_t pid;
+  // records ever written
+  uint64_t head;
+};
+
+typedef struct _ehttp_accesslog ehttp_accesslog;
+struct _ehttp_accesslog {
+  ehttp_accesslog_header *header;
+  ehttp_access_record *records;
+  size_t mapped;
+  uint32_t mask;
+};
+
+/**
+ * Creates (or truncates) the ring file path holding records records,
+ * rounded up to a power of two, and maps it. Returns NULL with errno set
+ * on failure.
+ */
+ehttp_accesslog *ehttp_accesslog_open(ehttp_accesslog * const restrict,
+                                      const char * const restrict path,
+                                      size_t records);
+
+/**
+ * Returns the ring of the calling thread, opened on first use as
+ * dir/access-<pid>-<tid>.bin. NULL with errno set when it cannot be
+ * opened.
+ */
+ehttp_accesslog *ehttp_accesslog_local(const char * const dir,
+                                       size_t records);
+
+/**
+ * Unmaps the ring.
+ */
+void ehttp_accesslog_close(ehttp_accesslog * const);
+
+/**
+ * Prints the records of a ring file, oldest first. Returns their count,
+ * or -1 with errno set.
+ */
+long ehttp_accesslog_dump(const char * const restrict path,
+                          FILE * const restrict out);
+
+/**
+ * Call when a request starts, e.g. from on_method.
+ */
+void ehttp_access_start(ehttp_access_record * const);
+
+/**
+ * Call from on_request_uri.
+ */
+static inline void ehttp_access_uri(ehttp_access_record * const restrict rec,
+                                    const uint8_t * const restrict at,
+                                    size_t len) {
+  size_t room = sizeof(rec->uri) - rec->uriCopied;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    rec->uriHash = (rec->uriHash ^ at[i]) * 16777619u;
+  }
+
+  memcpy(rec->uri + rec->uriCopied, at, len < room ? len : room);
+  rec->uriCopied += len < room ? len : room;
+  rec->uriLength = len < (size_t) UINT16_MAX - rec->uriLength
+      ? rec->uriLength + len : UINT16_MAX;
+}
+
+/**
+ * Call from on_headers_done, while the content length is still whole.
+ */
+static inline void ehttp_access_headers(ehttp_access_record * const restrict rec,
+                                        const ehttp_parser * const restrict s) {
+  rec->method = s->method;
+  rec->version = s->majorVersion << 4 | (s->minorVersion & 0xf);
+  rec->contentLength = s->isChunked ? 0 : s->contentLength;
+  rec->flags = (s->shouldClose ? EHTTP_ACCESS_CLOSE : 0)
+      | (s->isChunked ? EHTTP_ACCESS_CHUNKED : 0)
+      | (s->isUpgrade ? EHTTP_ACCESS_UPGRADE : 0);
+}
+
+/**
+ * Sets the response status and the duration, and appends the record.
+ */
+void ehttp_accesslog_commit(ehttp_accesslog * const restrict,
+                            const ehttp_access_record * const restrict,
+                            uint16_t status);
+
+#endif
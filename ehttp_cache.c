@@ -0,0 +1,448 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "ehttp_cache.h"
+
+_Static_assert((EHTTP_CACHE_SHARDS & (EHTTP_CACHE_SHARDS - 1)) == 0,
+               "EHTTP_CACHE_SHARDS must be a power of two");
+_Static_assert(EHTTP_CACHE_SHARDS <= 256, "shard index is a uint8_t");
+_Static_assert(EHTTP_CACHE_NAME_MAX < 0xff, "nameLen is a uint8_t");
+_Static_assert(EHTTP_CACHE_VARY_MAX < 0xff, "match is a uint8_t");
+_Static_assert(EHTTP_CACHE_KEY_MAX <= 0xffff, "key length is a uint16_t");
+
+#define FNV_OFFSET 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+static uint64_t now_nanos(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+static uint64_t mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+
+  return h;
+}
+
+static void append(ehttp_cache_key *key, const uint8_t *p, size_t len) {
+  uint64_t h = key->hash;
+
+  if (key->overflow || len > (size_t) EHTTP_CACHE_KEY_MAX - key->length) {
+    key->overflow = true;
+    return;
+  }
+
+  memcpy(key->bytes + key->length, p, len);
+  key->length += len;
+
+  while (len--) {
+    h = (h ^ *p++) * FNV_PRIME;
+  }
+
+  key->hash = h;
+}
+
+/**
+ * Prepares a cache of about maxEntries entries and maxBytes of responses.
+ * vary lists at most EHTTP_CACHE_VARY_MAX header names, referenced, not
+ * copied. Returns NULL when out of memory.
+ */
+ehttp_cache *ehttp_cache_init(ehttp_cache * const restrict cache,
+                              size_t maxEntries, size_t maxBytes,
+                              const char * const * restrict vary,
+                              size_t nvary) {
+  size_t slots = 1;
+  size_t i;
+
+  while (slots * EHTTP_CACHE_SHARDS < maxEntries) {
+    slots <<= 1;
+  }
+
+  memset(cache, 0, sizeof(*cache));
+  cache->slotMask = slots - 1;
+  cache->shardBytes = maxBytes / EHTTP_CACHE_SHARDS;
+  cache->nvary = nvary < EHTTP_CACHE_VARY_MAX ? nvary : EHTTP_CACHE_VARY_MAX;
+
+  for (i = 0; i < cache->nvary; i++) {
+    size_t len = strlen(vary[i]);
+
+    cache->vary[i] = vary[i];
+    cache->varyLen[i] = len <= EHTTP_CACHE_NAME_MAX ? len : 0;
+  }
+
+  for (i = 0; i < EHTTP_CACHE_SHARDS; i++) {
+    ehttp_cache_shard *shard = &cache->shards[i];
+
+    shard->slots = calloc(slots, sizeof(*shard->slots));
+    if (!shard->slots) {
+      while (i--) {
+        pthread_mutex_destroy(&cache->shards[i].lock);
+        free(cache->shards[i].slots);
+      }
+      return NULL;
+    }
+    pthread_mutex_init(&shard->lock, NULL);
+  }
+
+  return cache;
+}
+
+/**
+ * Starts the key of a new request.
+ */
+void ehttp_cache_key_init(ehttp_cache_key * const key) {
+  key->hash = FNV_OFFSET;
+  key->length = 0;
+  key->match = 0;
+  key->nameLen = 0;
+  key->newName = true;
+  key->overflow = false;
+}
+
+/**
+ * Call from on_request_uri.
+ */
+void ehttp_cache_key_uri(ehttp_cache_key * const restrict key,
+                         const uint8_t * const restrict at, size_t len) {
+  append(key, at, len);
+}
+
+/**
+ * Call from on_header_name.
+ */
+void ehttp_cache_key_name(ehttp_cache_key * const restrict key,
+                          const uint8_t * const restrict at, size_t len) {
+  if (key->newName) {
+    key->newName = false;
+    key->nameLen = 0;
+  }
+
+  if (len > (size_t) EHTTP_CACHE_NAME_MAX - key->nameLen) {
+    // too long to be in the vary list
+    key->nameLen = EHTTP_CACHE_NAME_MAX + 1;
+    return;
+  }
+
+  memcpy(key->name + key->nameLen, at, len);
+  key->nameLen += len;
+}
+
+/**
+ * Call from on_header_value.
+ */
+void ehttp_cache_key_value(const ehttp_cache * const restrict cache,
+                           ehttp_cache_key * const restrict key,
+                           const uint8_t * const restrict at, size_t len) {
+  if (!key->newName) {
+    // first piece of the value: the name is complete
+    size_t i;
+
+    key->newName = true;
+    key->match = 0;
+    for (i = 0; i < cache->nvary; i++) {
+      if (cache->varyLen[i] == key->nameLen &&
+          !strncasecmp((const char *) key->name, cache->vary[i],
+                       key->nameLen)) {
+        uint8_t tag[2] = { 0, i + 1 };
+
+        key->match = i + 1;
+        append(key, tag, sizeof(tag));
+        break;
+      }
+    }
+  }
+
+  if (key->match) {
+    append(key, at, len);
+  }
+}
+
+static void lru_unlink(ehttp_cache_shard *shard, ehttp_cache_entry *e) {
+  *(e->lruPrev ? &e->lruPrev->lruNext : &shard->lruHead) = e->lruNext;
+  *(e->lruNext ? &e->lruNext->lruPrev : &shard->lruTail) = e->lruPrev;
+}
+
+static void lru_push(ehttp_cache_shard *shard, ehttp_cache_entry *e) {
+  e->lruPrev = NULL;
+  e->lruNext = shard->lruHead;
+  *(shard->lruHead ? &shard->lruHead->lruPrev : &shard->lruTail) = e;
+  shard->lruHead = e;
+}
+
+static void entry_free(ehttp_cache_entry *e) {
+  free((void *) e->response);
+  free(e);
+}
+
+/*
+ * Removes an entry from the table, it is freed now or by the last
+ * release. Called with the shard locked.
+ */
+static void unlink_entry(ehttp_cache *cache, ehttp_cache_shard *shard,
+                         ehttp_cache_entry *e) {
+  ehttp_cache_entry **at = &shard->slots[e->hash & cache->slotMask];
+
+  while (*at != e) {
+    at = &(*at)->next;
+  }
+  *at = e->next;
+
+  if (!e->pending) {
+    lru_unlink(shard, e);
+    shard->bytes -= e->responseLength;
+  }
+  shard->count--;
+  e->dead = true;
+
+  if (!e->refs) {
+    entry_free(e);
+  }
+}
+
+/**
+ * Call from on_headers_done. Only GET and HEAD requests without content
+ * are cached. On EHTTP_CACHE_HIT and EHTTP_CACHE_MISS *entry is set, and
+ * on EHTTP_CACHE_WAIT the waiter is queued on the pending entry.
+ */
+ehttp_cache_result ehttp_cache_lookup(ehttp_cache * const restrict cache,
+                                      const ehttp_cache_key * const restrict key,
+                                      const ehttp_parser * const restrict parser,
+                                      ehttp_cache_waiter * const restrict waiter,
+                                      ehttp_cache_entry ** const restrict entry) {
+  ehttp_cache_shard *shard;
+  ehttp_cache_entry **slot;
+  ehttp_cache_entry *e;
+  uint64_t hash;
+  uint64_t now;
+  size_t index;
+
+  if (key->overflow || parser->hasContent ||
+      (parser->method != EHTTP_METHOD_GET &&
+       parser->method != EHTTP_METHOD_HEAD)) {
+    return EHTTP_CACHE_BYPASS;
+  }
+
+  hash = mix((key->hash ^ parser->method) * FNV_PRIME);
+  index = (hash >> 32) & (EHTTP_CACHE_SHARDS - 1);
+  shard = &cache->shards[index];
+  slot = &shard->slots[hash & cache->slotMask];
+  now = now_nanos();
+
+  pthread_mutex_lock(&shard->lock);
+
+  for (e = *slot; e; e = e->next) {
+    if (e->hash == hash && e->method == parser->method &&
+        e->keyLength == key->length &&
+        !memcmp(e->key, key->bytes, key->length)) {
+      break;
+    }
+  }
+
+  if (e && e->pending) {
+    waiter->next = e->waiters;
+    e->waiters = waiter;
+    shard->coalesced++;
+    pthread_mutex_unlock(&shard->lock);
+    return EHTTP_CACHE_WAIT;
+  }
+
+  if (e && e->expires <= now) {
+    unlink_entry(cache, shard, e);
+    e = NULL;
+  }
+
+  if (e) {
+    e->refs++;
+    lru_unlink(shard, e);
+    lru_push(shard, e);
+    shard->hits++;
+    pthread_mutex_unlock(&shard->lock);
+    *entry = e;
+    return EHTTP_CACHE_HIT;
+  }
+
+  e = malloc(sizeof(*e) + key->length);
+  if (!e) {
+    pthread_mutex_unlock(&shard->lock);
+    return EHTTP_CACHE_BYPASS;
+  }
+
+  *e = (ehttp_cache_entry) {
+    .next = *slot,
+    .hash = hash,
+    .refs = 1,
+    .keyLength = key->length,
+    .method = parser->method,
+    .shard = index,
+    .pending = true,
+  };
+  memcpy(e->key, key->bytes, key->length);
+  *slot = e;
+  shard->count++;
+  shard->misses++;
+
+  pthread_mutex_unlock(&shard->lock);
+
+  *entry = e;
+  return EHTTP_CACHE_MISS;
+}
+
+static void wake(ehttp_cache_waiter *w, ehttp_cache_entry *e) {
+  while (w) {
+    ehttp_cache_waiter *next = w->next;
+
+    w->ready(w, e);
+    w = next;
+  }
+}
+
+/**
+ * Stores the response of a pending entry for ttlNanos and wakes its
+ * waiters. The response is copied; one larger than the byte budget of a
+ * shard is only given to the waiters. Returns -1 when out of memory, the
+ * entry is then abandoned. Either way the filler must release entry.
+ */
+int ehttp_cache_fill(ehttp_cache * const restrict cache,
+                     ehttp_cache_entry * const restrict e,
+                     const uint8_t * const restrict response, size_t len,
+                     uint64_t ttlNanos) {
+  ehttp_cache_shard *shard = &cache->shards[e->shard];
+  ehttp_cache_waiter *waiters;
+  ehttp_cache_waiter *w;
+  uint8_t *copy = malloc(len ? len : 1);
+
+  if (!copy) {
+    ehttp_cache_abandon(cache, e);
+    return -1;
+  }
+  memcpy(copy, response, len);
+
+  pthread_mutex_lock(&shard->lock);
+
+  waiters = e->waiters;
+  e->waiters = NULL;
+  for (w = waiters; w; w = w->next) {
+    e->refs++;
+  }
+
+  e->response = copy;
+  e->responseLength = len;
+  e->expires = now_nanos() + ttlNanos;
+  e->pending = false;
+
+  lru_push(shard, e);
+  shard->bytes += len;
+
+  if (len > cache->shardBytes) {
+    unlink_entry(cache, shard, e);
+  }
+
+  while (shard->bytes > cache->shardBytes && shard->lruTail != e) {
+    unlink_entry(cache, shard, shard->lruTail);
+    shard->evictions++;
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+
+  wake(waiters, e);
+
+  return 0;
+}
+
+/**
+ * Removes a pending entry whose response is not cacheable, its waiters
+ * are called with NULL. The filler must still release entry.
+ */
+void ehttp_cache_abandon(ehttp_cache * const restrict cache,
+                         ehttp_cache_entry * const restrict e) {
+  ehttp_cache_shard *shard = &cache->shards[e->shard];
+  ehttp_cache_waiter *waiters;
+
+  pthread_mutex_lock(&shard->lock);
+  waiters = e->waiters;
+  e->waiters = NULL;
+  unlink_entry(cache, shard, e);
+  pthread_mutex_unlock(&shard->lock);
+
+  wake(waiters, NULL);
+}
+
+/**
+ * Drops a reference returned by a lookup or given to a waiter.
+ */
+void ehttp_cache_release(ehttp_cache * const restrict cache,
+                         ehttp_cache_entry * const restrict e) {
+  ehttp_cache_shard *shard = &cache->shards[e->shard];
+  bool last;
+
+  pthread_mutex_lock(&shard->lock);
+  last = !--e->refs && e->dead;
+  pthread_mutex_unlock(&shard->lock);
+
+  if (last) {
+    entry_free(e);
+  }
+}
+
+/**
+ * Frees every entry. Entries must not be pending or referenced anymore.
+ */
+void ehttp_cache_destroy(ehttp_cache * const cache) {
+  size_t i;
+  size_t j;
+
+  for (i = 0; i < EHTTP_CACHE_SHARDS; i++) {
+    ehttp_cache_shard *shard = &cache->shards[i];
+
+    for (j = 0; j <= cache->slotMask; j++) {
+      ehttp_cache_entry *e = shard->slots[j];
+
+      while (e) {
+        ehttp_cache_entry *next = e->next;
+
+        entry_free(e);
+        e = next;
+      }
+    }
+
+    pthread_mutex_destroy(&shard->lock);
+    free(shard->slots);
+    shard->slots = NULL;
+  }
+}
@@ -0,0 +1,233 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_CACHE_VESTOL
+#define EHTTP_CACHE_VESTOL
+
+#include <pthread.h>
+
+#include "ehttp.h"
+
+/*
+ * Response micro-cache.
+ *
+ * The cache key of a request is built while it is parsed: call
+ * ehttp_cache_key_uri() from on_request_uri, ehttp_cache_key_name() and
+ * ehttp_cache_key_value() from on_header_name and on_header_value, and
+ * look the key up from on_headers_done. The key holds the method, the URI
+ * and the values of the headers named in the vary list (add "host" there
+ * when serving several hosts). Vary values are tagged with their index in
+ * the list but kept in request order, so the same headers sent in another
+ * order only miss.
+ *
+ * Entries are complete serialised responses, written as they are. The
+ * table is split in EHTTP_CACHE_SHARDS shards, each with its own lock,
+ * hash chains, LRU list and share of the byte budget. Entries expire after
+ * their TTL and the least recently used ones are evicted when a shard is
+ * over budget.
+ *
+ * The first miss for a key inserts a pending entry and makes the caller
+ * its filler. Lookups of the same key then wait (coalesce) instead of
+ * also going to the backend: their waiter is called once the filler
+ * calls ehttp_cache_fill() or ehttp_cache_abandon().
+ */
+
+#ifndef EHTTP_CACHE_SHARDS
+#define EHTTP_CACHE_SHARDS 16
+#endif
+
+#ifndef EHTTP_CACHE_KEY_MAX
+#define EHTTP_CACHE_KEY_MAX 512
+#endif
+
+// longest header name compared to the vary list
+#ifndef EHTTP_CACHE_NAME_MAX
+#define EHTTP_CACHE_NAME_MAX 32
+#endif
+
+#ifndef EHTTP_CACHE_VARY_MAX
+#define EHTTP_CACHE_VARY_MAX 8
+#endif
+
+typedef enum {
+  // not cacheable (method, body or key too long): serve it normally
+  EHTTP_CACHE_BYPASS = 0,
+  // entry holds the response, release it once written
+  EHTTP_CACHE_HIT,
+  // the caller fills entry, or abandons it
+  EHTTP_CACHE_MISS,
+  // the waiter will be called
+  EHTTP_CACHE_WAIT,
+} ehttp_cache_result;
+
+typedef struct _ehttp_cache_key ehttp_cache_key;
+struct _ehttp_cache_key {
+  uint64_t hash;
+  uint16_t length;
+  // the current header is vary[match - 1], 0 for none
+  uint8_t match;
+  uint8_t nameLen;
+  // the next name piece starts a new header
+  bool newName;
+  bool overflow;
+  uint8_t name[EHTTP_CACHE_NAME_MAX];
+  uint8_t bytes[EHTTP_CACHE_KEY_MAX];
+};
+
+typedef struct _ehttp_cache_entry ehttp_cache_entry;
+
+typedef struct _ehttp_cache_waiter ehttp_cache_waiter;
+struct _ehttp_cache_waiter {
+  ehttp_cache_waiter *next;
+  /*
+   * Called without locks held, with a referenced entry to write and
+   * release, or NULL when the filler gave up and the request should be
+   * served normally.
+   */
+  void (*ready)(ehttp_cache_waiter *, ehttp_cache_entry *);
+  void *context;
+};
+
+struct _ehttp_cache_entry {
+  ehttp_cache_entry *next;
+  ehttp_cache_entry *lruPrev;
+  ehttp_cache_entry *lruNext;
+  ehttp_cache_waiter *waiters;
+  uint64_t hash;
+  uint64_t expires;
+  const uint8_t *response;
+  size_t responseLength;
+  uint32_t refs;
+  uint16_t keyLength;
+  uint8_t method;
+  uint8_t shard;
+  bool pending;
+  // unlinked from the table, freed with the last reference
+  bool dead;
+  uint8_t key[];
+};
+
+typedef struct _ehttp_cache_shard ehttp_cache_shard;
+struct _ehttp_cache_shard {
+  pthread_mutex_t lock;
+  ehttp_cache_entry **slots;
+  // most recently used first
+  ehttp_cache_entry *lruHead;
+  ehttp_cache_entry *lruTail;
+  size_t bytes;
+  size_t count;
+  /* stats */
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t coalesced;
+  uint64_t evictions;
+} __attribute__((aligned(64)));
+
+typedef struct _ehttp_cache ehttp_cache;
+struct _ehttp_cache {
+  ehttp_cache_shard shards[EHTTP_CACHE_SHARDS];
+  size_t slotMask;
+  size_t shardBytes;
+  const char *vary[EHTTP_CACHE_VARY_MAX];
+  uint8_t varyLen[EHTTP_CACHE_VARY_MAX];
+  size_t nvary;
+};
+
+/**
+ * Prepares a cache of about maxEntries entries and maxBytes of responses.
+ * vary lists at most EHTTP_CACHE_VARY_MAX header names, referenced, not
+ * copied. Returns NULL when out of memory.
+ */
+ehttp_cache *ehttp_cache_init(ehttp_cache * const restrict,
+                              size_t maxEntries, size_t maxBytes,
+                              const char * const * restrict vary,
+                              size_t nvary);
+
+/**
+ * Starts the key of a new request.
+ */
+void ehttp_cache_key_init(ehttp_cache_key * const);
+
+/**
+ * Call from on_request_uri.
+ */
+void ehttp_cache_key_uri(ehttp_cache_key * const restrict,
+                         const uint8_t * const restrict, size_t);
+
+/**
+ * Call from on_header_name.
+ */
+void ehttp_cache_key_name(ehttp_cache_key * const restrict,
+                          const uint8_t * const restrict, size_t);
+
+/**
+ * Call from on_header_value.
+ */
+void ehttp_cache_key_value(const ehttp_cache * const restrict,
+                           ehttp_cache_key * const restrict,
+                           const uint8_t * const restrict, size_t);
+
+/**
+ * Call from on_headers_done. Only GET and HEAD requests without content
+ * are cached. On EHTTP_CACHE_HIT and EHTTP_CACHE_MISS *entry is set, and
+ * on EHTTP_CACHE_WAIT the waiter is queued on the pending entry.
+ */
+ehttp_cache_result ehttp_cache_lookup(ehttp_cache * const restrict,
+                                      const ehttp_cache_key * const restrict,
+                                      const ehttp_parser * const restrict,
+                                      ehttp_cache_waiter * const restrict,
+                                      ehttp_cache_entry ** const restrict entry);
+
+/**
+ * Stores the response of a pending entry for ttlNanos and wakes its
+ * waiters. The response is copied; one larger than the byte budget of a
+ * shard is only given to the waiters. Returns -1 when out of memory, the
+ * entry is then abandoned. Either way the filler must release entry.
+ */
+int ehttp_cache_fill(ehttp_cache * const restrict,
+                     ehttp_cache_entry * const restrict,
+                     const uint8_t * const restrict response, size_t,
+                     uint64_t ttlNanos);
+
+/**
+ * Removes a pending entry whose response is not cacheable, its waiters
+ * are called with NULL. The filler must still release entry.
+ */
+void ehttp_cache_abandon(ehttp_cache * const restrict,
+                         ehttp_cache_entry * const restrict);
+
+/**
+ * Drops a reference returned by a lookup or given to a waiter.
+ */
+void ehttp_cache_release(ehttp_cache * const restrict,
+                         ehttp_cache_entry * const restrict);
+
+/**
+ * Frees every entry. Entries must not be pending or referenced anymore.
+ */
+void ehttp_cache_destroy(ehttp_cache * const);
+
+#endif
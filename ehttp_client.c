@@ -0,0 +1,661 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ehttp_client.h"
+#include "ehttp_internal.h"
+
+// iovecs gathered from the queue per writev()
+#define WRITE_IOV 64
+
+/**
+ * Prepares the pool of one server address, keeping at most maxIdle idle
+ * connections and maxPipeline (at least 1) requests per connection.
+ */
+ehttp_upstream *ehttp_upstream_init(ehttp_upstream * const restrict up,
+                                    const struct sockaddr * const restrict addr,
+                                    socklen_t addrLen, unsigned maxIdle,
+                                    unsigned maxPipeline) {
+  if (addrLen > sizeof(up->addr)) {
+    return NULL;
+  }
+
+  *up = (ehttp_upstream) {
+    .addrLen = addrLen,
+    .maxIdle = maxIdle,
+    .maxPipeline = maxPipeline ? maxPipeline : 1,
+  };
+  memcpy(&up->addr, addr, addrLen);
+
+  return up;
+}
+
+static void idle_remove(ehttp_upstream *up, ehttp_conn *conn) {
+  for (ehttp_conn **at = &up->idle; *at; at = &(*at)->idleNext) {
+    if (*at == conn) {
+      *at = conn->idleNext;
+      up->idleCount--;
+      conn->idle = false;
+      return;
+    }
+  }
+}
+
+// fails the queued exchanges, then frees the connection
+static void conn_close(ehttp_conn *conn) {
+  ehttp_upstream *up = conn->upstream;
+  ehttp_exchange *ex = conn->queue;
+
+  if (conn->idle) {
+    idle_remove(up, conn);
+  }
+
+  if (conn->prev) {
+    conn->prev->next = conn->next;
+  }
+  else {
+    up->conns = conn->next;
+  }
+  if (conn->next) {
+    conn->next->prev = conn->prev;
+  }
+
+  close(conn->fd);
+  free(conn);
+
+  while (ex) {
+    ehttp_exchange *next = ex->next;
+
+    ex->done(ex, -1);
+    ex = next;
+  }
+}
+
+static ehttp_conn *conn_open(ehttp_upstream *up) {
+  ehttp_conn *conn = malloc(sizeof(*conn));
+  int one = 1;
+
+  if (!conn) {
+    return NULL;
+  }
+
+  conn->fd = socket(up->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (conn->fd < 0) {
+    free(conn);
+    return NULL;
+  }
+
+  if (up->addr.ss_family == AF_INET || up->addr.ss_family == AF_INET6) {
+    (void) setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+
+  conn->connecting = false;
+  if (connect(conn->fd, (const struct sockaddr *) &up->addr, up->addrLen) < 0) {
+    if (errno != EINPROGRESS) {
+      int err = errno;
+
+      close(conn->fd);
+      free(conn);
+      errno = err;
+      return NULL;
+    }
+    conn->connecting = true;
+  }
+
+  conn->prev = NULL;
+  conn->next = up->conns;
+  if (up->conns) {
+    up->conns->prev = conn;
+  }
+  up->conns = conn;
+
+  conn->idleNext = NULL;
+  conn->upstream = up;
+  conn->idle = false;
+  conn->closing = false;
+  conn->queue = NULL;
+  conn->tail = &conn->queue;
+  conn->unsent = NULL;
+  conn->queued = 0;
+  ehttp_init(&conn->parser, EHTTP_MODE_RESPONSE, NULL);
+
+  up->connects++;
+  return conn;
+}
+
+/**
+ * A connection to queue a request on: an idle one, one with room in its
+ * pipeline, or a new one whose non-blocking connect() is in progress.
+ * NULL with errno set when a connection cannot be created.
+ */
+ehttp_conn *ehttp_upstream_acquire(ehttp_upstream * const up) {
+  ehttp_conn *conn = up->idle;
+
+  if (conn) {
+    up->idle = conn->idleNext;
+    up->idleCount--;
+    conn->idle = false;
+    up->reuses++;
+    return conn;
+  }
+
+  if (up->maxPipeline > 1) {
+    for (conn = up->conns; conn; conn = conn->next) {
+      if (!conn->closing && conn->queued < up->maxPipeline) {
+        up->reuses++;
+        return conn;
+      }
+    }
+  }
+
+  return conn_open(up);
+}
+
+/**
+ * Queues an exchange; its request is written by ehttp_conn_writable().
+ */
+void ehttp_conn_submit(ehttp_conn * const restrict conn,
+                       ehttp_exchange * const restrict ex) {
+  ex->next = NULL;
+  ex->iovNext = 0;
+  ex->iovOffset = 0;
+
+  *conn->tail = ex;
+  conn->tail = &ex->next;
+  if (!conn->unsent) {
+    conn->unsent = ex;
+  }
+
+  // the first response is parsed on behalf of the head of the queue
+  if (conn->queue == ex) {
+    conn->parser.context = ex;
+    conn->parser.requestMethod = ex->method;
+  }
+
+  conn->queued++;
+}
+
+/**
+ * True while request bytes wait for the socket to become writable.
+ */
+bool ehttp_conn_wants_write(const ehttp_conn * const conn) {
+  return conn->connecting || conn->unsent;
+}
+
+/**
+ * Completes the connect() and writes queued requests, several per
+ * writev(). Returns 1 when everything was written, 0 when the socket would
+ * block and -1 when the connection failed: its exchanges are done with -1
+ * and the connection is freed.
+ */
+int ehttp_conn_writable(ehttp_conn * const conn) {
+  if (conn->connecting) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+      conn_close(conn);
+      return -1;
+    }
+    conn->connecting = false;
+  }
+
+  while (conn->unsent) {
+    struct iovec iov[WRITE_IOV];
+    int n = 0;
+    ssize_t r;
+
+    // gather the pending requests, the first one possibly half written
+    for (ehttp_exchange *ex = conn->unsent; ex && n < WRITE_IOV; ex = ex->next) {
+      for (size_t i = ex->iovNext; i < ex->iovcnt && n < WRITE_IOV; i++) {
+        size_t skip = (i == ex->iovNext) ? ex->iovOffset : 0;
+
+        iov[n++] = (struct iovec) {
+          .iov_base = (uint8_t *) ex->iov[i].iov_base + skip,
+          .iov_len = ex->iov[i].iov_len - skip,
+        };
+      }
+    }
+
+    r = writev(conn->fd, iov, n);
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return 0;
+      }
+      conn_close(conn);
+      return -1;
+    }
+
+    // advance the exchanges by what was written
+    while (conn->unsent) {
+      ehttp_exchange *ex = conn->unsent;
+
+      if (ex->iovNext == ex->iovcnt) {
+        conn->unsent = ex->next;
+        continue;
+      }
+
+      size_t left = ex->iov[ex->iovNext].iov_len - ex->iovOffset;
+
+      if ((size_t) r < left) {
+        ex->iovOffset += r;
+        break;
+      }
+
+      r -= left;
+      ex->iovNext++;
+      ex->iovOffset = 0;
+    }
+  }
+
+  return 1;
+}
+
+// the exchange at the head of the queue got its response
+static void complete(ehttp_conn *conn) {
+  ehttp_upstream *up = conn->upstream;
+  ehttp_exchange *ex = conn->queue;
+
+  conn->queue = ex->next;
+  if (!conn->queue) {
+    conn->tail = &conn->queue;
+  }
+  conn->queued--;
+
+  if (!ehttp_keep_alive(&conn->parser)) {
+    conn->closing = true;
+  }
+
+  ehttp_reset(&conn->parser, conn->queue);
+  if (conn->queue) {
+    conn->parser.requestMethod = conn->queue->method;
+  }
+  ex->done(ex, 0);
+
+  if (conn->queue || conn->closing || conn->idle) {
+    return;
+  }
+
+  if (up->idleCount < up->maxIdle) {
+    conn->idle = true;
+    conn->idleNext = up->idle;
+    up->idle = conn;
+    up->idleCount++;
+  }
+  else {
+    conn->closing = true;
+  }
+}
+
+/**
+ * Reads and parses responses, completing exchanges in order. Returns 0,
+ * or -1 when the connection was closed (by the server, on a parse error or
+ * because a response asked for it): remaining exchanges are done with -1
+ * and the connection is freed.
+ */
+int ehttp_conn_readable(ehttp_conn * const conn) {
+  for (;;) {
+    ssize_t r = read(conn->fd, conn->buffer, sizeof(conn->buffer));
+    const uint8_t *at = conn->buffer;
+
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      conn_close(conn);
+      return -1;
+    }
+    else if (r == 0) {
+      // the end of a close-delimited response
+      if (conn->queue
+          && ehttp_parse_end(&conn->parser, conn->queue->callbacks) == 0
+          && conn->parser.state == S_STATE_END) {
+        complete(conn);
+      }
+
+      conn_close(conn);
+      return -1;
+    }
+
+    while (r > 0) {
+      int left;
+
+      // a response nobody asked for
+      if (!conn->queue) {
+        conn_close(conn);
+        return -1;
+      }
+
+      left = ehttp_parse(&conn->parser, at, r, conn->queue->callbacks);
+      if (left < 0) {
+        conn_close(conn);
+        return -1;
+      }
+
+      if (conn->parser.state != S_STATE_END) {
+        break;
+      }
+
+      // pipelined responses follow
+      at += r - left;
+      r = left;
+
+      // the final response is still to come
+      if (conn->parser.statusCode >= 100 && conn->parser.statusCode < 200
+          && conn->parser.statusCode != 101) {
+        ehttp_reset(&conn->parser, conn->queue);
+        conn->parser.requestMethod = conn->queue->method;
+        continue;
+      }
+
+      complete(conn);
+    }
+  }
+
+  if (conn->closing && !conn->queue) {
+    conn_close(conn);
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Closes every connection, failing their exchanges.
+ */
+void ehttp_upstream_destroy(ehttp_upstream * const up) {
+  while (up->conns) {
+    conn_close(up->conns);
+  }
+}
+
+#ifdef EHTTP_CLIENT_BENCH
+#include <arpa/inet.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/*
+ * Runs requests against a stub server forked on the loopback interface,
+ * with a connection per request, with pooled keep-alive connections and
+ * with pooled connections pipelining 8 requests.
+ * Usage: [requests] [concurrency]
+ */
+
+#define BENCH_FDS 1024
+
+static const char benchRequest[] = "GET / HTTP/1.1\r\nHost: bench\r\n\r\n";
+static const char benchResponse[] =
+  "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+
+static double bench_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// answers every request head with benchResponse until killed
+static void bench_server(int listener) {
+  struct pollfd fds[BENCH_FDS] = { { .fd = listener, .events = POLLIN } };
+  // bytes of "\r\n\r\n" matched so far, per client
+  unsigned matched[BENCH_FDS] = { 0 };
+  char response[sizeof(benchResponse) * 64];
+  nfds_t count = 1;
+  char buf[4096];
+
+  for (;;) {
+    poll(fds, count, -1);
+
+    if (fds[0].revents & POLLIN) {
+      int fd = accept(listener, NULL, NULL);
+
+      if (fd >= 0 && count < BENCH_FDS) {
+        fds[count] = (struct pollfd) { .fd = fd, .events = POLLIN };
+        matched[count++] = 0;
+      }
+      else if (fd >= 0) {
+        close(fd);
+      }
+    }
+
+    for (nfds_t i = 1; i < count; i++) {
+      ssize_t r;
+      size_t heads = 0;
+      size_t len = 0;
+
+      if (!fds[i].revents) {
+        continue;
+      }
+      if ((r = read(fds[i].fd, buf, sizeof(buf))) <= 0) {
+        close(fds[i].fd);
+        fds[i] = fds[--count];
+        matched[i--] = matched[count];
+        continue;
+      }
+
+      for (ssize_t k = 0; k < r; k++) {
+        if (buf[k] == "\r\n\r\n"[matched[i]]) {
+          if (++matched[i] == 4) {
+            matched[i] = 0;
+            heads++;
+          }
+        }
+        else {
+          matched[i] = buf[k] == '\r';
+        }
+      }
+
+      while (heads--) {
+        memcpy(response + len, benchResponse, sizeof(benchResponse) - 1);
+        len += sizeof(benchResponse) - 1;
+        if (len + sizeof(benchResponse) > sizeof(response) || !heads) {
+          if (write(fds[i].fd, response, len) != (ssize_t) len) {
+            break;
+          }
+          len = 0;
+        }
+      }
+    }
+  }
+}
+
+typedef struct {
+  ehttp_exchange ex;
+  bool busy;
+  int status;
+} bench_exchange;
+
+static void bench_done(ehttp_exchange *ex, int status) {
+  bench_exchange *b = (bench_exchange *) ex;
+
+  b->busy = false;
+  b->status = status;
+}
+
+// requests run concurrency at a time, -1 when one fails
+static int bench_run(ehttp_upstream *up, size_t requests,
+                     bench_exchange *slots, size_t concurrency) {
+  static const struct iovec iov = {
+    .iov_base = (void *) benchRequest,
+    .iov_len = sizeof(benchRequest) - 1,
+  };
+  ehttp_callbacks cb;
+  size_t issued = 0;
+  size_t done = 0;
+
+  ehttp_defaults(&cb);
+  for (size_t i = 0; i < concurrency; i++) {
+    slots[i].busy = false;
+    slots[i].status = 1;
+  }
+
+  while (done < requests) {
+    struct pollfd fds[BENCH_FDS];
+    ehttp_conn *conns[BENCH_FDS];
+    nfds_t count = 0;
+
+    for (size_t i = 0; i < concurrency; i++) {
+      ehttp_conn *conn;
+
+      if (slots[i].busy) {
+        continue;
+      }
+      if (slots[i].status < 0) {
+        return -1;
+      }
+      if (slots[i].status == 0) {
+        slots[i].status = 1;
+        done++;
+      }
+      if (issued == requests) {
+        continue;
+      }
+      if (!(conn = ehttp_upstream_acquire(up))) {
+        return -1;
+      }
+      slots[i].ex = (ehttp_exchange) {
+        .iov = &iov,
+        .iovcnt = 1,
+        .callbacks = &cb,
+        .done = bench_done,
+        .method = EHTTP_METHOD_GET,
+      };
+      slots[i].busy = true;
+      ehttp_conn_submit(conn, &slots[i].ex);
+      issued++;
+    }
+
+    for (ehttp_conn *conn = up->conns; conn && count < BENCH_FDS;
+         conn = conn->next) {
+      conns[count] = conn;
+      fds[count++] = (struct pollfd) {
+        .fd = conn->fd,
+        .events = POLLIN | (ehttp_conn_wants_write(conn) ? POLLOUT : 0),
+      };
+    }
+    if (done == requests) {
+      break;
+    }
+    poll(fds, count, 1000);
+
+    // a connection is only freed by its own call
+    for (nfds_t i = 0; i < count; i++) {
+      if ((fds[i].revents & (POLLOUT | POLLERR)) &&
+          ehttp_conn_writable(conns[i]) < 0) {
+        continue;
+      }
+      if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+        ehttp_conn_readable(conns[i]);
+      }
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  static const struct {
+    const char *name;
+    bool pooled;
+    unsigned pipeline;
+  } modes[] = {
+    { "connection per request", false, 1 },
+    { "keep-alive pool", true, 1 },
+    { "keep-alive pool, pipelined", true, 8 },
+  };
+  size_t requests = argc > 1 ? (size_t) atol(argv[1]) : 20000;
+  size_t concurrency = argc > 2 ? (size_t) atol(argv[2]) : 16;
+  struct sockaddr_in addr = {
+    .sin_family = AF_INET,
+    .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+  socklen_t addrLen = sizeof(addr);
+  bench_exchange *slots = calloc(concurrency, sizeof(*slots));
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int rc = 0;
+  pid_t server;
+
+  if (!slots || !requests || !concurrency || concurrency >= BENCH_FDS) {
+    fprintf(stderr, "usage: %s [requests] [concurrency < %d]\n", argv[0],
+            BENCH_FDS);
+    return 2;
+  }
+  if (listener < 0 ||
+      bind(listener, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+      listen(listener, 1024) < 0 ||
+      getsockname(listener, (struct sockaddr *) &addr, &addrLen) < 0) {
+    perror("stub server");
+    return 1;
+  }
+  if ((server = fork()) == 0) {
+    bench_server(listener);
+  }
+  close(listener);
+
+  for (size_t k = 0; k < sizeof(modes) / sizeof(*modes); k++) {
+    ehttp_upstream up;
+    double elapsed;
+
+    // without idle connections, each one closes after its response
+    ehttp_upstream_init(&up, (struct sockaddr *) &addr, addrLen,
+                        modes[k].pooled ? concurrency : 0, modes[k].pipeline);
+
+    elapsed = bench_now();
+    if (bench_run(&up, requests, slots, concurrency) < 0) {
+      fprintf(stderr, "%s: a request failed\n", modes[k].name);
+      rc = 1;
+    }
+    elapsed = bench_now() - elapsed;
+
+    printf("%s: %.0f requests/s, %llu connects, %llu reuses\n",
+           modes[k].name, requests / elapsed,
+           (unsigned long long) up.connects, (unsigned long long) up.reuses);
+    ehttp_upstream_destroy(&up);
+  }
+
+  kill(server, SIGTERM);
+  waitpid(server, NULL, 0);
+  free(slots);
+  return rc;
+}
+#endif
@@ -0,0 +1,164 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_CLIENT_VESTOL
+#define EHTTP_CLIENT_VESTOL
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "ehttp.h"
+
+/*
+ * Non-blocking upstream client.
+ *
+ * An ehttp_upstream is the connection pool of one server address. Requests
+ * (exchanges) are queued on a connection and written back to back, with
+ * up to maxPipeline awaiting their response. Responses are parsed with
+ * EHTTP_MODE_RESPONSE in the order the requests were sent. When the queue
+ * of a connection drains it returns to the idle pool, unless the response
+ * does not keep it alive (see ehttp_keep_alive()). Interim 1xx responses
+ * are passed to the callbacks and the exchange waits for the final one. A
+ * close-delimited response completes when the server closes the
+ * connection.
+ *
+ * No event loop is assumed: the caller polls conn->fd, calls
+ * ehttp_conn_writable() while ehttp_conn_wants_write() is true and calls
+ * ehttp_conn_readable() on input, idle connections included so that a
+ * server side close is noticed.
+ *
+ * Build ehttp_client.c with -DEHTTP_CLIENT_BENCH for a benchmark against a
+ * local stub server, with and without the pool.
+ */
+
+#ifndef EHTTP_CLIENT_BUFFER
+#define EHTTP_CLIENT_BUFFER (16 * 1024)
+#endif
+
+typedef struct _ehttp_exchange ehttp_exchange;
+struct _ehttp_exchange {
+  ehttp_exchange *next;
+  // request bytes, referenced until written
+  const struct iovec *iov;
+  size_t iovcnt;
+  // response callbacks, parser->context is the exchange; they must not
+  // return EHTTP_PARSER_RETURN
+  const ehttp_callbacks *callbacks;
+  // called once: 0 after the response, -1 when the connection failed first
+  void (*done)(ehttp_exchange *, int);
+  void *context;
+  // ehttp_method of the request, for the response framing
+  uint8_t method;
+  // write progress
+  size_t iovNext;
+  size_t iovOffset;
+};
+
+typedef struct _ehttp_upstream ehttp_upstream;
+typedef struct _ehttp_conn ehttp_conn;
+
+struct _ehttp_conn {
+  ehttp_conn *prev;
+  ehttp_conn *next;
+  ehttp_conn *idleNext;
+  ehttp_upstream *upstream;
+  int fd;
+  bool connecting;
+  bool idle;
+  // no new exchanges, closed once the queue drains
+  bool closing;
+  // exchanges in request order, unsent points into the queue
+  ehttp_exchange *queue;
+  ehttp_exchange **tail;
+  ehttp_exchange *unsent;
+  size_t queued;
+  ehttp_parser parser;
+  uint8_t buffer[EHTTP_CLIENT_BUFFER];
+};
+
+struct _ehttp_upstream {
+  struct sockaddr_storage addr;
+  socklen_t addrLen;
+  unsigned maxIdle;
+  unsigned maxPipeline;
+  // every connection, and the idle ones
+  ehttp_conn *conns;
+  ehttp_conn *idle;
+  unsigned idleCount;
+  /* stats */
+  uint64_t connects;
+  uint64_t reuses;
+};
+
+/**
+ * Prepares the pool of one server address, keeping at most maxIdle idle
+ * connections and maxPipeline (at least 1) requests per connection.
+ */
+ehttp_upstream *ehttp_upstream_init(ehttp_upstream * const restrict,
+                                    const struct sockaddr * const restrict,
+                                    socklen_t, unsigned maxIdle,
+                                    unsigned maxPipeline);
+
+/**
+ * A connection to queue a request on: an idle one, one with room in its
+ * pipeline, or a new one whose non-blocking connect() is in progress.
+ * NULL with errno set when a connection cannot be created.
+ */
+ehttp_conn *ehttp_upstream_acquire(ehttp_upstream * const);
+
+/**
+ * Queues an exchange; its request is written by ehttp_conn_writable().
+ */
+void ehttp_conn_submit(ehttp_conn * const restrict,
+                       ehttp_exchange * const restrict);
+
+/**
+ * True while request bytes wait for the socket to become writable.
+ */
+bool ehttp_conn_wants_write(const ehttp_conn * const);
+
+/**
+ * Completes the connect() and writes queued requests, several per
+ * writev(). Returns 1 when everything was written, 0 when the socket would
+ * block and -1 when the connection failed: its exchanges are done with -1
+ * and the connection is freed.
+ */
+int ehttp_conn_writable(ehttp_conn * const);
+
+/**
+ * Reads and parses responses, completing exchanges in order. Returns 0,
+ * or -1 when the connection was closed (by the server, on a parse error or
+ * because a response asked for it): remaining exchanges are done with -1
+ * and the connection is freed.
+ */
+int ehttp_conn_readable(ehttp_conn * const);
+
+/**
+ * Closes every connection, failing their exchanges.
+ */
+void ehttp_upstream_destroy(ehttp_upstream * const);
+
+#endif
@@ -0,0 +1,240 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ehttp_cookie.h"
+
+_Static_assert(EHTTP_COOKIE_MAX < 0xff, "slots store cookie index + 1");
+_Static_assert((EHTTP_COOKIE_SLOTS & (EHTTP_COOKIE_SLOTS - 1)) == 0,
+               "EHTTP_COOKIE_SLOTS must be a power of two");
+
+static uint32_t hash(const uint8_t *p, size_t len) {
+  uint32_t h = 2166136261u;
+
+  while (len--) {
+    h = (h ^ *p++) * 16777619u;
+  }
+
+  return h;
+}
+
+static const uint8_t *find_semicolon(const uint8_t *p, const uint8_t *end) {
+  const uint8_t *q;
+
+#ifdef __SSE2__
+  const __m128i semi = _mm_set1_epi8(';');
+
+  for (; end - p >= 16; p += 16) {
+    int mask = _mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) p), semi));
+    if (mask) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+#endif
+
+  q = memchr(p, ';', end - p);
+  return q ? q : end;
+}
+
+static bool is_ows(uint8_t c) {
+  return c == ' ' || c == '\t';
+}
+
+static void build_index(ehttp_cookies * const c) {
+  const uint8_t *p = c->at, *end = c->at + c->len, *semi, *eq, *n, *ne, *v, *ve;
+  uint32_t h, slot;
+
+  c->indexed = 1;
+
+  for (; p < end; p = semi + 1) {
+    semi = find_semicolon(p, end);
+
+    for (n = p; n < semi && is_ows(*n); n++);
+    for (ve = semi; ve > n && is_ows(ve[-1]); ve--);
+
+    eq = memchr(n, '=', ve - n);
+    if (!eq || eq == n) {
+      continue;
+    }
+
+    for (ne = eq; ne > n && is_ows(ne[-1]); ne--);
+    for (v = eq + 1; v < ve && is_ows(*v); v++);
+
+    if (c->count == EHTTP_COOKIE_MAX) {
+      c->truncated = 1;
+      return;
+    }
+
+    // the first cookie of a name wins
+    h = hash(n, ne - n);
+    for (slot = h & (EHTTP_COOKIE_SLOTS - 1); c->slots[slot];
+         slot = (slot + 1) & (EHTTP_COOKIE_SLOTS - 1)) {
+      const ehttp_cookie *e = &c->cookies[c->slots[slot] - 1];
+      if (e->nameLen == (size_t) (ne - n)
+          && memcmp(c->at + e->name, n, ne - n) == 0) {
+        break;
+      }
+    }
+
+    if (c->slots[slot]) {
+      continue;
+    }
+
+    c->cookies[c->count++] = (ehttp_cookie) {
+      .name = n - c->at,
+      .nameLen = ne - n,
+      .value = v - c->at,
+      .valueLen = ve - v,
+    };
+    c->slots[slot] = c->count;
+  }
+}
+
+/**
+ * Prepares an empty accessor, scratch may be NULL when Cookie headers are
+ * known to arrive in one piece.
+ */
+ehttp_cookies *ehttp_cookies_init(ehttp_cookies * const restrict out,
+                                  uint8_t * const restrict scratch,
+                                  size_t scratchSize) {
+  out->at = NULL;
+  out->len = 0;
+  out->scratch = scratch;
+  out->scratchSize = scratchSize;
+  out->inScratch = out->open = out->indexed = out->truncated = 0;
+  out->count = 0;
+  memset(out->slots, 0, sizeof(out->slots));
+  return out;
+}
+
+/**
+ * Adds an on_header_value fragment of a Cookie header. Returns -1 when it
+ * had to be copied and the scratch buffer is full.
+ */
+int ehttp_cookies_feed(ehttp_cookies * const restrict c,
+                       const uint8_t * const restrict at, size_t len) {
+  bool join = !c->open && c->len;
+
+  // nothing to add, and nothing to copy
+  if (!len) {
+    return 0;
+  }
+
+  // index again on the next lookup
+  if (c->indexed) {
+    c->indexed = 0;
+    c->count = 0;
+    memset(c->slots, 0, sizeof(c->slots));
+  }
+
+  if (!c->len) {
+    c->at = at;
+    c->len = len;
+    c->open = 1;
+    return 0;
+  }
+
+  c->open = 1;
+
+  if (!join && !c->inScratch && c->at + c->len == at) {
+    c->len += len;
+    return 0;
+  }
+
+  if (!c->inScratch) {
+    if (!c->scratch || c->len > c->scratchSize) {
+      c->truncated = 1;
+      return -1;
+    }
+    memmove(c->scratch, c->at, c->len);
+    c->at = c->scratch;
+    c->inScratch = 1;
+  }
+
+  if (c->len + join * 2 + len > c->scratchSize) {
+    c->truncated = 1;
+    return -1;
+  }
+
+  if (join) {
+    memcpy(c->scratch + c->len, "; ", 2);
+    c->len += 2;
+  }
+
+  memcpy(c->scratch + c->len, at, len);
+  c->len += len;
+  return 0;
+}
+
+/**
+ * Ends the current Cookie header.
+ */
+void ehttp_cookies_done(ehttp_cookies * const c) {
+  c->open = 0;
+}
+
+/**
+ * Looks a cookie up by name, false when it is missing.
+ */
+bool ehttp_cookies_get(ehttp_cookies * const restrict c,
+                       const char * const restrict name, size_t nameLen,
+                       const uint8_t ** const restrict value,
+                       size_t * const restrict valueLen) {
+  uint32_t slot;
+
+  if (!c->indexed) {
+    build_index(c);
+  }
+
+  for (slot = hash((const uint8_t *) name, nameLen) & (EHTTP_COOKIE_SLOTS - 1);
+       c->slots[slot]; slot = (slot + 1) & (EHTTP_COOKIE_SLOTS - 1)) {
+    const ehttp_cookie *e = &c->cookies[c->slots[slot] - 1];
+
+    if (e->nameLen == nameLen && memcmp(c->at + e->name, name, nameLen) == 0) {
+      *value = c->at + e->value;
+      *valueLen = e->valueLen;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Number of cookies, indexing them if needed.
+ */
+size_t ehttp_cookies_count(ehttp_cookies * const c) {
+  if (!c->indexed) {
+    build_index(c);
+  }
+
+  return c->count;
+}
@@ -0,0 +1,108 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_COOKIE_VESTOL
+#define EHTTP_COOKIE_VESTOL
+
+#include "ehttp.h"
+
+/*
+ * Lazy Cookie header accessor.
+ *
+ * Feed the on_header_value fragments of Cookie headers and call
+ * ehttp_cookies_done() from on_header_value_done. Contiguous fragments are
+ * kept as a span into the input. Split fragments and repeated Cookie headers
+ * are joined in the caller scratch buffer. Nothing is split until the first
+ * lookup. That lookup scans for ';' and builds a small hash index of the
+ * names, so later lookups take constant time.
+ */
+
+#ifndef EHTTP_COOKIE_MAX
+#define EHTTP_COOKIE_MAX 64
+#endif
+
+// hash slots, a power of two above EHTTP_COOKIE_MAX
+#define EHTTP_COOKIE_SLOTS (EHTTP_COOKIE_MAX * 2)
+
+typedef struct _ehttp_cookie ehttp_cookie;
+struct _ehttp_cookie {
+  uint32_t name;
+  uint32_t nameLen;
+  uint32_t value;
+  uint32_t valueLen;
+};
+
+typedef struct _ehttp_cookies ehttp_cookies;
+struct _ehttp_cookies {
+  const uint8_t *at;
+  size_t len;
+  uint8_t *scratch;
+  size_t scratchSize;
+  uint8_t inScratch;
+  // inside a Cookie header value
+  uint8_t open;
+  uint8_t indexed;
+  // more cookies than EHTTP_COOKIE_MAX, or scratch too small
+  uint8_t truncated;
+  uint16_t count;
+  ehttp_cookie cookies[EHTTP_COOKIE_MAX];
+  // index + 1 in cookies, 0 for an empty slot
+  uint8_t slots[EHTTP_COOKIE_SLOTS];
+};
+
+/**
+ * Prepares an empty accessor, scratch may be NULL when Cookie headers are
+ * known to arrive in one piece.
+ */
+ehttp_cookies *ehttp_cookies_init(ehttp_cookies * const restrict,
+                                  uint8_t * const restrict, size_t);
+
+/**
+ * Adds an on_header_value fragment of a Cookie header. Returns -1 when it
+ * had to be copied and the scratch buffer is full.
+ */
+int ehttp_cookies_feed(ehttp_cookies * const restrict,
+                       const uint8_t * const restrict, size_t);
+
+/**
+ * Ends the current Cookie header.
+ */
+void ehttp_cookies_done(ehttp_cookies * const);
+
+/**
+ * Looks a cookie up by name, false when it is missing.
+ */
+bool ehttp_cookies_get(ehttp_cookies * const restrict,
+                       const char * const restrict name, size_t nameLen,
+                       const uint8_t ** const restrict value,
+                       size_t * const restrict valueLen);
+
+/**
+ * Number of cookies, indexing them if needed.
+ */
+size_t ehttp_cookies_count(ehttp_cookies * const);
+
+#endif
@@ -0,0 +1,549 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "ehttp_executor.h"
+
+// most jobs moved from the shared queue to a deque at once
+#define BATCH 32
+
+static _Thread_local ehttp_worker *current;
+
+static void mailbox_post(ehttp_mailbox *mb, ehttp_job *job) {
+  ehttp_job *prev;
+
+  __atomic_store_n(&job->next, NULL, __ATOMIC_RELAXED);
+  prev = __atomic_exchange_n(&mb->head, job, __ATOMIC_ACQ_REL);
+  __atomic_store_n(&prev->next, job, __ATOMIC_RELEASE);
+}
+
+// NULL when empty, or when a producer has not linked its job yet
+static ehttp_job *mailbox_take(ehttp_mailbox *mb) {
+  ehttp_job *tail = mb->tail;
+  ehttp_job *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+  if (tail == &mb->stub) {
+    if (!next) {
+      return NULL;
+    }
+    mb->tail = next;
+    tail = next;
+    next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+  }
+
+  if (next) {
+    mb->tail = next;
+    return tail;
+  }
+
+  if (tail != __atomic_load_n(&mb->head, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+
+  // tail is the last job: put the stub behind it
+  mailbox_post(mb, &mb->stub);
+  next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+  if (next) {
+    mb->tail = next;
+    return tail;
+  }
+
+  return NULL;
+}
+
+static bool mailbox_empty(ehttp_mailbox *mb) {
+  return mb->tail == &mb->stub &&
+         __atomic_load_n(&mb->head, __ATOMIC_ACQUIRE) == &mb->stub;
+}
+
+static bool deque_push(ehttp_deque *d, ehttp_job *job) {
+  int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+  int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+
+  if (b - t > d->mask) {
+    return false;
+  }
+
+  __atomic_store_n(&d->jobs[b & d->mask], job, __ATOMIC_RELAXED);
+  __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELEASE);
+
+  return true;
+}
+
+static ehttp_job *deque_pop(ehttp_deque *d) {
+  int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+  int64_t t;
+  ehttp_job *job = NULL;
+
+  __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+  if (t <= b) {
+    job = __atomic_load_n(&d->jobs[b & d->mask], __ATOMIC_RELAXED);
+    if (t == b) {
+      // last job: race the thieves for it
+      if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        job = NULL;
+      }
+      __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+  }
+  else {
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+  }
+
+  return job;
+}
+
+static ehttp_job *deque_steal(ehttp_deque *d) {
+  int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+  int64_t b;
+  ehttp_job *job;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+  if (t >= b) {
+    return NULL;
+  }
+
+  job = __atomic_load_n(&d->jobs[t & d->mask], __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false,
+                                   __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    return NULL;
+  }
+
+  return job;
+}
+
+static ehttp_job *steal(ehttp_worker *w) {
+  ehttp_executor *exec = w->executor;
+  unsigned start;
+  unsigned i;
+
+  // xorshift, to spread the thieves
+  w->seed ^= w->seed << 13;
+  w->seed ^= w->seed >> 7;
+  w->seed ^= w->seed << 17;
+  start = w->seed % exec->count;
+
+  for (i = 0; i < exec->count; i++) {
+    ehttp_worker *victim = &exec->workers[(start + i) % exec->count];
+    ehttp_job *job;
+
+    if (victim != w && (job = deque_steal(&victim->deque))) {
+      w->steals++;
+      return job;
+    }
+  }
+
+  return NULL;
+}
+
+// a job was pushed to some deque and may be stolen
+static bool stealable(ehttp_executor *exec) {
+  unsigned i;
+
+  for (i = 0; i < exec->count; i++) {
+    ehttp_deque *d = &exec->workers[i].deque;
+
+    if (__atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE) >
+        __atomic_load_n(&d->top, __ATOMIC_ACQUIRE)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// the next job from the shared queue, the rest of a batch goes to the deque
+static ehttp_job *take(ehttp_worker *w, bool *stop) {
+  ehttp_executor *exec = w->executor;
+  ehttp_job *job;
+  size_t batch;
+  size_t n;
+
+  pthread_mutex_lock(&exec->lock);
+
+  if (!exec->queue) {
+    *stop = exec->stop;
+    if (!*stop) {
+      __atomic_store_n(&exec->sleepers, exec->sleepers + 1, __ATOMIC_RELAXED);
+      // pairs with the fence in submit: either it sees this sleeper or
+      // the deques show its job
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      if (!stealable(exec)) {
+        pthread_cond_wait(&exec->wake, &exec->lock);
+      }
+      __atomic_store_n(&exec->sleepers, exec->sleepers - 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&exec->lock);
+    return NULL;
+  }
+
+  job = exec->queue;
+  exec->queue = job->next;
+  exec->queued--;
+
+  // leave half for the others
+  batch = exec->queued / 2 < BATCH ? exec->queued / 2 : BATCH;
+  for (n = 0; n < batch; n++) {
+    ehttp_job *next = exec->queue;
+    // once pushed, next may be stolen and run at once
+    ehttp_job *after = next->next;
+
+    if (!deque_push(&w->deque, next)) {
+      break;
+    }
+    exec->queue = after;
+    exec->queued--;
+  }
+  if (!exec->queue) {
+    exec->queueTail = &exec->queue;
+  }
+  if (n && exec->sleepers) {
+    pthread_cond_broadcast(&exec->wake);
+  }
+
+  pthread_mutex_unlock(&exec->lock);
+
+  return job;
+}
+
+static void run(ehttp_worker *w, ehttp_job *job) {
+  ehttp_mailbox *mb = job->mailbox;
+
+  job->run(job);
+  w->runs++;
+
+  if (mb) {
+    mailbox_post(mb, job);
+    if (!__atomic_exchange_n(&mb->signaled, 1, __ATOMIC_ACQ_REL)) {
+      uint64_t one = 1;
+      ssize_t rc = write(mb->fd, &one, sizeof(one));
+
+      (void) rc;
+    }
+  }
+}
+
+static void *worker_main(void *arg) {
+  ehttp_worker *w = arg;
+  bool stop = false;
+
+  current = w;
+
+  while (!stop) {
+    ehttp_job *job = deque_pop(&w->deque);
+
+    if (!job) {
+      job = steal(w);
+    }
+    if (!job) {
+      job = take(w, &stop);
+    }
+    if (job) {
+      run(w, job);
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Starts threads workers with deques of dequeSize jobs, rounded up to a
+ * power of two. Returns NULL with errno set on failure.
+ */
+ehttp_executor *ehttp_executor_init(ehttp_executor * const exec,
+                                    unsigned threads, size_t dequeSize) {
+  size_t size = 2;
+  unsigned i;
+  int rc;
+
+  while (size < dequeSize) {
+    size <<= 1;
+  }
+
+  memset(exec, 0, sizeof(*exec));
+  exec->queueTail = &exec->queue;
+  if (!threads ||
+      !(exec->workers = aligned_alloc(64, sizeof(ehttp_worker) * threads))) {
+    errno = threads ? ENOMEM : EINVAL;
+    return NULL;
+  }
+  memset(exec->workers, 0, sizeof(ehttp_worker) * threads);
+  pthread_mutex_init(&exec->lock, NULL);
+  pthread_cond_init(&exec->wake, NULL);
+
+  // workers steal from each other: all deques exist before any starts
+  exec->count = threads;
+  for (i = 0; i < threads; i++) {
+    ehttp_worker *w = &exec->workers[i];
+
+    w->executor = exec;
+    w->seed = 0x9e3779b97f4a7c15ull * (i + 1);
+    w->deque.mask = size - 1;
+    if (!(w->deque.jobs = calloc(size, sizeof(*w->deque.jobs)))) {
+      exec->count = i;
+      ehttp_executor_destroy(exec);
+      errno = ENOMEM;
+      return NULL;
+    }
+  }
+
+  for (i = 0; i < threads; i++) {
+    if ((rc = pthread_create(&exec->workers[i].thread, NULL, worker_main,
+                             &exec->workers[i]))) {
+      ehttp_executor_destroy(exec);
+      errno = rc;
+      return NULL;
+    }
+    exec->workers[i].started = true;
+  }
+
+  return exec;
+}
+
+/**
+ * Queues a job, from any thread.
+ */
+void ehttp_executor_submit(ehttp_executor * const restrict exec,
+                           ehttp_job * const restrict job) {
+  if (current && current->executor == exec &&
+      deque_push(&current->deque, job)) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    // the sleeper holds the lock until it waits: signal once it does
+    if (__atomic_load_n(&exec->sleepers, __ATOMIC_RELAXED)) {
+      pthread_mutex_lock(&exec->lock);
+      pthread_cond_signal(&exec->wake);
+      pthread_mutex_unlock(&exec->lock);
+    }
+    return;
+  }
+
+  job->next = NULL;
+  pthread_mutex_lock(&exec->lock);
+  *exec->queueTail = job;
+  exec->queueTail = &job->next;
+  exec->queued++;
+  if (exec->sleepers) {
+    pthread_cond_signal(&exec->wake);
+  }
+  pthread_mutex_unlock(&exec->lock);
+}
+
+/**
+ * Runs the jobs still queued, then stops the workers.
+ */
+void ehttp_executor_destroy(ehttp_executor * const exec) {
+  unsigned i;
+
+  pthread_mutex_lock(&exec->lock);
+  exec->stop = true;
+  pthread_cond_broadcast(&exec->wake);
+  pthread_mutex_unlock(&exec->lock);
+
+  for (i = 0; i < exec->count; i++) {
+    if (exec->workers[i].started) {
+      pthread_join(exec->workers[i].thread, NULL);
+    }
+    free(exec->workers[i].deque.jobs);
+  }
+
+  pthread_cond_destroy(&exec->wake);
+  pthread_mutex_destroy(&exec->lock);
+  free(exec->workers);
+  exec->workers = NULL;
+  exec->count = 0;
+}
+
+/**
+ * Prepares an empty mailbox and its non-blocking eventfd. Returns NULL with
+ * errno set on failure.
+ */
+ehttp_mailbox *ehttp_mailbox_init(ehttp_mailbox * const mb) {
+  memset(mb, 0, sizeof(*mb));
+  mb->head = &mb->stub;
+  mb->tail = &mb->stub;
+  mb->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  return mb->fd < 0 ? NULL : mb;
+}
+
+/**
+ * Calls done for every job posted so far, on the owner thread. Returns
+ * their count.
+ */
+size_t ehttp_mailbox_drain(ehttp_mailbox * const mb) {
+  uint64_t value;
+  size_t n = 0;
+  ssize_t rc = read(mb->fd, &value, sizeof(value));
+
+  (void) rc;
+  // jobs posted from now on signal again; the exchange pairs with the one
+  // in run(), so the posts it saw are visible to the takes below
+  (void) __atomic_exchange_n(&mb->signaled, 0, __ATOMIC_ACQ_REL);
+
+  for (;;) {
+    ehttp_job *job = mailbox_take(mb);
+
+    if (job) {
+      job->done(job);
+      n++;
+    }
+    else if (mailbox_empty(mb)) {
+      break;
+    }
+    else {
+      // a worker is between its two stores
+      sched_yield();
+    }
+  }
+
+  return n;
+}
+
+/**
+ * Closes the eventfd.
+ */
+void ehttp_mailbox_destroy(ehttp_mailbox * const mb) {
+  close(mb->fd);
+  mb->fd = -1;
+}
+
+#ifdef EHTTP_EXECUTOR_BENCH
+#include <poll.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+ * Handlers of skewed cost: one in a hundred runs a thousand times longer
+ * than the others, the case work stealing is for. Usage: [threads] [jobs]
+ */
+
+typedef struct {
+  ehttp_job job;
+  unsigned cost;
+  uint64_t result;
+} bench_job;
+
+static size_t benchDone;
+static uint64_t benchSum;
+
+static uint64_t bench_work(unsigned cost) {
+  uint64_t x = cost;
+  unsigned i;
+
+  for (i = 0; i < cost; i++) {
+    x = x * 6364136223846793005ull + 1442695040888963407ull;
+  }
+  return x;
+}
+
+static void bench_run(ehttp_job *job) {
+  bench_job *b = (bench_job *) job;
+
+  b->result = bench_work(b->cost);
+}
+
+static void bench_done(ehttp_job *job) {
+  benchDone++;
+  benchSum += ((bench_job *) job)->result;
+}
+
+static double bench_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  unsigned threads = argc > 1 ? (unsigned) atoi(argv[1]) : 4;
+  size_t count = argc > 2 ? (size_t) atol(argv[2]) : 200000;
+  ehttp_executor exec;
+  ehttp_mailbox mb;
+  bench_job *jobs;
+  uint64_t expect = 0;
+  uint64_t units = 0;
+  uint64_t steals = 0;
+  double start;
+  double elapsed;
+  size_t i;
+
+  if (!(jobs = calloc(count, sizeof(*jobs))) || !ehttp_mailbox_init(&mb) ||
+      !ehttp_executor_init(&exec, threads, 256)) {
+    perror("init");
+    return 1;
+  }
+
+  srand(3);
+  for (i = 0; i < count; i++) {
+    jobs[i].cost = rand() % 100 ? 200 + rand() % 800 : 200000;
+    jobs[i].job.run = bench_run;
+    jobs[i].job.done = bench_done;
+    jobs[i].job.mailbox = &mb;
+    units += jobs[i].cost;
+    expect += bench_work(jobs[i].cost);
+  }
+
+  start = bench_now();
+  for (i = 0; i < count; i++) {
+    ehttp_executor_submit(&exec, &jobs[i].job);
+    if (!(i & 1023)) {
+      ehttp_mailbox_drain(&mb);
+    }
+  }
+  while (benchDone < count) {
+    struct pollfd pfd = { .fd = mb.fd, .events = POLLIN };
+
+    poll(&pfd, 1, 100);
+    ehttp_mailbox_drain(&mb);
+  }
+  elapsed = bench_now() - start;
+
+  for (i = 0; i < threads; i++) {
+    steals += exec.workers[i].steals;
+  }
+  printf("%u threads: %zu jobs in %.3f s, %.2f ns per cost unit and thread, "
+         "%llu steals%s\n", threads, count, elapsed,
+         elapsed * 1e9 * threads / units, (unsigned long long) steals,
+         benchSum == expect ? "" : ", WRONG RESULTS");
+
+  ehttp_executor_destroy(&exec);
+  ehttp_mailbox_destroy(&mb);
+  free(jobs);
+  return benchSum != expect;
+}
+#endif
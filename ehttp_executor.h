@@ -0,0 +1,151 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_EXECUTOR_VESTOL
+#define EHTTP_EXECUTOR_VESTOL
+
+#include <pthread.h>
+
+#include "ehttp.h"
+
+/*
+ * Work stealing executor for request handlers.
+ *
+ * An I/O thread hands a request to the executor as a job, typically from
+ * on_headers_done returning EHTTP_PARSER_RETURN so that the parser of the
+ * connection is left alone until the handler is done. A request without a
+ * body has then already reached on_parser_done: the connection resumes
+ * with ehttp_reset() and the bytes ehttp_parse() left over, otherwise it
+ * feeds the body to the same parser. Workers run jobs
+ * from their own Chase-Lev deque, steal from the others when it is empty
+ * and take new jobs from a shared queue in batches, which the others then
+ * steal from. A job submitted from a worker goes to its own deque.
+ *
+ * When a job has a mailbox, it is posted there once run: the mailbox is a
+ * lock-free multi-producer single-consumer queue owned by the I/O thread,
+ * which polls its eventfd and calls ehttp_mailbox_drain() to run the
+ * done callbacks, e.g. to write the response and resume parsing.
+ *
+ * Build ehttp_executor.c with -DEHTTP_EXECUTOR_BENCH for a benchmark with
+ * skewed handler costs.
+ */
+
+typedef struct _ehttp_mailbox ehttp_mailbox;
+
+typedef struct _ehttp_job ehttp_job;
+struct _ehttp_job {
+  ehttp_job *next;
+  // on a worker
+  void (*run)(ehttp_job *);
+  // on the mailbox owner, after run
+  void (*done)(ehttp_job *);
+  // NULL when nothing is posted back: run may then free the job
+  ehttp_mailbox *mailbox;
+  void *context;
+};
+
+struct _ehttp_mailbox {
+  // producers swap themselves in as the head
+  ehttp_job *head;
+  int signaled;
+  int fd;
+  // consumer side, on its own cache line
+  ehttp_job *tail __attribute__((aligned(64)));
+  ehttp_job stub;
+} __attribute__((aligned(64)));
+
+typedef struct _ehttp_deque ehttp_deque;
+struct _ehttp_deque {
+  // stolen from the top, owner works at the bottom
+  int64_t top __attribute__((aligned(64)));
+  int64_t bottom __attribute__((aligned(64)));
+  ehttp_job **jobs;
+  int64_t mask;
+};
+
+typedef struct _ehttp_executor ehttp_executor;
+
+typedef struct _ehttp_worker ehttp_worker;
+struct _ehttp_worker {
+  ehttp_deque deque;
+  ehttp_executor *executor;
+  pthread_t thread;
+  bool started;
+  uint64_t seed;
+  /* stats */
+  uint64_t runs;
+  uint64_t steals;
+} __attribute__((aligned(64)));
+
+struct _ehttp_executor {
+  ehttp_worker *workers;
+  unsigned count;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  // shared queue of submitted jobs
+  ehttp_job *queue;
+  ehttp_job **queueTail;
+  size_t queued;
+  unsigned sleepers;
+  bool stop;
+};
+
+/**
+ * Starts threads workers with deques of dequeSize jobs, rounded up to a
+ * power of two. Returns NULL with errno set on failure.
+ */
+ehttp_executor *ehttp_executor_init(ehttp_executor * const, unsigned threads,
+                                    size_t dequeSize);
+
+/**
+ * Queues a job, from any thread.
+ */
+void ehttp_executor_submit(ehttp_executor * const restrict,
+                           ehttp_job * const restrict);
+
+/**
+ * Runs the jobs still queued, then stops the workers.
+ */
+void ehttp_executor_destroy(ehttp_executor * const);
+
+/**
+ * Prepares an empty mailbox and its non-blocking eventfd. Returns NULL with
+ * errno set on failure.
+ */
+ehttp_mailbox *ehttp_mailbox_init(ehttp_mailbox * const);
+
+/**
+ * Calls done for every job posted so far, on the owner thread. Returns
+ * their count.
+ */
+size_t ehttp_mailbox_drain(ehttp_mailbox * const);
+
+/**
+ * Closes the eventfd.
+ */
+void ehttp_mailbox_destroy(ehttp_mailbox * const);
+
+#endif
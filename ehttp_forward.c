@@ -0,0 +1,323 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "ehttp_forward.h"
+#include "ehttp_internal.h"
+
+#define SPLICE_CHUNK (64 * 1024)
+
+/**
+ * Prepares a forwarder with room for max headers and maxIov spans.
+ */
+ehttp_forward *ehttp_forward_init(ehttp_forward * const restrict fwd,
+                                  ehttp_forward_header * const restrict headers,
+                                  size_t max,
+                                  struct iovec * const restrict iov,
+                                  size_t maxIov) {
+  *fwd = (ehttp_forward) {
+    .headers = headers,
+    .max = max,
+    .iov = iov,
+    .maxIov = maxIov,
+    .pipe = { -1, -1 },
+  };
+
+  return fwd;
+}
+
+/**
+ * Sets the rewrite rules, at most EHTTP_FORWARD_RULES_MAX. They are
+ * referenced, not copied.
+ */
+void ehttp_forward_rules(ehttp_forward * const restrict fwd,
+                         const ehttp_rewrite * const restrict rules, size_t n) {
+  fwd->rules = rules;
+  fwd->nrules = n < EHTTP_FORWARD_RULES_MAX ? n : EHTTP_FORWARD_RULES_MAX;
+}
+
+/**
+ * Starts a message whose first byte is at head.
+ */
+void ehttp_forward_begin(ehttp_forward * const restrict fwd,
+                         const uint8_t * const restrict head) {
+  fwd->head = head;
+  fwd->headLength = 0;
+  fwd->overflow = false;
+  fwd->count = 0;
+  fwd->niov = 0;
+  fwd->next = 0;
+}
+
+/**
+ * Call from on_header_name.
+ */
+void ehttp_forward_name(ehttp_forward * const restrict fwd,
+                        const uint8_t * const restrict at, size_t len) {
+  ehttp_forward_header *last = fwd->count ? &fwd->headers[fwd->count - 1] : NULL;
+  size_t offset = at - fwd->head;
+
+  // the rest of a name split across reads
+  if (last && offset == last->offset + last->nameLen) {
+    last->nameLen += len;
+    return;
+  }
+
+  if (fwd->count == fwd->max) {
+    fwd->overflow = true;
+    return;
+  }
+
+  fwd->headers[fwd->count++] = (ehttp_forward_header) {
+    .offset = offset,
+    .nameLen = len,
+  };
+}
+
+static int push(ehttp_forward *fwd, const void *base, size_t len) {
+  struct iovec *last = fwd->niov ? &fwd->iov[fwd->niov - 1] : NULL;
+
+  if (!len) {
+    return 0;
+  }
+
+  if (last && (const uint8_t *) last->iov_base + last->iov_len == base) {
+    last->iov_len += len;
+    return 0;
+  }
+
+  if (fwd->niov == fwd->maxIov) {
+    return -1;
+  }
+
+  fwd->iov[fwd->niov++] = (struct iovec) {
+    .iov_base = (void *) base,
+    .iov_len = len,
+  };
+  return 0;
+}
+
+static const ehttp_rewrite *rule_of(const ehttp_forward *fwd,
+                                    const ehttp_forward_header *h) {
+  for (size_t i = 0; i < fwd->nrules; i++) {
+    const ehttp_rewrite *rule = &fwd->rules[i];
+
+    if (rule->op != EHTTP_FORWARD_ADD && strlen(rule->name) == h->nameLen
+        && !strncasecmp(rule->name, (const char *) fwd->head + h->offset,
+                        h->nameLen)) {
+      return rule;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Call from on_headers_done. It lays out the spans to send. Returns -1
+ * when headers or spans ran out, and the caller must then rebuild the
+ * request itself.
+ */
+int ehttp_forward_headers_done(ehttp_forward * const restrict fwd,
+                               const ehttp_parser * const restrict parser) {
+  uint64_t replaced = 0;
+  size_t end;
+
+  // the parser stands on the last '\n'
+  fwd->headLength = parser->p + 1 - fwd->head;
+  fwd->eolLength = (fwd->headLength > 1 && parser->p[-1] == '\r') ? 2 : 1;
+  end = fwd->headLength - fwd->eolLength;
+
+  if (fwd->overflow) {
+    return -1;
+  }
+
+  // request line
+  if (push(fwd, fwd->head, fwd->count ? fwd->headers[0].offset : end) < 0) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < fwd->count; i++) {
+    const ehttp_forward_header *h = &fwd->headers[i];
+    size_t next = (i + 1 < fwd->count) ? fwd->headers[i + 1].offset : end;
+    const ehttp_rewrite *rule = rule_of(fwd, h);
+    int r = 0;
+
+    if (!rule) {
+      r = push(fwd, fwd->head + h->offset, next - h->offset);
+    }
+    else if (rule->op == EHTTP_FORWARD_REPLACE
+             && !(replaced & (UINT64_C(1) << (rule - fwd->rules)))) {
+      replaced |= UINT64_C(1) << (rule - fwd->rules);
+      r = push(fwd, rule->line, strlen(rule->line));
+    }
+
+    if (r < 0) {
+      return -1;
+    }
+  }
+
+  for (size_t i = 0; i < fwd->nrules; i++) {
+    const ehttp_rewrite *rule = &fwd->rules[i];
+
+    if ((rule->op == EHTTP_FORWARD_ADD
+         || (rule->op == EHTTP_FORWARD_REPLACE && !(replaced & (UINT64_C(1) << i))))
+        && push(fwd, rule->line, strlen(rule->line)) < 0) {
+      return -1;
+    }
+  }
+
+  return push(fwd, fwd->head + end, fwd->eolLength);
+}
+
+/**
+ * Sends the head on a (non-blocking) socket. Returns 1 when everything was
+ * sent, 0 when the socket would block and -1 on error.
+ */
+int ehttp_forward_send_head(ehttp_forward * const fwd, int sock) {
+  while (fwd->next < fwd->niov) {
+    struct iovec *iov = &fwd->iov[fwd->next];
+    size_t n = fwd->niov - fwd->next;
+    ssize_t r = writev(sock, iov, n < IOV_MAX ? n : IOV_MAX);
+
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+
+    // sent spans are consumed, a partial one is shortened in place
+    while (fwd->next < fwd->niov && (size_t) r >= iov->iov_len) {
+      r -= iov->iov_len;
+      iov++;
+      fwd->next++;
+    }
+
+    if (r) {
+      iov->iov_base = (uint8_t *) iov->iov_base + r;
+      iov->iov_len -= r;
+    }
+  }
+
+  return 1;
+}
+
+/**
+ * Body bytes the parser is only counting, which may be spliced.
+ */
+size_t ehttp_forward_pending(const ehttp_parser * const parser) {
+  if (parser->state == S_BODY_CONTENT_LENGHT || parser->state == S_BODY_CHUNK) {
+    return parser->contentLength;
+  }
+
+  return 0;
+}
+
+// bytes read from the client are body bytes the parser no longer expects
+static void consumed(ehttp_parser *parser, size_t n) {
+  parser->contentLength -= n;
+
+  if (parser->contentLength) {
+    return;
+  }
+
+  parser->state = (parser->state == S_BODY_CHUNK) ? S_BODY_CHUNK_CR : S_STATE_END;
+}
+
+/**
+ * Moves the pending body bytes from one socket to another through a pipe
+ * and advances the parser past them. When a Content-Length body completes
+ * this way, the parser ends without calling on_parser_done. Returns 1 once
+ * nothing is pending and the pipe is empty, 0 when a socket would block
+ * and -1 on error (0 bytes read count as an error, with errno ECONNRESET).
+ */
+int ehttp_forward_splice(ehttp_forward * const restrict fwd,
+                         ehttp_parser * const restrict parser,
+                         int from, int to) {
+  if (fwd->pipe[0] < 0 && pipe2(fwd->pipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+    return -1;
+  }
+
+  for (;;) {
+    size_t pending = ehttp_forward_pending(parser);
+    ssize_t r;
+
+    if (fwd->piped) {
+      r = splice(fwd->pipe[0], NULL, to, NULL, fwd->piped,
+                 SPLICE_F_MOVE | SPLICE_F_NONBLOCK | (pending ? SPLICE_F_MORE : 0));
+      if (r < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return (errno == EAGAIN) ? 0 : -1;
+      }
+
+      fwd->piped -= r;
+      continue;
+    }
+
+    if (!pending) {
+      return 1;
+    }
+
+    r = splice(from, NULL, fwd->pipe[1], NULL,
+               pending < SPLICE_CHUNK ? pending : SPLICE_CHUNK,
+               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return (errno == EAGAIN) ? 0 : -1;
+    }
+    else if (r == 0) {
+      errno = ECONNRESET;
+      return -1;
+    }
+
+    fwd->piped += r;
+    consumed(parser, r);
+  }
+}
+
+/**
+ * Closes the pipe.
+ */
+void ehttp_forward_end(ehttp_forward * const fwd) {
+  if (fwd->pipe[0] >= 0) {
+    close(fwd->pipe[0]);
+    close(fwd->pipe[1]);
+    fwd->pipe[0] = fwd->pipe[1] = -1;
+  }
+
+  fwd->piped = 0;
+}
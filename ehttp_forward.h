@@ -0,0 +1,165 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_FORWARD_VESTOL
+#define EHTTP_FORWARD_VESTOL
+
+#include <sys/uio.h>
+
+#include "ehttp.h"
+
+/*
+ * Zero copy request forwarding for proxies.
+ *
+ * The request head must be contiguous in memory, e.g. read into a single
+ * buffer that grows by appending, and stay there until it has been sent.
+ * From the callbacks, ehttp_forward_name() records where each header line
+ * starts. ehttp_forward_headers_done() records where the head ends. The
+ * head is then sent upstream with writev() as spans of the original
+ * bytes, with the rewrite rules applied: unchanged neighbouring lines
+ * become a single span.
+ *
+ * Body bytes that the parser only needs to count, either the rest of a
+ * Content-Length body or the rest of the current chunk, can be moved
+ * between sockets with splice() and never reach user space. Chunk-size
+ * lines are still read, parsed and forwarded by the caller.
+ */
+
+typedef enum {
+  // append line to the head
+  EHTTP_FORWARD_ADD = 0,
+  // remove every header called name
+  EHTTP_FORWARD_DROP,
+  // line replaces the first header called name (added if absent), others
+  // are removed
+  EHTTP_FORWARD_REPLACE,
+} ehttp_forward_op;
+
+typedef struct _ehttp_rewrite ehttp_rewrite;
+struct _ehttp_rewrite {
+  ehttp_forward_op op;
+  // compared case insensitively, unused by EHTTP_FORWARD_ADD
+  const char *name;
+  // a complete "Name: value\r\n" header line
+  const char *line;
+};
+
+typedef struct _ehttp_forward_header ehttp_forward_header;
+struct _ehttp_forward_header {
+  // offsets from the start of the head
+  uint32_t offset;
+  uint32_t nameLen;
+};
+
+#ifndef EHTTP_FORWARD_RULES_MAX
+#define EHTTP_FORWARD_RULES_MAX 64
+#endif
+
+typedef struct _ehttp_forward ehttp_forward;
+struct _ehttp_forward {
+  const uint8_t *head;
+  size_t headLength;
+  // length of the final empty line
+  uint8_t eolLength;
+  // more headers than max were seen
+  bool overflow;
+  ehttp_forward_header *headers;
+  size_t count;
+  size_t max;
+  const ehttp_rewrite *rules;
+  size_t nrules;
+  struct iovec *iov;
+  size_t niov;
+  size_t maxIov;
+  // send progress
+  size_t next;
+  // splice() pipe and the bytes it holds
+  int pipe[2];
+  size_t piped;
+};
+
+/**
+ * Prepares a forwarder with room for max headers and maxIov spans.
+ */
+ehttp_forward *ehttp_forward_init(ehttp_forward * const restrict,
+                                  ehttp_forward_header * const restrict,
+                                  size_t max,
+                                  struct iovec * const restrict, size_t maxIov);
+
+/**
+ * Sets the rewrite rules, at most EHTTP_FORWARD_RULES_MAX. They are
+ * referenced, not copied.
+ */
+void ehttp_forward_rules(ehttp_forward * const restrict,
+                         const ehttp_rewrite * const restrict, size_t n);
+
+/**
+ * Starts a message whose first byte is at head.
+ */
+void ehttp_forward_begin(ehttp_forward * const restrict,
+                         const uint8_t * const restrict head);
+
+/**
+ * Call from on_header_name.
+ */
+void ehttp_forward_name(ehttp_forward * const restrict,
+                        const uint8_t * const restrict, size_t);
+
+/**
+ * Call from on_headers_done. It lays out the spans to send. Returns -1
+ * when headers or spans ran out, and the caller must then rebuild the
+ * request itself.
+ */
+int ehttp_forward_headers_done(ehttp_forward * const restrict,
+                               const ehttp_parser * const restrict);
+
+/**
+ * Sends the head on a (non-blocking) socket. Returns 1 when everything was
+ * sent, 0 when the socket would block and -1 on error.
+ */
+int ehttp_forward_send_head(ehttp_forward * const, int sock);
+
+/**
+ * Body bytes the parser is only counting, which may be spliced.
+ */
+size_t ehttp_forward_pending(const ehttp_parser * const);
+
+/**
+ * Moves the pending body bytes from one socket to another through a pipe
+ * and advances the parser past them. When a Content-Length body completes
+ * this way, the parser ends without calling on_parser_done. Returns 1 once
+ * nothing is pending and the pipe is empty, 0 when a socket would block
+ * and -1 on error (0 bytes read count as an error, with errno ECONNRESET).
+ */
+int ehttp_forward_splice(ehttp_forward * const restrict,
+                         ehttp_parser * const restrict, int from, int to);
+
+/**
+ * Closes the pipe.
+ */
+void ehttp_forward_end(ehttp_forward * const);
+
+#endif
@@ -0,0 +1,212 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#include "ehttp_inflate.h"
+
+static ehttp_inflate_status deliver(ehttp_inflate * const z) {
+  size_t len = z->windowSize - z->zs.avail_out;
+
+  if (!len) {
+    return EHTTP_INFLATE_OK;
+  }
+
+  if (z->total + len > z->maxOutput || z->total + len < z->total) {
+    return EHTTP_INFLATE_TOO_LARGE;
+  }
+
+  z->total += len;
+  z->on_data(z, z->window, len);
+  z->zs.next_out = z->window;
+  z->zs.avail_out = z->windowSize;
+  return EHTTP_INFLATE_OK;
+}
+
+// restarts a "deflate" stream as raw deflate, from its first byte
+static ehttp_inflate_status retry_raw(ehttp_inflate * const z,
+                                      const uint8_t * const in) {
+  size_t consumed = (const uint8_t *) z->zs.next_in - in;
+  // the zlib header is two bytes: at most one came with an earlier fragment
+  size_t early = z->zs.total_in - consumed;
+  unsigned avail = z->zs.avail_in;
+
+  if (early > 1 || inflateReset2(&z->zs, -MAX_WBITS) != Z_OK) {
+    return EHTTP_INFLATE_ERROR;
+  }
+
+  z->raw = 1;
+
+  if (early) {
+    z->zs.next_in = &z->first;
+    z->zs.avail_in = 1;
+    if (inflate(&z->zs, Z_NO_FLUSH) != Z_OK) {
+      return EHTTP_INFLATE_ERROR;
+    }
+  }
+
+  z->zs.next_in = (Bytef *) in;
+  z->zs.avail_in = avail + consumed;
+  return EHTTP_INFLATE_OK;
+}
+
+/**
+ * Prepares a decoder for the given encoding writing into window.
+ * EHTTP_ENCODING_IDENTITY passes the body through unchanged.
+ */
+ehttp_inflate_status ehttp_inflate_init(ehttp_inflate * const restrict z,
+    ehttp_encoding encoding, uint8_t * const restrict window, size_t windowSize,
+    size_t maxOutput,
+    void (*on_data)(ehttp_inflate *, const uint8_t *, size_t),
+    void * const restrict ctx) {
+  int bits;
+
+  *z = (ehttp_inflate) {
+    .window = window,
+    .windowSize = windowSize > UINT_MAX ? UINT_MAX : windowSize,
+    .maxOutput = maxOutput,
+    .on_data = on_data,
+    .context = ctx,
+    .encoding = encoding,
+  };
+
+  switch (encoding) {
+    case EHTTP_ENCODING_IDENTITY:
+      return EHTTP_INFLATE_OK;
+
+    case EHTTP_ENCODING_GZIP:
+      bits = 16 + MAX_WBITS;
+      break;
+
+    case EHTTP_ENCODING_DEFLATE:
+      bits = MAX_WBITS;
+      break;
+
+    default:
+      return z->status = EHTTP_INFLATE_UNSUPPORTED;
+  }
+
+  if (inflateInit2(&z->zs, bits) != Z_OK) {
+    return z->status = EHTTP_INFLATE_ERROR;
+  }
+
+  z->zs.next_out = z->window;
+  z->zs.avail_out = z->windowSize;
+  return EHTTP_INFLATE_OK;
+}
+
+/**
+ * Decodes an on_content fragment.
+ */
+ehttp_inflate_status ehttp_inflate_feed(ehttp_inflate * const restrict z,
+                                        const uint8_t * const restrict in,
+                                        size_t len) {
+  int ret;
+
+  if (z->status != EHTTP_INFLATE_OK) {
+    // data after the end of the stream
+    return (z->status == EHTTP_INFLATE_DONE && len)
+      ? (z->status = EHTTP_INFLATE_ERROR)
+      : z->status;
+  }
+
+  if (z->encoding == EHTTP_ENCODING_IDENTITY) {
+    if (z->total + len > z->maxOutput || z->total + len < z->total) {
+      return z->status = EHTTP_INFLATE_TOO_LARGE;
+    }
+
+    z->total += len;
+    z->on_data(z, in, len);
+    return EHTTP_INFLATE_OK;
+  }
+
+  if (z->zs.total_in == 0 && len) {
+    z->first = in[0];
+  }
+
+  z->zs.next_in = (Bytef *) in;
+
+  while (len) {
+    // avail_in is an unsigned int
+    z->zs.avail_in = len > UINT_MAX ? UINT_MAX : len;
+    len -= z->zs.avail_in;
+
+    do {
+      ret = inflate(&z->zs, Z_NO_FLUSH);
+
+      // "deflate" is often sent without the zlib wrapper
+      if (ret == Z_DATA_ERROR && z->encoding == EHTTP_ENCODING_DEFLATE
+          && !z->raw && z->zs.total_out == 0) {
+        if (retry_raw(z, in) != EHTTP_INFLATE_OK) {
+          return z->status = EHTTP_INFLATE_ERROR;
+        }
+        continue;
+      }
+
+      if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+        return z->status = EHTTP_INFLATE_ERROR;
+      }
+
+      if (z->zs.avail_out == 0 || ret == Z_STREAM_END) {
+        if ( (z->status = deliver(z) ) != EHTTP_INFLATE_OK) {
+          return z->status;
+        }
+      }
+
+      if (ret == Z_STREAM_END) {
+        z->status = EHTTP_INFLATE_DONE;
+        return (z->zs.avail_in || len) ? (z->status = EHTTP_INFLATE_ERROR)
+                                       : EHTTP_INFLATE_DONE;
+      }
+    } while (z->zs.avail_in || z->zs.avail_out == 0);
+  }
+
+  // flush what is decoded so far: decoding overlaps with arrival
+  return z->status = deliver(z);
+}
+
+/**
+ * Checks that the encoded stream was complete at the end of the body.
+ */
+ehttp_inflate_status ehttp_inflate_finish(ehttp_inflate * const z) {
+  if (z->encoding == EHTTP_ENCODING_IDENTITY && z->status == EHTTP_INFLATE_OK) {
+    return z->status = EHTTP_INFLATE_DONE;
+  }
+
+  if (z->status == EHTTP_INFLATE_OK) {
+    z->status = EHTTP_INFLATE_TRUNCATED;
+  }
+
+  return z->status;
+}
+
+/**
+ * Releases zlib state.
+ */
+void ehttp_inflate_end(ehttp_inflate * const z) {
+  if (z->encoding == EHTTP_ENCODING_GZIP
+      || z->encoding == EHTTP_ENCODING_DEFLATE) {
+    inflateEnd(&z->zs);
+  }
+}
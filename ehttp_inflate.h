@@ -0,0 +1,97 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_INFLATE_VESTOL
+#define EHTTP_INFLATE_VESTOL
+
+#include <zlib.h>
+
+#include "ehttp.h"
+
+/*
+ * Streaming Content-Encoding decoder (links with zlib).
+ *
+ * Set up from on_headers_done with the parser's contentEncoding, feed every
+ * on_content fragment and finish from on_parser_done. Decoded bytes are
+ * delivered through on_data in chunks of at most the window size, as soon as
+ * they are available: memory does not depend on the body size.
+ *
+ * Decoding stops with EHTTP_INFLATE_TOO_LARGE once more than maxOutput
+ * decoded bytes would be produced.
+ */
+
+typedef enum {
+  EHTTP_INFLATE_TOO_LARGE = -4,
+  EHTTP_INFLATE_TRUNCATED = -3,
+  EHTTP_INFLATE_UNSUPPORTED = -2,
+  EHTTP_INFLATE_ERROR = -1,
+  EHTTP_INFLATE_OK = 0,
+  EHTTP_INFLATE_DONE,
+} ehttp_inflate_status;
+
+typedef struct _ehttp_inflate ehttp_inflate;
+struct _ehttp_inflate {
+  z_stream zs;
+  uint8_t *window;
+  size_t windowSize;
+  size_t maxOutput;
+  size_t total;
+  void (*on_data)(ehttp_inflate *, const uint8_t *, size_t);
+  void *context;
+  ehttp_encoding encoding;
+  ehttp_inflate_status status;
+  // raw deflate fallback
+  uint8_t raw;
+  uint8_t first;
+};
+
+/**
+ * Prepares a decoder for the given encoding writing into window.
+ * EHTTP_ENCODING_IDENTITY passes the body through unchanged.
+ */
+ehttp_inflate_status ehttp_inflate_init(ehttp_inflate * const restrict,
+    ehttp_encoding, uint8_t * const restrict window, size_t windowSize,
+    size_t maxOutput,
+    void (*on_data)(ehttp_inflate *, const uint8_t *, size_t),
+    void * const restrict ctx);
+
+/**
+ * Decodes an on_content fragment.
+ */
+ehttp_inflate_status ehttp_inflate_feed(ehttp_inflate * const restrict,
+                                        const uint8_t * const restrict, size_t);
+
+/**
+ * Checks that the encoded stream was complete at the end of the body.
+ */
+ehttp_inflate_status ehttp_inflate_finish(ehttp_inflate * const);
+
+/**
+ * Releases zlib state.
+ */
+void ehttp_inflate_end(ehttp_inflate * const);
+
+#endif
@@ -0,0 +1,854 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_INTERNAL_VESTOL
+#define EHTTP_INTERNAL_VESTOL
+
+/*
+ * Parser states, header sub states and character tables shared by the
+ * runtime parser and by parsers instantiated from ehttp_parse.h.
+ */
+
+#include <string.h>
+
+#include "ehttp.h"
+
+enum ihttp_states {
+  // undetermined
+  S_NOSTATE = 0,
+  S_UND_H,
+  S_UND_HT,
+  S_UND_HTT,
+  S_UND_HTTP,
+
+  S_REQUEST_REQUIRED,
+  S_METHOD_CHAR,
+
+  S_REQUEST_URI,
+  S_REQUEST_URI_CHAR,
+  S_REQUEST_URI_ASTERISK,
+
+  S_REQUEST_URI_1ST_HEX,
+  S_REQUEST_URI_2ND_HEX,
+
+  S_REQUEST_REQUIRE_VERSION,
+  S_REQUEST_H,
+  S_REQUEST_HT,
+  S_REQUEST_HTT,
+  S_REQUEST_HTTP,
+  S_REQUEST_HTTP_MAJORV,
+  S_REQUEST_HTTP_DOT,
+  S_REQUEST_HTTP_MINORV,
+
+  S_REQUEST_EOL,
+  S_REQUEST_CRLF,
+
+ /*
+  * Http response states
+  */
+  S_RESPONSE_REQUIRED,
+
+  S_RESPONSE_H,
+  S_RESPONSE_HT,
+  S_RESPONSE_HTT,
+  S_RESPONSE_HTTP,
+  S_RESPONSE_HTTP_SLASH,
+
+  S_RESPONSE_HTTP_MAJORV,
+  S_RESPONSE_HTTP_DOT,
+  S_RESPONSE_HTTP_MINORV,
+
+  S_STATUS_REQUIRED,
+  S_STATUS_1ST,
+  S_STATUS_2ND,
+  S_STATUS_3RD,
+
+  S_RESPONSE_REASON,
+  S_RESPONSE_EOL,
+
+ /*
+  * Http headers
+  */
+  S_HEADER_NAME,
+  S_HEADER_NAME_CHAR,
+  S_HEADER_NAME_CHAR_CHECK,
+
+  S_HEADER_VALUE,
+  S_HEADER_VALUE_CHAR,
+
+  S_HEADER_VALUE_LF_CLOSE,
+  S_HEADER_VALUE_LF_CHUNKED,
+  S_HEADER_VALUE_LF_CHUNKED_CHAR,
+
+  S_HEADER_VALUE_CONTENT_ENCODING,
+  S_HEADER_VALUE_EXPECT,
+
+  S_HEADER_VALUE_CONTENT_LENGTH,
+  S_HEADER_VALUE_END_TRIM,
+
+  S_HEADER_EOL,
+  S_HEADER_CRLF,
+
+ /*
+  * Last CRLF (end of headers)
+  */
+  S_HEADER_EOH,
+  S_HEADERS_DONE,
+
+ /*
+  * Content body
+  */
+  S_BODY_CONTENT_LENGHT,
+
+  S_BODY_CHUNKED,
+  S_BODY_CHUNKLEN,
+  S_BODY_CHUNKEXT,
+  S_BODY_CHUNKLEN_CRLF,
+
+  S_BODY_CHUNK,
+  S_BODY_CHUNK_CR,
+  S_BODY_CHUNK_CRLF,
+
+  S_BODY_CHUNKED_EOS,
+  S_BODY_TRAILER,
+  S_BODY_TRAILER_FIELD,
+  S_BODY_TRAILER_LF,
+  S_BODY_TRAILER_EOH,
+
+  // close-delimited response body
+  S_BODY_UNTIL_CLOSE,
+
+  S_STATE_END,
+};
+
+
+// header names
+enum {
+  SH_IGNORE = 0,
+  SH_NOSTATE,
+
+  SH_C, SH_CO, SH_CON, SH_CONN, SH_CONNE, SH_CONNEC, SH_CONNECT, SH_CONNECTI,
+  SH_CONNECTIO, SH_CONNECTION,
+
+  SH_CONT, SH_CONTE, SH_CONTEN, SH_CONTENT, SH_CONTENT_, SH_CONTENT_L,
+  SH_CONTENT_LE, SH_CONTENT_LEN, SH_CONTENT_LENG, SH_CONTENT_LENGT,
+  SH_CONTENT_LENGTH,
+
+  SH_CONTENT_E, SH_CONTENT_EN, SH_CONTENT_ENC, SH_CONTENT_ENCO,
+  SH_CONTENT_ENCOD, SH_CONTENT_ENCODI, SH_CONTENT_ENCODIN,
+  SH_CONTENT_ENCODING,
+
+  SH_E, SH_EX, SH_EXP, SH_EXPE, SH_EXPEC, SH_EXPECT,
+
+  SH_H, SH_HO, SH_HOS, SH_HOST,
+
+  SH_T, SH_TR, SH_TRA, SH_TRAN, SH_TRANS, SH_TRANSF, SH_TRANSFE, SH_TRANSFER,
+  SH_TRANSFER_, SH_TRANSFER_E, SH_TRANSFER_EN, SH_TRANSFER_ENC, SH_TRANSFER_ENCO,
+  SH_TRANSFER_ENCOD, SH_TRANSFER_ENCODI, SH_TRANSFER_ENCODIN,
+  SH_TRANSFER_ENCODING,
+
+  SH_U, SH_UP, SH_UPG, SH_UPGR, SH_UPGRA, SH_UPGRAD, SH_UPGRADE,
+
+  SH_STATE_MAX,
+};
+
+enum {
+  SCLOSE_NOSTATE = 0,
+  SCLOSE_WAIT,
+  SCLOSE_C,
+  SCLOSE_CL,
+  SCLOSE_CLO,
+  SCLOSE_CLOS,
+  SCLOSE_CLOSE,
+
+  SCLOSE_CONFIRMED,
+  // SCLOSE_K + n: the letters of "keep-alive" matched up to index n
+  SCLOSE_K,
+};
+
+// kept in the state once a "keep-alive" token was seen
+#define SCLOSE_KEEP_ALIVE 0x80
+
+enum {
+  SCHUNKED_WAIT = 0,
+  SCHUNKED_TRIM,
+  SCHUNKED_NOSTATE,
+  SCHUNKED_C,
+  SCHUNKED_CH,
+  SCHUNKED_CHU,
+  SCHUNKED_CHUN,
+  SCHUNKED_CHUNK,
+  SCHUNKED_CHUNKE,
+  SCHUNKED_CHUNKED,
+  SCHUNKED_CONFIRMED,
+  SCHUNKED_NOT_LAST,
+};
+
+// kept in the state once a "chunked" coding was seen, and once seen again
+#define SCHUNKED_SEEN 0x80
+#define SCHUNKED_TWICE 0x40
+#define SCHUNKED_STATE(state) ((state) & ~(SCHUNKED_SEEN | SCHUNKED_TWICE))
+
+// request methods, same letters as header names
+enum {
+  SM_IGNORE = 0,
+  SM_NOSTATE,
+
+  SM_G, SM_GE, SM_GET,
+  SM_H, SM_HE, SM_HEA, SM_HEAD,
+  SM_P, SM_PO, SM_POS, SM_POST, SM_PU, SM_PUT, SM_PA, SM_PAT, SM_PATC,
+  SM_PATCH,
+  SM_D, SM_DE, SM_DEL, SM_DELE, SM_DELET, SM_DELETE,
+  SM_C, SM_CO, SM_CON, SM_CONN, SM_CONNE, SM_CONNEC, SM_CONNECT,
+  SM_O, SM_OP, SM_OPT, SM_OPTI, SM_OPTIO, SM_OPTION, SM_OPTIONS,
+  SM_T, SM_TR, SM_TRA, SM_TRAC, SM_TRACE,
+
+  SM_STATE_MAX,
+};
+
+// content codings: coding index in the high nibble, matched length below
+enum {
+  SENC_NOSTATE = 0,
+  SENC_GZIP,
+  SENC_X_GZIP,
+  SENC_DEFLATE,
+  SENC_IDENTITY,
+
+  SENC_CODINGS,
+  SENC_OTHER = 0xff,
+};
+
+// expectations: matched length of "100-continue"
+enum {
+  SEXPECT_NOSTATE = 0,
+  SEXPECT_CONTINUE = 12,
+  SEXPECT_OTHER = 0xff,
+};
+
+/**
+ * @bug Requires at least one header
+ */
+
+enum {
+  C_TOKEN = 1 << 0,
+  C_VCHAR = 1 << 1,
+  C_URI = 1 << 2,
+  C_HEX = 1 << 3,
+};
+
+// header name letters, case folded
+enum {
+  HC_OTHER = 0,
+  HC_A, HC_C, HC_D, HC_E, HC_F, HC_G, HC_H, HC_I, HC_L, HC_N, HC_O, HC_P,
+  HC_R, HC_S, HC_T, HC_U, HC_X, HC_DASH,
+
+  HC_MAX,
+};
+
+static const uint8_t cclass[0x100];
+static const uint8_t hclass[0x100];
+
+#define is_request(s) \
+  ((s)->mode == EHTTP_MODE_REQUEST || (s)->requestType == EHTTP_MODE_REQUEST)
+
+// '\n' without its '\r', accepted under EHTTP_FLAG_LENIENT unless strict
+#define is_bare_lf(s) (*(s)->p == '\n' && ((s)->flags & EHTTP_FLAG_LENIENT) && \
+  !((s)->flags & EHTTP_FLAG_STRICT))
+
+#define is_token(c) (cclass[(c)] & C_TOKEN)
+#define is_vchar(c) (cclass[(c)] & C_VCHAR)
+#define is_urichar(c) (cclass[(c)] & C_URI)
+#define is_hexchar(c) (cclass[(c)] & C_HEX)
+
+static inline uint8_t header_name_lookup(uint8_t state, uint8_t c);
+static inline uint8_t method_lookup(uint8_t state, uint8_t c);
+static inline ehttp_method method_of(uint8_t state);
+static inline uint8_t header_lf_close(uint8_t state, uint8_t c);
+static inline uint8_t header_lf_chunked(uint8_t state, uint8_t c);
+static inline uint8_t header_content_encoding(uint8_t state, uint8_t c);
+static inline uint8_t header_expect(uint8_t state, uint8_t c);
+static inline bool response_without_content(const ehttp_parser *s);
+static inline size_t swar_decimal(size_t *value, const uint8_t *p,
+                                  const uint8_t *end);
+static inline size_t swar_hex(size_t *value, const uint8_t *p,
+                              const uint8_t *end);
+
+// a number parsed by swar_*() does not fit a size_t
+#define SWAR_OVERFLOW SIZE_MAX
+static inline ehttp_encoding header_content_encoding_done(uint8_t state);
+
+static inline uint8_t header_name_lookup(uint8_t state, uint8_t c) {
+  static const uint8_t table[SH_STATE_MAX][HC_MAX] = {
+    [SH_NOSTATE] = {
+      [HC_C] = SH_C, [HC_E] = SH_E, [HC_H] = SH_H, [HC_T] = SH_T, [HC_U] = SH_U
+    },
+    [SH_C] = { [HC_O] = SH_CO },
+    [SH_CO] = { [HC_N] = SH_CON },
+    [SH_CON] = { [HC_N] = SH_CONN, [HC_T] = SH_CONT },
+    [SH_CONN] = { [HC_E] = SH_CONNE },
+    [SH_CONNE] = { [HC_C] = SH_CONNEC },
+    [SH_CONNEC] = { [HC_T] = SH_CONNECT },
+    [SH_CONNECT] = { [HC_I] = SH_CONNECTI },
+    [SH_CONNECTI] = { [HC_O] = SH_CONNECTIO },
+    [SH_CONNECTIO] = { [HC_N] = SH_CONNECTION },
+
+    [SH_CONT] = { [HC_E] = SH_CONTE },
+    [SH_CONTE] = { [HC_N] = SH_CONTEN },
+    [SH_CONTEN] = { [HC_T] = SH_CONTENT },
+    [SH_CONTENT] = { [HC_DASH] = SH_CONTENT_ },
+    [SH_CONTENT_] = { [HC_L] = SH_CONTENT_L, [HC_E] = SH_CONTENT_E },
+    [SH_CONTENT_L] = { [HC_E] = SH_CONTENT_LE },
+    [SH_CONTENT_LE] = { [HC_N] = SH_CONTENT_LEN },
+    [SH_CONTENT_LEN] = { [HC_G] = SH_CONTENT_LENG },
+    [SH_CONTENT_LENG] = { [HC_T] = SH_CONTENT_LENGT },
+    [SH_CONTENT_LENGT] = { [HC_H] = SH_CONTENT_LENGTH },
+
+    [SH_CONTENT_E] = { [HC_N] = SH_CONTENT_EN },
+    [SH_CONTENT_EN] = { [HC_C] = SH_CONTENT_ENC },
+    [SH_CONTENT_ENC] = { [HC_O] = SH_CONTENT_ENCO },
+    [SH_CONTENT_ENCO] = { [HC_D] = SH_CONTENT_ENCOD },
+    [SH_CONTENT_ENCOD] = { [HC_I] = SH_CONTENT_ENCODI },
+    [SH_CONTENT_ENCODI] = { [HC_N] = SH_CONTENT_ENCODIN },
+    [SH_CONTENT_ENCODIN] = { [HC_G] = SH_CONTENT_ENCODING },
+
+    [SH_E] = { [HC_X] = SH_EX },
+    [SH_EX] = { [HC_P] = SH_EXP },
+    [SH_EXP] = { [HC_E] = SH_EXPE },
+    [SH_EXPE] = { [HC_C] = SH_EXPEC },
+    [SH_EXPEC] = { [HC_T] = SH_EXPECT },
+
+    [SH_H] = { [HC_O] = SH_HO },
+    [SH_HO] = { [HC_S] = SH_HOS },
+    [SH_HOS] = { [HC_T] = SH_HOST },
+
+    [SH_T] = { [HC_R] = SH_TR },
+    [SH_TR] = { [HC_A] = SH_TRA },
+    [SH_TRA] = { [HC_N] = SH_TRAN },
+    [SH_TRAN] = { [HC_S] = SH_TRANS },
+    [SH_TRANS] = { [HC_F] = SH_TRANSF },
+    [SH_TRANSF] = { [HC_E] = SH_TRANSFE },
+    [SH_TRANSFE] = { [HC_R] = SH_TRANSFER },
+    [SH_TRANSFER] = { [HC_DASH] = SH_TRANSFER_ },
+    [SH_TRANSFER_] = { [HC_E] = SH_TRANSFER_E },
+    [SH_TRANSFER_E] = { [HC_N] = SH_TRANSFER_EN },
+    [SH_TRANSFER_EN] = { [HC_C] = SH_TRANSFER_ENC },
+    [SH_TRANSFER_ENC] = { [HC_O] = SH_TRANSFER_ENCO },
+    [SH_TRANSFER_ENCO] = { [HC_D] = SH_TRANSFER_ENCOD },
+    [SH_TRANSFER_ENCOD] = { [HC_I] = SH_TRANSFER_ENCODI },
+    [SH_TRANSFER_ENCODI] = { [HC_N] = SH_TRANSFER_ENCODIN },
+    [SH_TRANSFER_ENCODIN] = { [HC_G] = SH_TRANSFER_ENCODING },
+
+    [SH_U] = { [HC_P] = SH_UP },
+    [SH_UP] = { [HC_G] = SH_UPG },
+    [SH_UPG] = { [HC_R] = SH_UPGR },
+    [SH_UPGR] = { [HC_A] = SH_UPGRA },
+    [SH_UPGRA] = { [HC_D] = SH_UPGRAD },
+    [SH_UPGRAD] = { [HC_E] = SH_UPGRADE },
+  };
+
+  return table[state][hclass[c]];
+}
+
+// methods are case-sensitive
+static inline uint8_t method_lookup(uint8_t state, uint8_t c) {
+  static const uint8_t table[SM_STATE_MAX][HC_MAX] = {
+    [SM_NOSTATE] = {
+      [HC_G] = SM_G, [HC_H] = SM_H, [HC_P] = SM_P, [HC_D] = SM_D,
+      [HC_C] = SM_C, [HC_O] = SM_O, [HC_T] = SM_T,
+    },
+    [SM_G] = { [HC_E] = SM_GE },
+    [SM_GE] = { [HC_T] = SM_GET },
+
+    [SM_H] = { [HC_E] = SM_HE },
+    [SM_HE] = { [HC_A] = SM_HEA },
+    [SM_HEA] = { [HC_D] = SM_HEAD },
+
+    [SM_P] = { [HC_O] = SM_PO, [HC_U] = SM_PU, [HC_A] = SM_PA },
+    [SM_PO] = { [HC_S] = SM_POS },
+    [SM_POS] = { [HC_T] = SM_POST },
+    [SM_PU] = { [HC_T] = SM_PUT },
+    [SM_PA] = { [HC_T] = SM_PAT },
+    [SM_PAT] = { [HC_C] = SM_PATC },
+    [SM_PATC] = { [HC_H] = SM_PATCH },
+
+    [SM_D] = { [HC_E] = SM_DE },
+    [SM_DE] = { [HC_L] = SM_DEL },
+    [SM_DEL] = { [HC_E] = SM_DELE },
+    [SM_DELE] = { [HC_T] = SM_DELET },
+    [SM_DELET] = { [HC_E] = SM_DELETE },
+
+    [SM_C] = { [HC_O] = SM_CO },
+    [SM_CO] = { [HC_N] = SM_CON },
+    [SM_CON] = { [HC_N] = SM_CONN },
+    [SM_CONN] = { [HC_E] = SM_CONNE },
+    [SM_CONNE] = { [HC_C] = SM_CONNEC },
+    [SM_CONNEC] = { [HC_T] = SM_CONNECT },
+
+    [SM_O] = { [HC_P] = SM_OP },
+    [SM_OP] = { [HC_T] = SM_OPT },
+    [SM_OPT] = { [HC_I] = SM_OPTI },
+    [SM_OPTI] = { [HC_O] = SM_OPTIO },
+    [SM_OPTIO] = { [HC_N] = SM_OPTION },
+    [SM_OPTION] = { [HC_S] = SM_OPTIONS },
+
+    [SM_T] = { [HC_R] = SM_TR },
+    [SM_TR] = { [HC_A] = SM_TRA },
+    [SM_TRA] = { [HC_C] = SM_TRAC },
+    [SM_TRAC] = { [HC_E] = SM_TRACE },
+  };
+
+  if (c >= 'a' && c <= 'z') {
+    return SM_IGNORE;
+  }
+
+  return table[state][hclass[c]];
+}
+
+static inline ehttp_method method_of(uint8_t state) {
+  switch (state) {
+    case SM_GET: return EHTTP_METHOD_GET;
+    case SM_HEAD: return EHTTP_METHOD_HEAD;
+    case SM_POST: return EHTTP_METHOD_POST;
+    case SM_PUT: return EHTTP_METHOD_PUT;
+    case SM_PATCH: return EHTTP_METHOD_PATCH;
+    case SM_DELETE: return EHTTP_METHOD_DELETE;
+    case SM_CONNECT: return EHTTP_METHOD_CONNECT;
+    case SM_OPTIONS: return EHTTP_METHOD_OPTIONS;
+    case SM_TRACE: return EHTTP_METHOD_TRACE;
+  }
+
+  return EHTTP_METHOD_UNKNOWN;
+}
+
+// one step of the "close" or "keep-alive" token, SCLOSE_KEEP_ALIVE aside
+static inline uint8_t header_lf_close_token(uint8_t state, uint8_t c) {
+  static const char keepAlive[] = "keep-alive";
+
+  switch (state) {
+    case SCLOSE_NOSTATE:
+      if (c == 'C' || c == 'c') {
+        return SCLOSE_C;
+      }
+      else if (c == 'K' || c == 'k') {
+        return SCLOSE_K;
+      }
+      else if (c == ',' || c == ' ' || c == '\t') {
+        return SCLOSE_NOSTATE;
+      }
+
+      return SCLOSE_WAIT;
+
+    // wait for ,
+    case SCLOSE_WAIT:
+      if (c == ',') {
+        return SCLOSE_NOSTATE;
+      }
+
+      return SCLOSE_WAIT;
+
+    case SCLOSE_C:
+      if (c == 'L' || c == 'l') {
+        return SCLOSE_CL;
+      }
+
+      return SCLOSE_WAIT;
+
+    case SCLOSE_CL:
+      if (c == 'O' || c == 'o') {
+        return SCLOSE_CLO;
+      }
+
+      return SCLOSE_WAIT;
+
+    case SCLOSE_CLO:
+      if (c == 'S' || c == 's') {
+        return SCLOSE_CLOS;
+      }
+
+      return SCLOSE_WAIT;
+
+    case SCLOSE_CLOS:
+      if (c == 'E' || c == 'e') {
+        return SCLOSE_CLOSE;
+      }
+
+      return SCLOSE_WAIT;
+
+    case SCLOSE_CLOSE:
+      if (c == ' ' || c == '\t' || c == '\t' || c == '\r' || c == ',') {
+        return SCLOSE_CONFIRMED;
+      }
+
+      return SCLOSE_WAIT;
+
+    case SCLOSE_CONFIRMED:
+      return SCLOSE_CONFIRMED;
+  }
+
+  // "keep-alive", letters are matched in lower case and '-' is kept
+  state -= SCLOSE_K - 1;
+  if (state < sizeof(keepAlive) - 1) {
+    return ((c | 0x20) == keepAlive[state]) ? SCLOSE_K + state : SCLOSE_WAIT;
+  }
+  else if (c == ',') {
+    return SCLOSE_NOSTATE | SCLOSE_KEEP_ALIVE;
+  }
+  else if (c == ' ' || c == '\t' || c == '\r') {
+    return SCLOSE_WAIT | SCLOSE_KEEP_ALIVE;
+  }
+
+  return SCLOSE_WAIT;
+}
+
+// looking for "close" and "keep-alive" tokens, "close" wins
+static inline uint8_t header_lf_close(uint8_t state, uint8_t c) {
+  const uint8_t next = header_lf_close_token(state & ~SCLOSE_KEEP_ALIVE, c);
+
+  return (next == SCLOSE_CONFIRMED) ? next : next | (state & SCLOSE_KEEP_ALIVE);
+}
+
+// looking for "chunked" token (must be the last one, and appear once);
+// SCHUNKED_CONFIRMED when the value ends with it
+static inline uint8_t header_lf_chunked(uint8_t state, uint8_t c) {
+  //fprintf(stderr, "%s %u:%c\n", __func__, state, c);
+  static const uint8_t table[][0x100] = {
+    [SCHUNKED_WAIT] = {
+      [','] = SCHUNKED_TRIM
+    },
+    [SCHUNKED_TRIM] = {
+      [' '] = SCHUNKED_TRIM, ['\t'] = SCHUNKED_TRIM,
+      ['C'] = SCHUNKED_C, ['c'] = SCHUNKED_C,
+    },
+
+    [SCHUNKED_NOSTATE] = { ['C'] = SCHUNKED_C, ['c'] = SCHUNKED_C },
+    [SCHUNKED_C] = { ['H'] = SCHUNKED_CH, ['h'] = SCHUNKED_CH },
+    [SCHUNKED_CH] = { ['U'] = SCHUNKED_CHU, ['u'] = SCHUNKED_CHU },
+    [SCHUNKED_CHU] = { ['N'] = SCHUNKED_CHUN, ['n'] = SCHUNKED_CHUN },
+    [SCHUNKED_CHUN] = { ['K'] = SCHUNKED_CHUNK, ['k'] = SCHUNKED_CHUNK },
+    [SCHUNKED_CHUNK] = { ['E'] = SCHUNKED_CHUNKE, ['e'] = SCHUNKED_CHUNKE },
+    [SCHUNKED_CHUNKE] = { ['D'] = SCHUNKED_CHUNKED, ['d'] = SCHUNKED_CHUNKED },
+    [SCHUNKED_CHUNKED] = {
+      // QWS at the end
+      [' '] = SCHUNKED_CHUNKED,
+      ['\t'] = SCHUNKED_CHUNKED,
+      ['\r'] = SCHUNKED_CONFIRMED,
+      // chunk not last
+      [','] = SCHUNKED_NOT_LAST,
+    },
+  };
+  uint8_t kept = state & (SCHUNKED_SEEN | SCHUNKED_TWICE);
+
+  state = table[SCHUNKED_STATE(state)][c];
+  // a chunked coding ends here
+  if (state == SCHUNKED_CONFIRMED || state == SCHUNKED_NOT_LAST) {
+    kept |= (kept & SCHUNKED_SEEN) ? SCHUNKED_TWICE : SCHUNKED_SEEN;
+    if (state == SCHUNKED_NOT_LAST) {
+      state = SCHUNKED_TRIM;
+    }
+  }
+  return state | kept;
+}
+
+// looking for a single "gzip", "x-gzip", "deflate" or "identity" coding
+static inline uint8_t header_content_encoding(uint8_t state, uint8_t c) {
+  static const char codings[SENC_CODINGS][9] = {
+    [SENC_GZIP] = "gzip",
+    [SENC_X_GZIP] = "x-gzip",
+    [SENC_DEFLATE] = "deflate",
+    [SENC_IDENTITY] = "identity",
+  };
+  uint8_t coding = state >> 4;
+  uint8_t pos = state & 0x0f;
+
+  if (state == SENC_OTHER) {
+    return SENC_OTHER;
+  }
+
+  if (c >= 'A' && c <= 'Z') {
+    c += 'a' - 'A';
+  }
+
+  if (state == SENC_NOSTATE) {
+    for (coding = SENC_GZIP; coding < SENC_CODINGS; coding++) {
+      if (codings[coding][0] == c) {
+        return coding << 4 | 1;
+      }
+    }
+
+    return SENC_OTHER;
+  }
+
+  // matched, only OWS may follow
+  if (codings[coding][pos] == '\0') {
+    return (c == ' ' || c == '\t') ? state : SENC_OTHER;
+  }
+
+  return codings[coding][pos] == c ? state + 1 : SENC_OTHER;
+}
+
+static inline ehttp_encoding header_content_encoding_done(uint8_t state) {
+  static const uint8_t lengths[SENC_CODINGS] = {
+    [SENC_GZIP] = 4, [SENC_X_GZIP] = 6, [SENC_DEFLATE] = 7, [SENC_IDENTITY] = 8,
+  };
+  static const ehttp_encoding encodings[SENC_CODINGS] = {
+    [SENC_GZIP] = EHTTP_ENCODING_GZIP,
+    [SENC_X_GZIP] = EHTTP_ENCODING_GZIP,
+    [SENC_DEFLATE] = EHTTP_ENCODING_DEFLATE,
+    [SENC_IDENTITY] = EHTTP_ENCODING_IDENTITY,
+  };
+
+  if (state == SENC_OTHER || state == SENC_NOSTATE
+      || (state & 0x0f) != lengths[state >> 4]) {
+    return EHTTP_ENCODING_UNKNOWN;
+  }
+
+  return encodings[state >> 4];
+}
+
+// looking for the "100-continue" expectation, OWS allowed after it
+static inline uint8_t header_expect(uint8_t state, uint8_t c) {
+  static const char expect[SEXPECT_CONTINUE + 1] = "100-continue";
+
+  if (state == SEXPECT_OTHER) {
+    return SEXPECT_OTHER;
+  }
+
+  if (state == SEXPECT_CONTINUE) {
+    return (c == ' ' || c == '\t') ? SEXPECT_CONTINUE : SEXPECT_OTHER;
+  }
+
+  if (c >= 'A' && c <= 'Z') {
+    c += 'a' - 'A';
+  }
+
+  return (c == expect[state]) ? state + 1 : SEXPECT_OTHER;
+}
+
+// RFC 9112 6.3: framing headers of these responses describe no content
+static inline bool response_without_content(const ehttp_parser *s) {
+  return s->requestMethod == EHTTP_METHOD_HEAD
+    || (s->statusCode >= 100 && s->statusCode < 200)
+    || s->statusCode == 204 || s->statusCode == 304
+    // a tunnel follows
+    || (s->requestMethod == EHTTP_METHOD_CONNECT
+        && s->statusCode >= 200 && s->statusCode < 300);
+}
+
+/*
+ * Numbers eight digits at a time: a little endian 64 bit load puts the
+ * first (most significant) digit in the low byte. Bytes are classified
+ * with carry free additions on 7 bit lanes, so every lane is exact.
+ */
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SWAR_ONES UINT64_C(0x0101010101010101)
+#define SWAR_HIGH (SWAR_ONES * 0x80)
+// high bit of every lane holding a byte >= n
+#define swar_ge(x7, n) (((x7) + SWAR_ONES * (0x80 - (n))) & SWAR_HIGH)
+
+// digits at the start of word, up to 8
+static inline unsigned swar_count(uint64_t valid) {
+  uint64_t invalid = ~valid & SWAR_HIGH;
+
+  return invalid ? (unsigned) __builtin_ctzll(invalid) / 8 : 8;
+}
+
+static inline uint64_t swar_load(const uint8_t *p) {
+  uint64_t word;
+
+  memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+/*
+ * Adds the decimal digits at p to value, a word at a time while 8 bytes
+ * are left. Returns the digits consumed (0 when less than a word is left)
+ * or SWAR_OVERFLOW.
+ */
+static inline size_t swar_decimal(size_t *value, const uint8_t *p,
+                                  const uint8_t *end) {
+  static const uint64_t pow10[9] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+  };
+  size_t consumed = 0;
+
+  while (end - p >= 8) {
+    uint64_t word = swar_load(p);
+    uint64_t x7 = word & (SWAR_ONES * 0x7f);
+    unsigned n = swar_count(swar_ge(x7, '0') & ~swar_ge(x7, '9' + 1) & ~word);
+    uint64_t d;
+
+    if (!n) {
+      break;
+    }
+
+    // digits to the high bytes, the low ones become leading zeros
+    d = (word - SWAR_ONES * '0') << (8 * (8 - n));
+    d = d * 10 + (d >> 8);
+    d = (((d & UINT64_C(0x000000ff000000ff)) * (100 + (UINT64_C(1000000) << 32)))
+        + (((d >> 16) & UINT64_C(0x000000ff000000ff)) * (1 + (UINT64_C(10000) << 32))))
+        >> 32;
+
+    if (*value > (SIZE_MAX - d) / pow10[n]) {
+      return SWAR_OVERFLOW;
+    }
+
+    *value = *value * pow10[n] + d;
+    consumed += n;
+    p += n;
+
+    if (n < 8) {
+      break;
+    }
+  }
+
+  return consumed;
+}
+
+/*
+ * Same as swar_decimal() for hexadecimal digits.
+ */
+static inline size_t swar_hex(size_t *value, const uint8_t *p,
+                              const uint8_t *end) {
+  size_t consumed = 0;
+
+  while (end - p >= 8) {
+    uint64_t word = swar_load(p);
+    uint64_t x7 = word & (SWAR_ONES * 0x7f);
+    uint64_t lower = (word | (SWAR_ONES * 0x20)) & (SWAR_ONES * 0x7f);
+    unsigned n = swar_count(
+      ((swar_ge(x7, '0') & ~swar_ge(x7, '9' + 1))
+       | (swar_ge(lower, 'a') & ~swar_ge(lower, 'f' + 1))) & ~word);
+    uint64_t d;
+
+    if (!n) {
+      break;
+    }
+
+    // nibble per byte: letters have 0x40 set and their low bits start at 1
+    d = (word & (SWAR_ONES * 0x0f)) + 9 * ((word >> 6) & SWAR_ONES);
+    d <<= 8 * (8 - n);
+    d = ((d & UINT64_C(0x00ff00ff00ff00ff)) << 4)
+        | ((d >> 8) & UINT64_C(0x00ff00ff00ff00ff));
+    d = ((d & UINT64_C(0x0000ffff0000ffff)) << 8)
+        | ((d >> 16) & UINT64_C(0x0000ffff0000ffff));
+    d = ((d & UINT64_C(0x00000000ffffffff)) << 16) | (d >> 32);
+
+    if (4 * n >= sizeof(size_t) * 8
+        ? *value != 0 || d > SIZE_MAX
+        : (*value >> (sizeof(size_t) * 8 - 4 * n)) != 0) {
+      return SWAR_OVERFLOW;
+    }
+
+    *value = (size_t) (*value << (4 * n % (sizeof(size_t) * 8))) + d;
+    consumed += n;
+    p += n;
+
+    if (n < 8) {
+      break;
+    }
+  }
+
+  return consumed;
+}
+
+#undef SWAR_ONES
+#undef SWAR_HIGH
+#undef swar_ge
+#else
+static inline size_t swar_decimal(size_t *value, const uint8_t *p,
+                                  const uint8_t *end) {
+  (void) value; (void) p; (void) end;
+  return 0;
+}
+
+static inline size_t swar_hex(size_t *value, const uint8_t *p,
+                              const uint8_t *end) {
+  (void) value; (void) p; (void) end;
+  return 0;
+}
+#endif
+
+/*
+ * Character classes, one bit per class:
+ *   C_TOKEN  tchar (RFC 9110)
+ *   C_VCHAR  field-vchar, SP and HTAB (obs-text unless CORE_HTTP_STRICT)
+ *   C_URI    unreserved, gen-delims and sub-delims
+ *   C_HEX    HEXDIG
+ */
+static const uint8_t cclass[0x100] = {
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x02, 0x07, 0x02, 0x07, 0x07, 0x03, 0x07, 0x07,
+  0x06, 0x06, 0x07, 0x07, 0x06, 0x07, 0x07, 0x06,
+  0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f,
+  0x0f, 0x0f, 0x06, 0x06, 0x02, 0x06, 0x02, 0x06,
+  0x06, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x07,
+  0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07,
+  0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07,
+  0x07, 0x07, 0x07, 0x06, 0x02, 0x06, 0x03, 0x07,
+  0x03, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x07,
+  0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07,
+  0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07,
+  0x07, 0x07, 0x07, 0x02, 0x03, 0x02, 0x07, 0x00,
+#ifndef CORE_HTTP_STRICT
+  [0x80] = 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+           0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+           0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+           0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+           0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+           0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+           0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+           0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+           0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+           0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+           0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+           0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+           0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+           0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+           0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+           0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+#endif
+};
+
+/*
+ * Equivalence classes of header name characters: only the letters of the
+ * names matched by header_name_lookup() get a class of their own.
+ */
+static const uint8_t hclass[0x100] = {
+  ['A'] = HC_A, ['a'] = HC_A, ['C'] = HC_C, ['c'] = HC_C,
+  ['D'] = HC_D, ['d'] = HC_D, ['E'] = HC_E, ['e'] = HC_E,
+  ['F'] = HC_F, ['f'] = HC_F, ['G'] = HC_G, ['g'] = HC_G,
+  ['H'] = HC_H, ['h'] = HC_H, ['I'] = HC_I, ['i'] = HC_I,
+  ['L'] = HC_L, ['l'] = HC_L, ['N'] = HC_N, ['n'] = HC_N,
+  ['O'] = HC_O, ['o'] = HC_O, ['P'] = HC_P, ['p'] = HC_P,
+  ['R'] = HC_R, ['r'] = HC_R, ['S'] = HC_S, ['s'] = HC_S,
+  ['T'] = HC_T, ['t'] = HC_T, ['U'] = HC_U, ['u'] = HC_U,
+  ['X'] = HC_X, ['x'] = HC_X, ['-'] = HC_DASH,
+};
+
+#endif
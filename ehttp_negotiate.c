@@ -0,0 +1,439 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ehttp_negotiate.h"
+
+#define CODING_ANY EHTTP_CODING_MAX
+
+static const struct {
+  const char *name;
+  uint8_t len;
+  uint8_t coding;
+} codings[] = {
+  { "br", 2, EHTTP_CODING_BR },
+  { "zstd", 4, EHTTP_CODING_ZSTD },
+  { "gzip", 4, EHTTP_CODING_GZIP },
+  { "x-gzip", 6, EHTTP_CODING_GZIP },
+  { "identity", 8, EHTTP_CODING_IDENTITY },
+  { "*", 1, CODING_ANY },
+};
+
+static const char * const suffixes[EHTTP_CODING_IDENTITY] = {
+  [EHTTP_CODING_BR] = ".br",
+  [EHTTP_CODING_ZSTD] = ".zst",
+  [EHTTP_CODING_GZIP] = ".gz",
+};
+
+static const char * const headers[EHTTP_CODING_MAX] = {
+  [EHTTP_CODING_BR] = "Content-Encoding: br\r\nVary: Accept-Encoding\r\n",
+  [EHTTP_CODING_ZSTD] = "Content-Encoding: zstd\r\nVary: Accept-Encoding\r\n",
+  [EHTTP_CODING_GZIP] = "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n",
+  [EHTTP_CODING_IDENTITY] = "Vary: Accept-Encoding\r\n",
+};
+
+static const uint8_t *skip_ows(const uint8_t *p, const uint8_t *end) {
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    p++;
+  }
+  return p;
+}
+
+static const uint8_t *skip_token(const uint8_t *p, const uint8_t *end) {
+  while (p < end && *p != ',' && *p != ';' && *p != '=' && *p != ' ' &&
+         *p != '\t') {
+    p++;
+  }
+  return p;
+}
+
+// qvalue = ( "0" [ "." 0*3DIGIT ] ) / ( "1" [ "." 0*3("0") ] )
+static bool parse_qvalue(const uint8_t **pp, const uint8_t *end,
+                         uint16_t *out) {
+  const uint8_t *p = *pp;
+  unsigned v;
+  unsigned scale = 100;
+
+  if (p == end || (*p != '0' && *p != '1')) {
+    return false;
+  }
+  v = (*p++ - '0') * 1000;
+
+  if (p < end && *p == '.') {
+    for (p++; p < end && scale && *p >= '0' && *p <= '9'; p++, scale /= 10) {
+      v += (*p - '0') * scale;
+    }
+  }
+
+  if (v > 1000) {
+    return false;
+  }
+
+  *pp = p;
+  *out = v;
+  return true;
+}
+
+/**
+ * Evaluates an Accept-Encoding value into q[EHTTP_CODING_MAX], in
+ * thousandths. Codings the value does not list get the q-value of "*", if
+ * any, or 0; identity gets 1000 unless excluded. Returns -1 on a syntax
+ * error, q then only accepts identity.
+ */
+int ehttp_accept_encoding(const uint8_t * const restrict in, size_t len,
+                          uint16_t * const restrict q) {
+  const uint8_t *p = in;
+  const uint8_t *end = in + len;
+  // listed q-values, the last one is for "*"
+  int listed[EHTTP_CODING_MAX + 1];
+  size_t i;
+
+  for (i = 0; i <= EHTTP_CODING_MAX; i++) {
+    listed[i] = -1;
+  }
+
+  for (;;) {
+    const uint8_t *name;
+    size_t nameLen;
+    uint16_t qv = 1000;
+
+    while (p < end && (*p == ',' || *p == ' ' || *p == '\t')) {
+      p++;
+    }
+    if (p == end) {
+      break;
+    }
+
+    name = p;
+    p = skip_token(p, end);
+    nameLen = p - name;
+    if (!nameLen) {
+      goto error;
+    }
+
+    p = skip_ows(p, end);
+    while (p < end && *p == ';') {
+      const uint8_t *param = skip_ows(p + 1, end);
+
+      p = skip_token(param, end);
+      if (p == param || p == end || *p != '=') {
+        goto error;
+      }
+      if (p - param == 1 && (*param | 0x20) == 'q') {
+        p++;
+        if (!parse_qvalue(&p, end, &qv)) {
+          goto error;
+        }
+      } else {
+        p = skip_token(p + 1, end);
+      }
+      p = skip_ows(p, end);
+    }
+
+    if (p < end && *p != ',') {
+      goto error;
+    }
+
+    for (i = 0; i < sizeof(codings) / sizeof(codings[0]); i++) {
+      if (codings[i].len == nameLen &&
+          !strncasecmp((const char *) name, codings[i].name, nameLen)) {
+        listed[codings[i].coding] = qv;
+        break;
+      }
+    }
+  }
+
+  for (i = 0; i < EHTTP_CODING_MAX; i++) {
+    if (listed[i] >= 0) {
+      q[i] = listed[i];
+    } else if (listed[CODING_ANY] >= 0) {
+      q[i] = listed[CODING_ANY];
+    } else {
+      q[i] = i == EHTTP_CODING_IDENTITY ? 1000 : 0;
+    }
+  }
+
+  return 0;
+
+error:
+  for (i = 0; i < EHTTP_CODING_MAX; i++) {
+    q[i] = i == EHTTP_CODING_IDENTITY ? 1000 : 0;
+  }
+  return -1;
+}
+
+typedef struct {
+  ehttp_asset *assets;
+  // offsets of the paths in names until the scan is over
+  size_t *offsets;
+  size_t count;
+  size_t cap;
+  char *names;
+  size_t namesLen;
+  size_t namesCap;
+} scan;
+
+static int add(scan *s, const char *path, size_t len) {
+  if (s->count == s->cap) {
+    size_t cap = s->cap ? s->cap * 2 : 64;
+    ehttp_asset *assets = realloc(s->assets, cap * sizeof(*assets));
+    size_t *offsets;
+
+    if (!assets) {
+      return -1;
+    }
+    s->assets = assets;
+    offsets = realloc(s->offsets, cap * sizeof(*offsets));
+    if (!offsets) {
+      return -1;
+    }
+    s->offsets = offsets;
+    s->cap = cap;
+  }
+
+  if (s->namesCap - s->namesLen < len + 1) {
+    size_t cap = s->namesCap ? s->namesCap * 2 : 4096;
+    char *names;
+
+    while (cap - s->namesLen < len + 1) {
+      cap *= 2;
+    }
+    names = realloc(s->names, cap);
+    if (!names) {
+      return -1;
+    }
+    s->names = names;
+    s->namesCap = cap;
+  }
+
+  memcpy(s->names + s->namesLen, path, len + 1);
+  s->offsets[s->count] = s->namesLen;
+  s->assets[s->count++] = (ehttp_asset) { .pathLen = len };
+  s->namesLen += len + 1;
+
+  return 0;
+}
+
+// path holds the directory relative to the root, with a trailing '/'
+static int scan_dir(scan *s, int dir, char *path, size_t pathLen) {
+  DIR *d = fdopendir(dir);
+  struct dirent *de;
+  int rc = 0;
+
+  if (!d) {
+    close(dir);
+    return -1;
+  }
+
+  while (!rc && (de = readdir(d))) {
+    size_t len = strlen(de->d_name);
+    struct stat st;
+
+    if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+      continue;
+    }
+    if (pathLen + len + 1 >= PATH_MAX) {
+      errno = ENAMETOOLONG;
+      rc = -1;
+      break;
+    }
+    if (fstatat(dirfd(d), de->d_name, &st, 0) < 0) {
+      // dangling symbolic link, or removed meanwhile
+      continue;
+    }
+
+    memcpy(path + pathLen, de->d_name, len + 1);
+
+    if (S_ISDIR(st.st_mode)) {
+      int sub = openat(dirfd(d), de->d_name,
+                       O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+      path[pathLen + len] = '/';
+      path[pathLen + len + 1] = '\0';
+      rc = sub < 0 ? -1 : scan_dir(s, sub, path, pathLen + len + 1);
+    } else if (S_ISREG(st.st_mode)) {
+      rc = add(s, path, pathLen + len);
+    }
+  }
+
+  closedir(d);
+  return rc;
+}
+
+static int by_path(const void *a, const void *b) {
+  return strcmp(((const ehttp_asset *) a)->path,
+                ((const ehttp_asset *) b)->path);
+}
+
+/**
+ * Indexes the regular files under the directory root, which stays open.
+ * Returns NULL with errno set on failure.
+ */
+ehttp_assets *ehttp_assets_init(ehttp_assets * const restrict assets,
+                                const char * const restrict root) {
+  char path[PATH_MAX];
+  scan s = { 0 };
+  int dir;
+  size_t i;
+
+  assets->root = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (assets->root < 0) {
+    return NULL;
+  }
+
+  dir = dup(assets->root);
+  path[0] = '\0';
+  if (dir < 0 || scan_dir(&s, dir, path, 0) < 0) {
+    int e = errno;
+
+    close(assets->root);
+    free(s.assets);
+    free(s.offsets);
+    free(s.names);
+    errno = e;
+    return NULL;
+  }
+
+  for (i = 0; i < s.count; i++) {
+    s.assets[i].path = s.names + s.offsets[i];
+  }
+  free(s.offsets);
+  if (s.count) {
+    qsort(s.assets, s.count, sizeof(*s.assets), by_path);
+  }
+
+  assets->assets = s.assets;
+  assets->count = s.count;
+  assets->names = s.names;
+
+  for (i = 0; i < s.count; i++) {
+    const ehttp_asset *a = &s.assets[i];
+    unsigned c;
+
+    for (c = 0; c < EHTTP_CODING_IDENTITY; c++) {
+      size_t len = strlen(suffixes[c]);
+      ehttp_asset *base;
+
+      if (a->pathLen > len &&
+          !memcmp(a->path + a->pathLen - len, suffixes[c], len) &&
+          (base = (ehttp_asset *) ehttp_assets_find(assets, a->path,
+                                                    a->pathLen - len))) {
+        base->variants |= 1 << c;
+      }
+    }
+  }
+
+  return assets;
+}
+
+/**
+ * Finds the asset at path (relative, without leading '/'), NULL when not
+ * indexed.
+ */
+const ehttp_asset *ehttp_assets_find(const ehttp_assets * const restrict assets,
+                                     const char * const restrict path,
+                                     size_t len) {
+  size_t lo = 0;
+  size_t hi = assets->count;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    const ehttp_asset *a = &assets->assets[mid];
+    int cmp = memcmp(a->path, path, a->pathLen < len ? a->pathLen : len);
+
+    if (!cmp) {
+      cmp = (a->pathLen > len) - (a->pathLen < len);
+    }
+    if (!cmp) {
+      return a;
+    }
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Opens the variant of an asset with the highest q-value, q being NULL
+ * when the request had no Accept-Encoding. Identity is sent even when
+ * the client excluded it. Returns the file descriptor, or -1 with errno
+ * set.
+ */
+int ehttp_assets_open(const ehttp_assets * const restrict assets,
+                      const ehttp_asset * const restrict asset,
+                      const uint16_t * const restrict q,
+                      ehttp_variant * const restrict variant) {
+  char path[PATH_MAX];
+  ehttp_coding best = EHTTP_CODING_IDENTITY;
+  int c;
+
+  if (q) {
+    // on a tie the preferred coding, and any coding over identity
+    for (c = EHTTP_CODING_IDENTITY - 1; c >= 0; c--) {
+      if ((asset->variants & (1 << c)) && q[c] && q[c] >= q[best]) {
+        best = c;
+      }
+    }
+  }
+
+  variant->coding = best;
+  variant->headers = asset->variants ? headers[best] : "";
+  variant->headersLen = strlen(variant->headers);
+
+  if (best == EHTTP_CODING_IDENTITY) {
+    return openat(assets->root, asset->path, O_RDONLY | O_CLOEXEC);
+  }
+
+  snprintf(path, sizeof(path), "%s%s", asset->path, suffixes[best]);
+  return openat(assets->root, path, O_RDONLY | O_CLOEXEC);
+}
+
+/**
+ * Closes the root and frees the index.
+ */
+void ehttp_assets_destroy(ehttp_assets * const assets) {
+  close(assets->root);
+  free(assets->assets);
+  free(assets->names);
+  assets->assets = NULL;
+  assets->names = NULL;
+  assets->count = 0;
+}
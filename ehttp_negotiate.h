@@ -0,0 +1,122 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_NEGOTIATE_VESTOL
+#define EHTTP_NEGOTIATE_VESTOL
+
+#include "ehttp.h"
+
+/*
+ * Accept-Encoding negotiation of precompressed files.
+ *
+ * ehttp_accept_encoding() evaluates the q-values of the value span
+ * delivered by on_header_value, without allocating. ehttp_assets_init()
+ * scans a directory tree once at startup and indexes every file together
+ * with its precompressed siblings ("app.js" and "app.js.br", "app.js.gz",
+ * "app.js.zst"). ehttp_assets_open() then picks the variant the client
+ * accepts best and returns the Content-Encoding and Vary header lines to
+ * send with it.
+ *
+ * Unlike ehttp_encoding, which names the codings the parser decodes,
+ * ehttp_coding lists the stored variants in order of preference: on equal
+ * q-values the smaller variant wins.
+ */
+
+typedef enum {
+  EHTTP_CODING_BR = 0,
+  EHTTP_CODING_ZSTD,
+  EHTTP_CODING_GZIP,
+  EHTTP_CODING_IDENTITY,
+  EHTTP_CODING_MAX,
+} ehttp_coding;
+
+typedef struct _ehttp_asset ehttp_asset;
+struct _ehttp_asset {
+  // relative to the root, without leading '/'
+  const char *path;
+  size_t pathLen;
+  // 1 << ehttp_coding of the precompressed siblings
+  uint8_t variants;
+};
+
+typedef struct _ehttp_assets ehttp_assets;
+struct _ehttp_assets {
+  int root;
+  // sorted by path
+  ehttp_asset *assets;
+  size_t count;
+  char *names;
+};
+
+typedef struct _ehttp_variant ehttp_variant;
+struct _ehttp_variant {
+  ehttp_coding coding;
+  // header lines to add, "" when the file has no variants
+  const char *headers;
+  size_t headersLen;
+};
+
+/**
+ * Evaluates an Accept-Encoding value into q[EHTTP_CODING_MAX], in
+ * thousandths. Codings the value does not list get the q-value of "*", if
+ * any, or 0; identity gets 1000 unless excluded. Returns -1 on a syntax
+ * error, q then only accepts identity.
+ */
+int ehttp_accept_encoding(const uint8_t * const restrict, size_t,
+                          uint16_t * const restrict q);
+
+/**
+ * Indexes the regular files under the directory root, which stays open.
+ * Returns NULL with errno set on failure.
+ */
+ehttp_assets *ehttp_assets_init(ehttp_assets * const restrict,
+                                const char * const restrict root);
+
+/**
+ * Finds the asset at path (relative, without leading '/'), NULL when not
+ * indexed.
+ */
+const ehttp_asset *ehttp_assets_find(const ehttp_assets * const restrict,
+                                     const char * const restrict path,
+                                     size_t);
+
+/**
+ * Opens the variant of an asset with the highest q-value, q being NULL
+ * when the request had no Accept-Encoding. Identity is sent even when
+ * the client excluded it. Returns the file descriptor, or -1 with errno
+ * set.
+ */
+int ehttp_assets_open(const ehttp_assets * const restrict,
+                      const ehttp_asset * const restrict,
+                      const uint16_t * const restrict q,
+                      ehttp_variant * const restrict);
+
+/**
+ * Closes the root and frees the index.
+ */
+void ehttp_assets_destroy(ehttp_assets * const);
+
+#endif
@@ -0,0 +1,1285 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+
+/*
+ * Parser template.
+ *
+ * Including this file instantiates a parse function whose callbacks are
+ * resolved at compile time: every EHTTP_ON_* macro left undefined is
+ * compiled out, the others are expanded in place and can be inlined.
+ *
+ *   #define EHTTP_PARSE_NAME ehttp_parse_myserver
+ *   #define EHTTP_ON_REQUEST_URI(s, at, len) my_uri(s, at, len)
+ *   #define EHTTP_ON_HEADERS_DONE(s) my_headers_done(s)
+ *   #include "ehttp_parse.h"
+ *
+ * yields
+ *
+ *   int ehttp_parse_myserver(ehttp_parser *, const void *, size_t);
+ *
+ * with the same return values as ehttp_parse(). The file may be included
+ * several times, every configuration macro is undefined at the end.
+ *
+ * EHTTP_PARSE_STORAGE  storage class of the function (default: none)
+ * EHTTP_PARSE_PARAMS   extra parameters, starting with a comma
+ * EHTTP_PARSE_CHECKS   extra argument checks for CORE_HTTP_CHECKS
+ * EHTTP_PARSE_END_NAME also instantiates the end of input function, with
+ *                      the same parameters as ehttp_parse_end()
+ *
+ * With EHTTP_TRACE defined, sampled messages are timed (see ehttp_trace.h).
+ */
+#include "ehttp_internal.h"
+
+#ifndef EHTTP_PARSE_NAME
+#error "EHTTP_PARSE_NAME must be defined before including ehttp_parse.h"
+#endif
+
+#ifndef EHTTP_PARSE_STORAGE
+#define EHTTP_PARSE_STORAGE
+#endif
+
+#ifndef EHTTP_PARSE_PARAMS
+#define EHTTP_PARSE_PARAMS
+#endif
+
+#ifndef EHTTP_PARSE_CHECKS
+#define EHTTP_PARSE_CHECKS 0
+#endif
+
+// data callbacks, compiled out when undefined
+#ifndef EHTTP_ON_METHOD
+#define EHTTP_ON_METHOD(s, at, len) ((void) 0)
+#endif
+#ifndef EHTTP_ON_REQUEST_URI
+#define EHTTP_ON_REQUEST_URI(s, at, len) ((void) 0)
+#endif
+#ifndef EHTTP_ON_HEADER_NAME
+#define EHTTP_ON_HEADER_NAME(s, at, len) ((void) 0)
+#endif
+#ifndef EHTTP_ON_HEADER_VALUE
+#define EHTTP_ON_HEADER_VALUE(s, at, len) ((void) 0)
+#endif
+#ifndef EHTTP_ON_CONTENT
+#define EHTTP_ON_CONTENT(s, at, len) ((void) 0)
+#endif
+
+// control callbacks, continue when undefined
+#ifndef EHTTP_ON_METHOD_DONE
+#define EHTTP_ON_METHOD_DONE(s) EHTTP_PARSER_CONTINUE
+#endif
+#ifndef EHTTP_ON_REQUEST_URI_DONE
+#define EHTTP_ON_REQUEST_URI_DONE(s) EHTTP_PARSER_CONTINUE
+#endif
+#ifndef EHTTP_ON_STATUS_LINE_DONE
+#define EHTTP_ON_STATUS_LINE_DONE(s) EHTTP_PARSER_CONTINUE
+#endif
+#ifndef EHTTP_ON_HEADER_NAME_DONE
+#define EHTTP_ON_HEADER_NAME_DONE(s) EHTTP_PARSER_CONTINUE
+#endif
+#ifndef EHTTP_ON_HEADER_VALUE_DONE
+#define EHTTP_ON_HEADER_VALUE_DONE(s) EHTTP_PARSER_CONTINUE
+#endif
+#ifndef EHTTP_ON_HEADERS_DONE
+#define EHTTP_ON_HEADERS_DONE(s) EHTTP_PARSER_CONTINUE
+#endif
+#ifndef EHTTP_ON_PARSER_DONE
+#define EHTTP_ON_PARSER_DONE(s) EHTTP_PARSER_CONTINUE
+#endif
+// its result is ignored
+#ifndef EHTTP_ON_ERROR
+#define EHTTP_ON_ERROR(s) ((void) 0)
+#endif
+
+// callbacks are timed apart from the parser
+#ifdef EHTTP_TRACE
+#include "ehttp_trace.h"
+#define TRACE(s, event) ((s)->traced ? ehttp_trace_event((s), (event)) : (void) 0)
+#define TRACE_CALL(s, call) \
+  (TRACE(s, EHTTP_TRACE_CALLBACK), (call), TRACE(s, EHTTP_TRACE_CALLBACK_DONE))
+#define TRACE_CTRL(s, call) \
+  (TRACE(s, EHTTP_TRACE_CALLBACK), ehttp_trace_ctrl((s), (call)))
+#define TRACE_EXIT(s) \
+  (TRACE(s, EHTTP_TRACE_EXIT), \
+   s->state == S_STATE_END ? TRACE(s, EHTTP_TRACE_DONE) : (void) 0)
+#else
+#define TRACE(s, event) ((void) 0)
+#define TRACE_CALL(s, call) (call)
+#define TRACE_CTRL(s, call) (call)
+#define TRACE_EXIT(s) ((void) 0)
+#endif
+
+EHTTP_PARSE_STORAGE int EHTTP_PARSE_NAME(ehttp_parser * const restrict s,
+                  const void * restrict in, size_t size
+                  EHTTP_PARSE_PARAMS)
+{
+  ehttp_ctrl ctrl;
+
+#ifdef CORE_HTTP_CHECKS
+  if (!s || !in || !size || EHTTP_PARSE_CHECKS || s->mode < EHTTP_MODE_REQUEST || s->mode > EHTTP_MODE_RESPONSE) {
+    return -1;
+  }
+#endif
+
+  s->end = (const uint8_t *) in + size;
+  s->mark = in;
+  s->p = in;
+
+#ifdef EHTTP_TRACE
+  if (s->state == S_NOSTATE || s->state == S_REQUEST_REQUIRED
+      || s->state == S_RESPONSE_REQUIRED) {
+    s->traced = ehttp_trace_sample();
+    TRACE(s, EHTTP_TRACE_ENTER);
+    TRACE(s, EHTTP_PHASE_REQUEST_LINE);
+  }
+  else {
+    TRACE(s, EHTTP_TRACE_ENTER);
+  }
+#endif
+
+  for (; s->p < s->end; s->p++) {
+    size_t tmp;
+check_again:
+    switch (s->state) {
+      case S_NOSTATE:
+        s->mark = s->p;
+        s->hnstate = method_lookup(SM_NOSTATE, *s->p);
+        if (*s->p == 'H') {
+          s->state = S_UND_H;
+          continue;
+        }
+        else if (is_token(*s->p)) {
+          s->requestType = EHTTP_MODE_REQUEST;
+          s->state = S_METHOD_CHAR;
+          continue;
+        }
+
+        break;
+
+      case S_UND_H:
+        s->hnstate = method_lookup(s->hnstate, *s->p);
+        if (*s->p == 'T') {
+          s->state = S_UND_HT;
+          continue;
+        }
+        else if (is_token(*s->p)) {
+          s->requestType = EHTTP_MODE_REQUEST;
+          s->state = S_METHOD_CHAR;
+          continue;
+        }
+
+        break;
+
+      case S_UND_HT:
+        s->hnstate = method_lookup(s->hnstate, *s->p);
+        if (*s->p == 'T') {
+          s->state = S_UND_HTT;
+          continue;
+        }
+        else if (is_token(*s->p)) {
+          s->requestType = EHTTP_MODE_REQUEST;
+          s->state = S_METHOD_CHAR;
+          continue;
+        }
+
+        break;
+
+      case S_UND_HTT:
+        s->hnstate = method_lookup(s->hnstate, *s->p);
+        if (*s->p == 'P') {
+          s->state = S_UND_HTTP;
+          continue;
+        }
+        else if (is_token(*s->p)) {
+          s->requestType = EHTTP_MODE_REQUEST;
+          s->state = S_METHOD_CHAR;
+          continue;
+        }
+
+        break;
+
+      case S_UND_HTTP:
+        s->hnstate = method_lookup(s->hnstate, *s->p);
+        if (*s->p == '/') {
+          s->state = S_RESPONSE_HTTP_MAJORV;
+          s->requestType = EHTTP_MODE_RESPONSE;
+          continue;
+        }
+        else if (is_token(*s->p)) {
+          s->requestType = EHTTP_MODE_REQUEST;
+          s->state = S_METHOD_CHAR;
+          continue;
+        }
+
+        break;
+
+      case S_REQUEST_REQUIRED:
+        s->mark = s->p;
+        if (is_token(*s->p)) {
+          s->hnstate = method_lookup(SM_NOSTATE, *s->p);
+          s->state = S_METHOD_CHAR;
+          continue;
+        }
+
+        break;
+
+      case S_METHOD_CHAR:
+        if (is_token(*s->p)) {
+          s->hnstate = method_lookup(s->hnstate, *s->p);
+          continue;
+        }
+        else if (*s->p == ' ') {
+          s->method = method_of(s->hnstate);
+          TRACE_CALL(s, EHTTP_ON_METHOD(s, s->mark, s->p - s->mark));
+          s->state = S_REQUEST_URI;
+          if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_METHOD_DONE(s)) ) != EHTTP_PARSER_CONTINUE) {
+            goto early_return;
+          }
+          continue;
+        }
+
+        break;
+
+      case S_REQUEST_URI:
+        // legal chars at 1st
+        s->mark = s->p;
+        if (*s->p == '/' || *s->p == 'h' || *s->p == 'H') {
+          s->state = S_REQUEST_URI_CHAR;
+          continue;
+        }
+        else if (*s->p == '*') {
+          s->state = S_REQUEST_URI_ASTERISK;
+          continue;
+        }
+
+        break;
+
+      case S_REQUEST_URI_CHAR:
+        if (is_urichar(*s->p)) {
+          continue;
+        }
+        else if (*s->p == '%') {
+          s->state = S_REQUEST_URI_1ST_HEX;
+          continue;
+        }
+        else if (*s->p == ' ') {
+          TRACE_CALL(s, EHTTP_ON_REQUEST_URI(s, s->mark, s->p - s->mark));
+          s->state = S_REQUEST_REQUIRE_VERSION;
+          if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_REQUEST_URI_DONE(s)) ) != EHTTP_PARSER_CONTINUE) {
+            goto early_return;
+          }
+          continue;
+        }
+
+        break;
+
+      case S_REQUEST_URI_1ST_HEX:
+        if (is_hexchar(*s->p)) {
+          s->state = S_REQUEST_URI_2ND_HEX;
+          continue;
+        }
+
+        break;
+
+      case S_REQUEST_URI_2ND_HEX:
+        if (is_hexchar(*s->p)) {
+          s->state = S_REQUEST_URI_CHAR;
+          continue;
+        }
+
+        break;
+
+      case S_REQUEST_URI_ASTERISK:
+        if (*s->p == ' ') {
+          s->state = S_REQUEST_REQUIRE_VERSION;
+          continue;
+        }
+
+        break;
+
+      case S_REQUEST_REQUIRE_VERSION:
+        if (*s->p == 'H') {
+          s->state = S_REQUEST_H;
+          continue;
+        }
+
+        break;
+
+      case S_REQUEST_H:
+        if (*s->p == 'T') {
+          s->state = S_REQUEST_HT;
+          continue;
+        }
+
+        break;
+
+      case S_REQUEST_HT:
+        if (*s->p == 'T') {
+          s->state = S_REQUEST_HTT;
+          continue;
+        }
+
+        break;
+
+      case S_REQUEST_HTT:
+        if (*s->p == 'P') {
+          s->state = S_REQUEST_HTTP;
+          continue;
+        }
+
+        break;
+
+      case S_REQUEST_HTTP:
+        if (*s->p == '/') {
+          s->state = S_REQUEST_HTTP_MAJORV;
+          continue;
+        }
+
+        break;
+
+      case S_REQUEST_HTTP_MAJORV:
+        if (*s->p >= '0' && *s->p <= '9') {
+          s->majorVersion = *s->p - '0';
+          s->state = S_REQUEST_HTTP_DOT;
+          continue;
+        }
+
+        break;
+
+      case S_REQUEST_HTTP_DOT:
+        if (*s->p == '.') {
+          s->state = S_REQUEST_HTTP_MINORV;
+          continue;
+        }
+
+        break;
+
+      case S_REQUEST_HTTP_MINORV:
+        if (*s->p >= '0' && *s->p <= '9') {
+          s->minorVersion = *s->p - '0';
+          s->state = S_REQUEST_EOL;
+          continue;
+        }
+
+        break;
+
+      case S_REQUEST_EOL:
+        if (*s->p == '\r') {
+          s->state = S_REQUEST_CRLF;
+          continue;
+        }
+        else if (is_bare_lf(s)) {
+          s->state = S_REQUEST_CRLF;
+          goto check_again;
+        }
+
+        break;
+
+      case S_REQUEST_CRLF:
+        if (*s->p == '\n') {
+          s->state = S_HEADER_NAME;
+          TRACE(s, EHTTP_PHASE_HEADERS);
+          if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_STATUS_LINE_DONE(s)) ) != EHTTP_PARSER_CONTINUE) {
+            goto early_return;
+          }
+          continue;
+        }
+
+        break;
+
+      case S_RESPONSE_REQUIRED:
+        if (*s->p == 'H') {
+          s->state = S_RESPONSE_H;
+          continue;
+        }
+
+        break;
+
+      case S_RESPONSE_H:
+        if (*s->p == 'T') {
+          s->state = S_RESPONSE_HT;
+          continue;
+        }
+
+        break;
+
+      case S_RESPONSE_HT:
+        if (*s->p == 'T') {
+          s->state = S_RESPONSE_HTT;
+          continue;
+        }
+
+        break;
+
+      case S_RESPONSE_HTT:
+        if (*s->p == 'P') {
+          s->state = S_RESPONSE_HTTP;
+          continue;
+        }
+
+        break;
+
+      case S_RESPONSE_HTTP:
+        if (*s->p == '/') {
+          s->state = S_RESPONSE_HTTP_MAJORV;
+          continue;
+        }
+
+        break;
+
+      case S_RESPONSE_HTTP_MAJORV:
+        if (*s->p >= '0' && *s->p <= '9') {
+          s->majorVersion = *s->p - '0';
+          s->state = S_RESPONSE_HTTP_DOT;
+          continue;
+        }
+
+        break;
+
+      case S_RESPONSE_HTTP_DOT:
+        if (*s->p == '.') {
+          s->state = S_RESPONSE_HTTP_MINORV;
+          continue;
+        }
+
+        break;
+
+      case S_RESPONSE_HTTP_MINORV:
+        if (*s->p >= '0' && *s->p <= '9') {
+          s->minorVersion = *s->p - '0';
+          s->state = S_STATUS_REQUIRED;
+          continue;
+        }
+
+        break;
+
+      case S_STATUS_REQUIRED:
+        if (*s->p == ' ') {
+          s->state = S_STATUS_1ST;
+          continue;
+        }
+
+        break;
+
+      case S_STATUS_1ST:
+        if (*s->p >= '1' && *s->p <= '9') {
+          s->statusCode = (*s->p - '0') * 100;
+          s->state = S_STATUS_2ND;
+          continue;
+        }
+
+        break;
+
+      case S_STATUS_2ND:
+        if (*s->p >= '0' && *s->p <= '9') {
+          s->statusCode += (*s->p - '0') * 10;
+          s->state = S_STATUS_3RD;
+          continue;
+        }
+
+        break;
+
+      case S_STATUS_3RD:
+        if (*s->p >= '0' && *s->p <= '9') {
+          s->statusCode += (*s->p - '0');
+          s->state = S_RESPONSE_REASON;
+          continue;
+        }
+
+        break;
+
+      case S_RESPONSE_REASON:
+        if (is_vchar(*s->p)) {
+          continue;
+        }
+        else if (*s->p == '\r') {
+          s->state = S_RESPONSE_EOL;
+          continue;
+        }
+        else if (is_bare_lf(s)) {
+          s->state = S_RESPONSE_EOL;
+          goto check_again;
+        }
+
+        break;
+
+      case S_RESPONSE_EOL:
+        if (*s->p == '\n') {
+          s->state = S_HEADER_NAME;
+          TRACE(s, EHTTP_PHASE_HEADERS);
+          if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_STATUS_LINE_DONE(s)) ) != EHTTP_PARSER_CONTINUE) {
+            goto early_return;
+          }
+          continue;
+        }
+
+        break;
+
+      case S_HEADER_NAME:
+        s->mark = s->p;
+        if (is_token(*s->p)) {
+          if ( (s->hnstate = header_name_lookup(SH_NOSTATE, *s->p) ) == 0) {
+            s->state = S_HEADER_NAME_CHAR;
+          }
+          else {
+            s->state = S_HEADER_NAME_CHAR_CHECK;
+          }
+          continue;
+        }
+        // no headers
+        else if (*s->p == '\r') {
+          s->state = S_HEADER_EOH;
+          continue;
+        }
+        else if (is_bare_lf(s)) {
+          s->state = S_HEADER_EOH;
+          goto check_again;
+        }
+
+        break;
+
+      case S_HEADER_NAME_CHAR:
+        if (is_token(*s->p)) {
+          continue;
+        }
+        else if (*s->p == ':') {
+          TRACE_CALL(s, EHTTP_ON_HEADER_NAME(s, s->mark, s->p - s->mark));
+          s->state = S_HEADER_VALUE;
+          if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_HEADER_NAME_DONE(s)) ) != EHTTP_PARSER_CONTINUE) {
+            goto early_return;
+          }
+          continue;
+        }
+        else if (*s->p == ' ' || *s->p == '\t') {
+          s->error = EHTTP_ERR_HEADER_NAME_WHITESPACE;
+        }
+
+        break;
+
+      case S_HEADER_NAME_CHAR_CHECK:
+        if (is_token(*s->p)) {
+          if ( (s->hnstate = header_name_lookup(s->hnstate, *s->p) ) == 0) {
+            s->state = S_HEADER_NAME_CHAR;
+          }
+
+          continue;
+        }
+        else if (*s->p == ':') {
+          TRACE_CALL(s, EHTTP_ON_HEADER_NAME(s, s->mark, s->p - s->mark));
+          s->state = S_HEADER_VALUE;
+          if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_HEADER_NAME_DONE(s)) ) != EHTTP_PARSER_CONTINUE) {
+            goto early_return;
+          }
+          continue;
+        }
+        else if (*s->p == ' ' || *s->p == '\t') {
+          s->error = EHTTP_ERR_HEADER_NAME_WHITESPACE;
+        }
+
+        break;
+
+      case S_HEADER_VALUE:
+        // trim ows
+        if (*s->p == ' ' || *s->p == '\t') {
+          continue;
+        }
+        else if (is_vchar(*s->p)) {
+          s->mark = s->p;
+
+          switch (s->hnstate) {
+            case SH_CONNECTION:
+              s->state = S_HEADER_VALUE_LF_CLOSE;
+              s->hvstate = SCLOSE_NOSTATE;
+              goto check_again;
+
+            case SH_HOST:
+              s->state = S_HEADER_VALUE_CHAR;
+              s->haveHostHeader = 1;
+              goto check_again;
+
+            case SH_TRANSFER_ENCODING:
+              if ((s->flags & EHTTP_FLAG_STRICT) && s->haveContentLength) {
+                s->error = EHTTP_ERR_TRANSFER_ENCODING_CONTENT_LENGTH;
+                break;
+              }
+
+              s->haveTransferEncoding = 1;
+              s->state = S_HEADER_VALUE_LF_CHUNKED;
+              goto check_again;
+
+            case SH_CONTENT_LENGTH:
+              if (s->flags & EHTTP_FLAG_STRICT) {
+                if (s->haveContentLength) {
+                  s->error = EHTTP_ERR_DUPLICATE_CONTENT_LENGTH;
+                  break;
+                }
+                if (s->haveTransferEncoding) {
+                  s->error = EHTTP_ERR_TRANSFER_ENCODING_CONTENT_LENGTH;
+                  break;
+                }
+              }
+              else if (s->haveContentLength) {
+                s->error = EHTTP_ERR_DUPLICATE_CONTENT_LENGTH;
+                break;
+              }
+
+              s->haveContentLength = 1;
+              s->state = S_HEADER_VALUE_CONTENT_LENGTH;
+              goto check_again;
+
+            case SH_CONTENT_ENCODING:
+              s->state = S_HEADER_VALUE_CONTENT_ENCODING;
+              s->hvstate = SENC_NOSTATE;
+              goto check_again;
+
+            case SH_EXPECT:
+              s->state = S_HEADER_VALUE_EXPECT;
+              s->hvstate = SEXPECT_NOSTATE;
+              goto check_again;
+
+            case SH_UPGRADE:
+              s->state = S_HEADER_VALUE_CHAR;
+              s->isUpgrade = 1;
+              goto check_again;
+
+            default:
+              s->state = S_HEADER_VALUE_CHAR;
+              goto check_again;
+          }
+        }
+
+        break;
+
+      case S_HEADER_VALUE_CHAR:
+        if (is_vchar(*s->p)) {
+          continue;
+        }
+        else if (*s->p == '\r' || is_bare_lf(s)) {
+          TRACE_CALL(s, EHTTP_ON_HEADER_VALUE(s, s->mark, s->p - s->mark));
+          s->state = (*s->p == '\r') ? S_HEADER_EOL : S_HEADER_CRLF;
+          if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_HEADER_VALUE_DONE(s)) ) != EHTTP_PARSER_CONTINUE) {
+            goto early_return;
+          }
+          continue;
+        }
+
+        break;
+
+      case S_HEADER_VALUE_LF_CLOSE:
+        if (is_vchar(*s->p)) {
+          s->hvstate = header_lf_close(s->hvstate, *s->p);
+          continue;
+        }
+        else if (*s->p == '\r' || is_bare_lf(s)) {
+          s->hvstate = header_lf_close(s->hvstate, '\r');
+
+          if (s->hvstate == SCLOSE_CONFIRMED) {
+            s->shouldClose = 1;
+          }
+          else if (s->hvstate & SCLOSE_KEEP_ALIVE) {
+            s->keepAlive = 1;
+          }
+
+          TRACE_CALL(s, EHTTP_ON_HEADER_VALUE(s, s->mark, s->p - s->mark));
+          s->state = (*s->p == '\r') ? S_HEADER_EOL : S_HEADER_CRLF;
+          if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_HEADER_VALUE_DONE(s)) ) != EHTTP_PARSER_CONTINUE) {
+            goto early_return;
+          }
+          continue;
+        }
+
+        break;
+
+      case S_HEADER_VALUE_LF_CHUNKED:
+        if (is_vchar(*s->p)) {
+          // a chunked coding in an earlier header counts as well
+          s->hvstate = header_lf_chunked(
+            SCHUNKED_NOSTATE | (s->haveChunked ? SCHUNKED_SEEN : 0), *s->p);
+          s->state = S_HEADER_VALUE_LF_CHUNKED_CHAR;
+          continue;
+        }
+
+        break;
+
+      case S_HEADER_VALUE_LF_CHUNKED_CHAR:
+        if (is_vchar(*s->p)) {
+          s->hvstate = header_lf_chunked(s->hvstate, *s->p);
+          continue;
+        }
+        else if (*s->p == '\r' || is_bare_lf(s)) {
+          s->hvstate = header_lf_chunked(s->hvstate, '\r');
+          // chunked must not be applied twice
+          if ((s->hvstate & SCHUNKED_TWICE) && (s->flags & EHTTP_FLAG_STRICT)) {
+            s->error = EHTTP_ERR_CHUNKED_TWICE;
+            break;
+          }
+
+          // only the last coding counts: a later header may add another
+          s->isChunked = SCHUNKED_STATE(s->hvstate) == SCHUNKED_CONFIRMED;
+          s->haveChunked = (s->hvstate & SCHUNKED_SEEN) != 0;
+
+          TRACE_CALL(s, EHTTP_ON_HEADER_VALUE(s, s->mark, s->p - s->mark));
+          s->state = (*s->p == '\r') ? S_HEADER_EOL : S_HEADER_CRLF;
+          if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_HEADER_VALUE_DONE(s)) ) != EHTTP_PARSER_CONTINUE) {
+            goto early_return;
+          }
+          continue;
+        }
+
+        break;
+
+      case S_HEADER_VALUE_CONTENT_ENCODING:
+        if (is_vchar(*s->p)) {
+          s->hvstate = header_content_encoding(s->hvstate, *s->p);
+          continue;
+        }
+        else if (*s->p == '\r' || is_bare_lf(s)) {
+          // stacked codings, or the header repeated, are not decoded
+          s->contentEncoding = s->contentEncoding
+            ? EHTTP_ENCODING_UNKNOWN
+            : header_content_encoding_done(s->hvstate);
+
+          TRACE_CALL(s, EHTTP_ON_HEADER_VALUE(s, s->mark, s->p - s->mark));
+          s->state = (*s->p == '\r') ? S_HEADER_EOL : S_HEADER_CRLF;
+          if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_HEADER_VALUE_DONE(s)) ) != EHTTP_PARSER_CONTINUE) {
+            goto early_return;
+          }
+          continue;
+        }
+
+        break;
+
+      case S_HEADER_VALUE_EXPECT:
+        if (is_vchar(*s->p)) {
+          s->hvstate = header_expect(s->hvstate, *s->p);
+          continue;
+        }
+        else if (*s->p == '\r' || is_bare_lf(s)) {
+          // HTTP/1.0 clients never wait for 100 (Continue)
+          if (s->hvstate == SEXPECT_CONTINUE && is_request(s)
+              && (s->majorVersion > 1 || s->minorVersion > 0)) {
+            s->expectContinue = 1;
+          }
+
+          TRACE_CALL(s, EHTTP_ON_HEADER_VALUE(s, s->mark, s->p - s->mark));
+          s->state = (*s->p == '\r') ? S_HEADER_EOL : S_HEADER_CRLF;
+          if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_HEADER_VALUE_DONE(s)) ) != EHTTP_PARSER_CONTINUE) {
+            goto early_return;
+          }
+          continue;
+        }
+
+        break;
+
+      case S_HEADER_VALUE_CONTENT_LENGTH:
+        if (*s->p >= '0' && *s->p <= '9') {
+          // whole words first, bytes near the end of the buffer
+          if ((tmp = swar_decimal(&s->contentLength, s->p, s->end)) == SWAR_OVERFLOW) {
+            s->error = EHTTP_ERR_INVALID_CONTENT_LENGTH;
+            break;
+          }
+          else if (tmp) {
+            s->p += tmp - 1;
+            continue;
+          }
+
+          if (s->contentLength > (SIZE_MAX - (*s->p - '0')) / 10) {
+            s->error = EHTTP_ERR_INVALID_CONTENT_LENGTH;
+            break;
+          }
+          s->contentLength *= 10;
+          s->contentLength += (*s->p - '0');
+          continue;
+        }
+        else if (*s->p == ' ' || *s->p == '\t') {
+          TRACE_CALL(s, EHTTP_ON_HEADER_VALUE(s, s->mark, s->p - s->mark));
+          s->state = S_HEADER_VALUE_END_TRIM;
+          if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_HEADER_VALUE_DONE(s)) ) != EHTTP_PARSER_CONTINUE) {
+            goto early_return;
+          }
+          continue;
+        }
+        else if (*s->p == '\r' || is_bare_lf(s)) {
+          TRACE_CALL(s, EHTTP_ON_HEADER_VALUE(s, s->mark, s->p - s->mark));
+          s->state = (*s->p == '\r') ? S_HEADER_EOL : S_HEADER_CRLF;
+          if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_HEADER_VALUE_DONE(s)) ) != EHTTP_PARSER_CONTINUE) {
+            goto early_return;
+          }
+          continue;
+        }
+
+        break;
+
+      case S_HEADER_VALUE_END_TRIM:
+        if (*s->p == ' ' || *s->p == '\t') {
+          continue;
+        }
+        else if (*s->p == '\r') {
+          s->state = S_HEADER_EOL;
+          continue;
+        }
+        else if (is_bare_lf(s)) {
+          s->state = S_HEADER_CRLF;
+          continue;
+        }
+
+        break;
+
+      case S_HEADER_EOL:
+        if (*s->p == '\n') {
+          s->state = S_HEADER_CRLF;
+          continue;
+        }
+
+        break;
+
+      case S_HEADER_CRLF:
+        if (*s->p == '\r') {
+          s->state = S_HEADER_EOH;
+          continue;
+        }
+        else if (is_bare_lf(s)) {
+          s->state = S_HEADER_EOH;
+          goto check_again;
+        }
+        else if (is_token(*s->p)) {
+          s->state = S_HEADER_NAME;
+          goto check_again;
+        }
+        else if (*s->p == ' ' || *s->p == '\t') {
+          // a folded line is another value of the same header
+          if ((s->flags & (EHTTP_FLAG_STRICT | EHTTP_FLAG_LENIENT)) == EHTTP_FLAG_LENIENT) {
+            s->state = S_HEADER_VALUE;
+            continue;
+          }
+
+          s->error = EHTTP_ERR_OBS_FOLD;
+        }
+
+        break;
+
+      case S_HEADER_EOH:
+        if (*s->p == '\n') {
+          s->state = S_HEADERS_DONE;
+          TRACE(s, EHTTP_PHASE_EOH);
+
+          // prepare state for headers done
+
+          if (!is_request(s) && response_without_content(s)) {
+            s->hasContent = 0;
+          }
+          // a response whose last coding is not chunked ends with the
+          // connection, and its Content-Length is ignored (RFC 9112 6.3)
+          else if (!is_request(s) && s->haveTransferEncoding && !s->isChunked) {
+            s->contentLength = 0;
+            s->hasContent = 1;
+            s->shouldClose = 1;
+            s->state = S_BODY_UNTIL_CLOSE;
+          }
+          // a request body must end with the chunked coding
+          else if (is_request(s) && s->haveTransferEncoding && !s->isChunked) {
+            s->error = EHTTP_ERR_CHUNKED_NOT_LAST;
+            break;
+          }
+          else {
+            if (s->contentLength && !s->isChunked) {
+              s->hasContent = 1;
+            }
+
+            else if (s->isChunked && !s->contentLength) {
+              s->hasContent = 1;
+            }
+
+            if (!s->hasContent && (s->contentLength || s->isChunked) ) {
+              // ambigous transfer encoding
+              s->error = EHTTP_ERR_TRANSFER_ENCODING_CONTENT_LENGTH;
+              break;
+            }
+
+            if (s->contentLength) {
+              s->state = S_BODY_CONTENT_LENGHT;
+            }
+            else if (s->isChunked) {
+              s->state = S_BODY_CHUNKED;
+            }
+            // no length: the response ends with the connection
+            else if (!is_request(s) && !s->haveContentLength) {
+              s->hasContent = 1;
+              s->shouldClose = 1;
+              s->state = S_BODY_UNTIL_CLOSE;
+            }
+          }
+
+          if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_HEADERS_DONE(s)) ) == EHTTP_PARSER_SKIP) {
+            s->skipBody = 1;
+          }
+          else if (ctrl != EHTTP_PARSER_CONTINUE) {
+            // a message without a body is complete even when the caller
+            // stops here
+            if (ctrl == EHTTP_PARSER_RETURN && s->state == S_HEADERS_DONE) {
+              s->state = S_STATE_END;
+              if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_PARSER_DONE(s)) ) == EHTTP_PARSER_CONTINUE) {
+                ctrl = EHTTP_PARSER_RETURN;
+              }
+            }
+            goto early_return;
+          }
+
+          if (s->state != S_HEADERS_DONE) {
+            TRACE(s, EHTTP_PHASE_BODY);
+            continue;
+          }
+
+          s->state = S_STATE_END;
+          if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_PARSER_DONE(s)) ) != EHTTP_PARSER_CONTINUE) {
+            goto early_return;
+          }
+          continue;
+        }
+
+        break;
+
+      case S_BODY_CONTENT_LENGHT:
+        s->mark = s->p;
+        tmp = size - (s->mark - (const uint8_t *) in);
+
+        if (s->contentLength > tmp) {
+          if (!s->skipBody) {
+            TRACE_CALL(s, EHTTP_ON_CONTENT(s, s->mark, tmp));
+          }
+          s->contentLength -= tmp;
+          s->p += tmp - 1;
+          continue;
+        }
+
+        if (!s->skipBody) {
+          TRACE_CALL(s, EHTTP_ON_CONTENT(s, s->mark, s->contentLength));
+        }
+        s->p += s->contentLength - 1;
+        s->contentLength = 0;
+        s->state = S_STATE_END;
+        if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_PARSER_DONE(s)) ) != EHTTP_PARSER_CONTINUE) {
+          goto early_return;
+        }
+        continue;
+
+      case S_BODY_CHUNKED:
+        if (*s->p >= '0' && *s->p <= '9') {
+          s->contentLength = *s->p - '0';
+          s->state = S_BODY_CHUNKLEN;
+          continue;
+        }
+        else if (*s->p >= 'a' && *s->p <= 'f') {
+          s->contentLength = (*s->p - 'a') + 10;
+          s->state = S_BODY_CHUNKLEN;
+          continue;
+        }
+        else if (*s->p >= 'A' && *s->p <= 'F') {
+          s->contentLength = (*s->p - 'A') + 10;
+          s->state = S_BODY_CHUNKLEN;
+          continue;
+        }
+
+        break;
+
+      case S_BODY_CHUNKLEN:
+        if (is_hexchar(*s->p)) {
+          if ((tmp = swar_hex(&s->contentLength, s->p, s->end)) == SWAR_OVERFLOW) {
+            s->error = EHTTP_ERR_INVALID_CHUNK_SIZE;
+            break;
+          }
+          else if (tmp) {
+            s->p += tmp - 1;
+            continue;
+          }
+        }
+
+        // four more bits would overflow
+        if ((s->contentLength >> (sizeof(size_t) * 8 - 4)) && is_hexchar(*s->p)) {
+          s->error = EHTTP_ERR_INVALID_CHUNK_SIZE;
+          break;
+        }
+
+        if (*s->p >= '0' && *s->p <= '9') {
+          s->contentLength = s->contentLength << 4;
+          s->contentLength += *s->p - '0';
+          continue;
+        }
+        else if (*s->p >= 'a' && *s->p <= 'f') {
+          s->contentLength = s->contentLength << 4;
+          s->contentLength += (*s->p - 'a') + 10;
+          continue;
+        }
+        else if (*s->p >= 'A' && *s->p <= 'F') {
+          s->contentLength = s->contentLength << 4;
+          s->contentLength += (*s->p - 'A') + 10;
+          continue;
+        }
+
+        else if (*s->p == '\r') {
+          if (s->contentLength == 0) {
+            s->state = S_BODY_CHUNKED_EOS;
+            continue;
+          }
+
+          s->state = S_BODY_CHUNKLEN_CRLF;
+          continue;
+        }
+        else if (is_bare_lf(s)) {
+          s->state = s->contentLength ? S_BODY_CHUNKLEN_CRLF : S_BODY_CHUNKED_EOS;
+          goto check_again;
+        }
+        else if (*s->p == ';' || *s->p == ' ' || *s->p == '\t') {
+          s->state = S_BODY_CHUNKEXT;
+          continue;
+        }
+
+        break;
+
+      // chunk extensions are ignored
+      case S_BODY_CHUNKEXT:
+        if (is_vchar(*s->p)) {
+          continue;
+        }
+        else if (*s->p == '\r') {
+          s->state = s->contentLength ? S_BODY_CHUNKLEN_CRLF : S_BODY_CHUNKED_EOS;
+          continue;
+        }
+        else if (is_bare_lf(s)) {
+          s->state = s->contentLength ? S_BODY_CHUNKLEN_CRLF : S_BODY_CHUNKED_EOS;
+          goto check_again;
+        }
+
+        break;
+
+      case S_BODY_CHUNKLEN_CRLF:
+        if (*s->p == '\n') {
+          s->state = S_BODY_CHUNK;
+          continue;
+        }
+
+        break;
+
+      case S_BODY_CHUNK:
+        s->mark = s->p;
+        tmp = size - (s->mark - (const uint8_t *) in);
+
+        if (s->contentLength > tmp) {
+          s->p += tmp - 1;
+          if (!s->skipBody) {
+            TRACE_CALL(s, EHTTP_ON_CONTENT(s, s->mark, tmp));
+          }
+          s->contentLength -= tmp;
+          continue;
+        }
+
+        if (!s->skipBody) {
+          TRACE_CALL(s, EHTTP_ON_CONTENT(s, s->mark, s->contentLength));
+        }
+        s->p += s->contentLength - 1;
+        s->contentLength = 0;
+        s->state = S_BODY_CHUNK_CR;
+        continue;
+
+      // require \r after chunk
+      case S_BODY_CHUNK_CR:
+        if (*s->p == '\r') {
+          s->state = S_BODY_CHUNK_CRLF;
+          continue;
+        }
+        else if (is_bare_lf(s)) {
+          s->state = S_BODY_CHUNK_CRLF;
+          goto check_again;
+        }
+
+        break;
+
+      case S_BODY_CHUNK_CRLF:
+        if (*s->p == '\n') {
+          s->state = S_BODY_CHUNKED;
+          continue;
+        }
+
+        break;
+
+      case S_BODY_CHUNKED_EOS:
+        if (*s->p == '\n') {
+          s->state = S_BODY_TRAILER;
+          continue;
+        }
+
+        break;
+
+      // trailer fields are skipped up to the empty line ending the message
+      case S_BODY_TRAILER:
+        if (*s->p == '\r') {
+          s->state = S_BODY_TRAILER_EOH;
+          continue;
+        }
+        else if (is_bare_lf(s)) {
+          s->state = S_BODY_TRAILER_EOH;
+          goto check_again;
+        }
+        else if (is_token(*s->p)) {
+          s->state = S_BODY_TRAILER_FIELD;
+          continue;
+        }
+
+        break;
+
+      case S_BODY_TRAILER_FIELD:
+        if (is_vchar(*s->p) || *s->p == ':') {
+          continue;
+        }
+        else if (*s->p == '\r') {
+          s->state = S_BODY_TRAILER_LF;
+          continue;
+        }
+        else if (is_bare_lf(s)) {
+          s->state = S_BODY_TRAILER_LF;
+          goto check_again;
+        }
+
+        break;
+
+      case S_BODY_TRAILER_LF:
+        if (*s->p == '\n') {
+          s->state = S_BODY_TRAILER;
+          continue;
+        }
+
+        break;
+
+      case S_BODY_TRAILER_EOH:
+        if (*s->p == '\n') {
+          s->state = S_STATE_END;
+          if ( (ctrl = TRACE_CTRL(s, EHTTP_ON_PARSER_DONE(s)) ) != EHTTP_PARSER_CONTINUE) {
+            goto early_return;
+          }
+          continue;
+        }
+
+        break;
+
+      case S_BODY_UNTIL_CLOSE:
+        s->mark = s->p;
+        tmp = size - (s->mark - (const uint8_t *) in);
+
+        if (!s->skipBody) {
+          TRACE_CALL(s, EHTTP_ON_CONTENT(s, s->mark, tmp));
+        }
+        s->p += tmp - 1;
+        continue;
+
+      case S_STATE_END:
+        TRACE_EXIT(s);
+        return size - (s->p - (uint8_t *) in);
+    }
+
+    // '\n' is only valid after '\r'
+    if (s->error == EHTTP_ERR_NONE) {
+      s->error = (*s->p == '\n') ? EHTTP_ERR_BARE_LF : EHTTP_ERR_SYNTAX;
+    }
+
+    TRACE_CALL(s, EHTTP_ON_ERROR(s));
+    TRACE(s, EHTTP_TRACE_EXIT);
+    TRACE(s, EHTTP_TRACE_DONE);
+    return -1;
+  }
+
+  if (s->state == S_METHOD_CHAR)
+    TRACE_CALL(s, EHTTP_ON_METHOD(s, s->mark, s->p - s->mark));
+  else if (s->state > S_REQUEST_URI && s->state < S_REQUEST_REQUIRE_VERSION)
+    TRACE_CALL(s, EHTTP_ON_REQUEST_URI(s, s->mark, s->p - s->mark));
+  // S_HEADER_NAME and S_HEADER_VALUE have not started a span yet
+  else if (s->state > S_HEADER_NAME && s->state < S_HEADER_VALUE)
+    TRACE_CALL(s, EHTTP_ON_HEADER_NAME(s, s->mark, s->p - s->mark));
+  else if (s->state > S_HEADER_VALUE && s->state < S_HEADER_VALUE_END_TRIM)
+    TRACE_CALL(s, EHTTP_ON_HEADER_VALUE(s, s->mark, s->p - s->mark));
+
+  TRACE_EXIT(s);
+  return 0;
+
+early_return:
+  TRACE_EXIT(s);
+
+  // the current byte has been consumed
+  if (ctrl == EHTTP_PARSER_RETURN)
+    return size - (s->p + 1 - (uint8_t *) in);
+
+  return 1;
+}
+
+#ifdef EHTTP_PARSE_END_NAME
+EHTTP_PARSE_STORAGE int EHTTP_PARSE_END_NAME(ehttp_parser * const restrict s
+                  EHTTP_PARSE_PARAMS)
+{
+  ehttp_ctrl ctrl;
+
+  switch (s->state) {
+    case S_BODY_UNTIL_CLOSE:
+      s->state = S_STATE_END;
+      ctrl = TRACE_CTRL(s, EHTTP_ON_PARSER_DONE(s));
+      (void) ctrl;
+      TRACE(s, EHTTP_TRACE_DONE);
+      return 0;
+
+    case S_NOSTATE:
+    case S_REQUEST_REQUIRED:
+    case S_RESPONSE_REQUIRED:
+    case S_STATE_END:
+      return 0;
+  }
+
+  s->error = EHTTP_ERR_TRUNCATED;
+  TRACE_CALL(s, EHTTP_ON_ERROR(s));
+  TRACE(s, EHTTP_TRACE_DONE);
+  return -1;
+}
+#endif
+
+#undef EHTTP_PARSE_NAME
+#undef EHTTP_PARSE_END_NAME
+#undef EHTTP_PARSE_STORAGE
+#undef EHTTP_PARSE_PARAMS
+#undef EHTTP_PARSE_CHECKS
+#undef EHTTP_ON_METHOD
+#undef EHTTP_ON_METHOD_DONE
+#undef EHTTP_ON_REQUEST_URI
+#undef EHTTP_ON_REQUEST_URI_DONE
+#undef EHTTP_ON_STATUS_LINE_DONE
+#undef EHTTP_ON_HEADER_NAME
+#undef EHTTP_ON_HEADER_NAME_DONE
+#undef EHTTP_ON_HEADER_VALUE
+#undef EHTTP_ON_HEADER_VALUE_DONE
+#undef EHTTP_ON_HEADERS_DONE
+#undef EHTTP_ON_CONTENT
+#undef EHTTP_ON_PARSER_DONE
+#undef EHTTP_ON_ERROR
+#undef TRACE
+#undef TRACE_CALL
+#undef TRACE_CTRL
+#undef TRACE_EXIT
@@ -0,0 +1,285 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifdef EHTTP_POOL_BENCH
+// clock_gettime() and rand_r() for the benchmark at the end
+#define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "ehttp_pool.h"
+
+typedef union _ehttp_slot ehttp_slot;
+union _ehttp_slot {
+  _Alignas(64) ehttp_parser parser;
+  ehttp_slot *next;
+};
+
+struct _ehttp_slab {
+  ehttp_slab *prev;
+  ehttp_slab *next;
+  // released slots
+  ehttp_slot *free;
+  // slots never handed out start at slots[fresh]
+  uint32_t fresh;
+  uint32_t used;
+  ehttp_slot slots[];
+};
+
+#define SLAB_SLOTS \
+  ((EHTTP_POOL_SLAB_SIZE - sizeof(ehttp_slab)) / sizeof(ehttp_slot))
+
+_Static_assert((EHTTP_POOL_SLAB_SIZE & (EHTTP_POOL_SLAB_SIZE - 1)) == 0,
+               "EHTTP_POOL_SLAB_SIZE must be a power of two");
+_Static_assert(SLAB_SLOTS > 0, "EHTTP_POOL_SLAB_SIZE too small");
+
+static void slab_link(ehttp_slab **list, ehttp_slab *slab) {
+  slab->prev = NULL;
+  slab->next = *list;
+  if (*list) {
+    (*list)->prev = slab;
+  }
+  *list = slab;
+}
+
+static void slab_unlink(ehttp_slab **list, ehttp_slab *slab) {
+  if (slab->prev) {
+    slab->prev->next = slab->next;
+  }
+  else {
+    *list = slab->next;
+  }
+
+  if (slab->next) {
+    slab->next->prev = slab->prev;
+  }
+}
+
+static ehttp_slab *slab_of(ehttp_parser *parser) {
+  return (ehttp_slab *)
+    ((uintptr_t) parser & ~(uintptr_t) (EHTTP_POOL_SLAB_SIZE - 1));
+}
+
+/**
+ * Prepares an empty pool keeping at most maxEmptySlabs unused slabs around
+ * before returning them to the system.
+ */
+ehttp_pool *ehttp_pool_init(ehttp_pool * const out, size_t maxEmptySlabs) {
+  *out = (ehttp_pool) {
+    .maxEmptySlabs = maxEmptySlabs,
+  };
+
+  return out;
+}
+
+/**
+ * Returns the pool of the calling thread.
+ */
+ehttp_pool *ehttp_pool_local(void) {
+  static _Thread_local ehttp_pool local = { .maxEmptySlabs = 1 };
+  return &local;
+}
+
+/**
+ * Takes a parser from the pool and initialises it, NULL when out of memory.
+ */
+ehttp_parser *ehttp_pool_acquire(ehttp_pool * const restrict pool,
+                                 ehttp_mode mode, void * const restrict ctx) {
+  ehttp_slab *slab = pool->partial;
+  ehttp_slot *slot;
+
+  if (!slab) {
+    slab = aligned_alloc(EHTTP_POOL_SLAB_SIZE, EHTTP_POOL_SLAB_SIZE);
+    if (!slab) {
+      return NULL;
+    }
+
+    *slab = (ehttp_slab) { 0 };
+    slab_link(&pool->partial, slab);
+    pool->slabs++;
+    pool->emptySlabs++;
+  }
+
+  if (slab->free) {
+    slot = slab->free;
+    slab->free = slot->next;
+  }
+  else {
+    slot = &slab->slots[slab->fresh++];
+  }
+
+  if (slab->used++ == 0) {
+    pool->emptySlabs--;
+  }
+
+  if (!slab->free && slab->fresh == SLAB_SLOTS) {
+    slab_unlink(&pool->partial, slab);
+    slab_link(&pool->full, slab);
+  }
+
+  pool->active++;
+  ehttp_init(&slot->parser, mode, ctx);
+  return &slot->parser;
+}
+
+/**
+ * Gives a parser back to its pool.
+ */
+void ehttp_pool_release(ehttp_pool * const restrict pool,
+                        ehttp_parser * const restrict parser) {
+  ehttp_slab *slab = slab_of(parser);
+  ehttp_slot *slot = (ehttp_slot *) parser;
+
+  if (!slab->free && slab->fresh == SLAB_SLOTS) {
+    slab_unlink(&pool->full, slab);
+    slab_link(&pool->partial, slab);
+  }
+
+  slot->next = slab->free;
+  slab->free = slot;
+  pool->active--;
+
+  if (--slab->used == 0) {
+    if (pool->emptySlabs >= pool->maxEmptySlabs) {
+      slab_unlink(&pool->partial, slab);
+      pool->slabs--;
+      free(slab);
+      return;
+    }
+
+    pool->emptySlabs++;
+  }
+}
+
+/**
+ * Frees every slab of the pool, parsers still in use become invalid.
+ */
+void ehttp_pool_destroy(ehttp_pool * const pool) {
+  ehttp_slab *slab, *next;
+
+  for (slab = pool->partial; slab; slab = next) {
+    next = slab->next;
+    free(slab);
+  }
+
+  for (slab = pool->full; slab; slab = next) {
+    next = slab->next;
+    free(slab);
+  }
+
+  ehttp_pool_init(pool, pool->maxEmptySlabs);
+}
+
+/**
+ * Reports the pool memory footprint.
+ */
+ehttp_pool_stats *ehttp_pool_report(const ehttp_pool * const restrict pool,
+                                    ehttp_pool_stats * const restrict out) {
+  *out = (ehttp_pool_stats) {
+    .slabs = pool->slabs,
+    .capacity = pool->slabs * SLAB_SLOTS,
+    .active = pool->active,
+    .reservedBytes = pool->slabs * EHTTP_POOL_SLAB_SIZE,
+    .slotBytes = sizeof(ehttp_slot),
+    .bytesPerIdle = sizeof(ehttp_slot),
+  };
+
+  if (out->active) {
+    out->bytesPerActive = out->reservedBytes / out->active;
+  }
+
+  return out;
+}
+
+#ifdef EHTTP_POOL_BENCH
+#include <stdio.h>
+#include <time.h>
+
+/*
+ * Keep-alive connections that wake up at random: a share of them holds a
+ * parser at any time, the others gave theirs back. Reports the footprint
+ * against one parser per connection and the cost of acquire and release.
+ * Usage: [connections] [active percent] [wakeups]
+ */
+
+static double bench_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  size_t conns = argc > 1 ? (size_t) atol(argv[1]) : 500000;
+  size_t percent = argc > 2 ? (size_t) atol(argv[2]) : 1;
+  size_t wakeups = argc > 3 ? (size_t) atol(argv[3]) : 10000000;
+  size_t active = conns * percent / 100;
+  // the parsers of the active connections
+  ehttp_parser **held = calloc(active ? active : 1, sizeof(*held));
+  ehttp_pool *pool = ehttp_pool_local();
+  ehttp_pool_stats stats;
+  unsigned seed = 1;
+  double elapsed;
+  size_t i;
+
+  if (!held || !active || active > conns) {
+    fprintf(stderr, "usage: %s [connections] [active percent] [wakeups]\n",
+            argv[0]);
+    return 2;
+  }
+
+  for (i = 0; i < active; i++) {
+    held[i] = ehttp_pool_acquire(pool, EHTTP_MODE_REQUEST, NULL);
+  }
+
+  // an idle connection wakes up, an active one goes idle
+  elapsed = bench_now();
+  for (i = 0; i < wakeups; i++) {
+    size_t sleep = rand_r(&seed) % active;
+    ehttp_parser *p = ehttp_pool_acquire(pool, EHTTP_MODE_REQUEST, NULL);
+
+    if (p) {
+      ehttp_pool_release(pool, held[sleep]);
+      held[sleep] = p;
+    }
+  }
+  elapsed = bench_now() - elapsed;
+
+  ehttp_pool_report(pool, &stats);
+  printf("%zu connections, %zu active: %zu slabs, %zu bytes reserved, "
+         "%zu per active connection\n", conns, stats.active, stats.slabs,
+         stats.reservedBytes, stats.bytesPerActive);
+  printf("idle connection: %zu bytes while it holds a parser, none once "
+         "released, %zu bytes saved in all\n", stats.bytesPerIdle,
+         (conns - stats.active) * stats.bytesPerIdle);
+  printf("%.1f ns per acquire and release\n", elapsed * 1e9 / wakeups);
+
+  ehttp_pool_destroy(pool);
+  free(held);
+  return 0;
+}
+#endif
@@ -0,0 +1,112 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_POOL_VESTOL
+#define EHTTP_POOL_VESTOL
+
+#include "ehttp.h"
+
+/*
+ * Slab pool of parsers.
+ *
+ * Parsers are carved out of aligned slabs of EHTTP_POOL_SLAB_SIZE bytes, one
+ * cache line per parser, and recycled through a per-slab free list. A
+ * connection that is idle between requests (see ehttp_is_idle()) should give
+ * its parser back, so an idle keep-alive connection costs no parser memory at
+ * all.
+ *
+ * A pool is not thread safe: use one per thread, ehttp_pool_local() returns
+ * the calling thread's pool. Parsers must be released to the pool they came
+ * from.
+ *
+ * Build ehttp_pool.c with -DEHTTP_POOL_BENCH for a footprint benchmark.
+ */
+
+#ifndef EHTTP_POOL_SLAB_SIZE
+#define EHTTP_POOL_SLAB_SIZE (64 * 1024)
+#endif
+
+typedef struct _ehttp_slab ehttp_slab;
+
+typedef struct _ehttp_pool ehttp_pool;
+struct _ehttp_pool {
+  ehttp_slab *partial;
+  ehttp_slab *full;
+  size_t slabs;
+  size_t emptySlabs;
+  size_t maxEmptySlabs;
+  size_t active;
+};
+
+typedef struct _ehttp_pool_stats ehttp_pool_stats;
+struct _ehttp_pool_stats {
+  size_t slabs;
+  size_t capacity;
+  size_t active;
+  size_t reservedBytes;
+  // size of a parser slot
+  size_t slotBytes;
+  // reserved bytes divided by active parsers
+  size_t bytesPerActive;
+  // held by an idle connection that keeps its parser, none once released
+  size_t bytesPerIdle;
+};
+
+/**
+ * Prepares an empty pool keeping at most maxEmptySlabs unused slabs around
+ * before returning them to the system.
+ */
+ehttp_pool *ehttp_pool_init(ehttp_pool * const, size_t maxEmptySlabs);
+
+/**
+ * Returns the pool of the calling thread.
+ */
+ehttp_pool *ehttp_pool_local(void);
+
+/**
+ * Takes a parser from the pool and initialises it, NULL when out of memory.
+ */
+ehttp_parser *ehttp_pool_acquire(ehttp_pool * const restrict,
+                                 ehttp_mode, void * const restrict);
+
+/**
+ * Gives a parser back to its pool.
+ */
+void ehttp_pool_release(ehttp_pool * const restrict,
+                        ehttp_parser * const restrict);
+
+/**
+ * Frees every slab of the pool, parsers still in use become invalid.
+ */
+void ehttp_pool_destroy(ehttp_pool * const);
+
+/**
+ * Reports the pool memory footprint.
+ */
+ehttp_pool_stats *ehttp_pool_report(const ehttp_pool * const restrict,
+                                    ehttp_pool_stats * const restrict);
+
+#endif
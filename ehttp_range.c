@@ -0,0 +1,430 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "ehttp_range.h"
+
+#define EHTTP_RANGE_IOV 64
+
+static const uint8_t *skip_ows(const uint8_t *p, const uint8_t *end) {
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    p++;
+  }
+  return p;
+}
+
+// 1*DIGIT, false on overflow or no digit
+static bool parse_u64(const uint8_t **pp, const uint8_t *end, uint64_t *out) {
+  const uint8_t *p = *pp;
+  uint64_t v = 0;
+
+  if (p == end || *p < '0' || *p > '9') {
+    return false;
+  }
+
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    if (v > (UINT64_MAX - (*p - '0')) / 10) {
+      return false;
+    }
+    v = v * 10 + (*p - '0');
+  }
+
+  *pp = p;
+  *out = v;
+  return true;
+}
+
+/**
+ * Parses a Range value against a representation of size bytes. Returns the
+ * number of ranges stored in out, sorted with overlapping and adjacent ranges
+ * merged, or an ehttp_range_status. More than max ranges in the header give
+ * EHTTP_RANGE_TOO_MANY.
+ */
+int ehttp_range_parse(const uint8_t * const restrict in, size_t len,
+                      uint64_t size, ehttp_range * const restrict out,
+                      size_t max) {
+  const uint8_t *p = in, *end = in + len;
+  size_t specs = 0, n = 0, i, j;
+  uint64_t first, last;
+
+  p = skip_ows(p, end);
+  if (end - p < 5 || strncasecmp((const char *) p, "bytes", 5) != 0) {
+    return EHTTP_RANGE_IGNORE;
+  }
+
+  p = skip_ows(p + 5, end);
+  if (p == end || *p++ != '=') {
+    return EHTTP_RANGE_IGNORE;
+  }
+
+  for (;;) {
+    p = skip_ows(p, end);
+
+    // empty list elements
+    if (p < end && *p == ',') {
+      p++;
+      continue;
+    }
+    if (p == end) {
+      break;
+    }
+
+    if (*p == '-') {
+      // suffix-range: the last n bytes
+      p++;
+      if (!parse_u64(&p, end, &last)) {
+        return EHTTP_RANGE_IGNORE;
+      }
+
+      if (last == 0 || size == 0) {
+        first = 1, last = 0;
+      }
+      else {
+        first = last < size ? size - last : 0;
+        last = size - 1;
+      }
+    }
+    else {
+      if (!parse_u64(&p, end, &first) || p == end || *p++ != '-') {
+        return EHTTP_RANGE_IGNORE;
+      }
+
+      if (p < end && *p >= '0' && *p <= '9') {
+        if (!parse_u64(&p, end, &last) || last < first) {
+          return EHTTP_RANGE_IGNORE;
+        }
+      }
+      else {
+        last = UINT64_MAX;
+      }
+
+      if (last >= size) {
+        last = size - 1;
+      }
+    }
+
+    p = skip_ows(p, end);
+    if (p < end && *p != ',') {
+      return EHTTP_RANGE_IGNORE;
+    }
+
+    if (++specs > max) {
+      return EHTTP_RANGE_TOO_MANY;
+    }
+
+    // unsatisfiable spec
+    if (size == 0 || first >= size || first > last) {
+      continue;
+    }
+
+    // insertion sort: the list is bounded by max
+    for (i = n; i > 0 && out[i - 1].first > first; i--) {
+      out[i] = out[i - 1];
+    }
+    out[i] = (ehttp_range) { .first = first, .last = last };
+    n++;
+  }
+
+  if (!specs) {
+    return EHTTP_RANGE_IGNORE;
+  }
+
+  if (!n) {
+    return EHTTP_RANGE_UNSATISFIABLE;
+  }
+
+  // merge overlapping and adjacent ranges
+  for (i = 0, j = 1; j < n; j++) {
+    if (out[j].first <= out[i].last + 1) {
+      if (out[j].last > out[i].last) {
+        out[i].last = out[j].last;
+      }
+    }
+    else {
+      out[++i] = out[j];
+    }
+  }
+
+  return (int) (i + 1);
+}
+
+/**
+ * True when an If-Range value (entity-tag or HTTP-date) matches the current
+ * strong etag or Last-Modified date, either of which may be NULL.
+ */
+bool ehttp_if_range(const uint8_t * const restrict in, size_t len,
+                    const char * const restrict etag,
+                    const char * const restrict lastModified) {
+  const uint8_t *p = skip_ows(in, in + len), *end = in + len;
+  const char *validator;
+
+  while (end > p && (end[-1] == ' ' || end[-1] == '\t')) {
+    end--;
+  }
+
+  if (p == end) {
+    return false;
+  }
+
+  // weak tags never match: If-Range uses the strong comparison
+  if (*p == 'W' && end - p > 1 && p[1] == '/') {
+    return false;
+  }
+
+  validator = (*p == '"') ? etag : lastModified;
+  if (!validator || (*p == '"' && validator[0] != '"')) {
+    return false;
+  }
+
+  return strlen(validator) == (size_t) (end - p)
+    && memcmp(validator, p, end - p) == 0;
+}
+
+/**
+ * Prepares a writer using max segments and a scratch buffer for framing.
+ */
+ehttp_range_writer *ehttp_range_writer_init(ehttp_range_writer * const restrict w,
+                                            ehttp_segment * const restrict segments,
+                                            size_t max,
+                                            char * const restrict scratch,
+                                            size_t scratchSize) {
+  *w = (ehttp_range_writer) {
+    .segments = segments,
+    .max = max,
+    .scratch = scratch,
+    .scratchSize = scratchSize,
+  };
+
+  return w;
+}
+
+static ehttp_segment *push(ehttp_range_writer * const w,
+                           const uint8_t *data, uint64_t offset, uint64_t len) {
+  if (w->count == w->max) {
+    return NULL;
+  }
+
+  w->segments[w->count] = (ehttp_segment) {
+    .data = data,
+    .offset = offset,
+    .len = len,
+  };
+
+  return &w->segments[w->count++];
+}
+
+// formats into scratch and appends it as a memory segment
+static ehttp_segment *emit(ehttp_range_writer * const w, const char *fmt, ...) {
+  size_t room = w->scratchSize - w->scratchUsed;
+  char *at = w->scratch + w->scratchUsed;
+  va_list ap;
+  int len;
+
+  va_start(ap, fmt);
+  len = vsnprintf(at, room, fmt, ap);
+  va_end(ap);
+
+  if (len < 0 || (size_t) len >= room) {
+    return NULL;
+  }
+
+  w->scratchUsed += len;
+  return push(w, (const uint8_t *) at, 0, len);
+}
+
+/**
+ * Lays out a 206 response for n ranges of a size bytes file. headers holds
+ * extra CRLF terminated header lines and is referenced, not copied. With
+ * several ranges, the body is multipart/byteranges delimited by boundary.
+ * Returns -1 when segments or scratch space run out.
+ */
+int ehttp_range_response(ehttp_range_writer * const restrict w,
+                         const ehttp_range * const restrict ranges, size_t n,
+                         uint64_t size,
+                         const char * const restrict contentType,
+                         const char * const restrict boundary,
+                         const uint8_t * const restrict headers,
+                         size_t headersLen) {
+  ehttp_segment *status;
+  uint64_t body = 0;
+  size_t i;
+
+  w->count = w->scratchUsed = w->next = w->sent = 0;
+
+  // status line and headers are formatted once the body length is known
+  if (!push(w, NULL, 0, 0) || !push(w, headers, 0, headersLen)) {
+    return -1;
+  }
+
+  if (n == 1) {
+    body = ranges[0].last - ranges[0].first + 1;
+
+    if (!emit(w, "\r\n") || !push(w, NULL, ranges[0].first, body)) {
+      return -1;
+    }
+  }
+  else {
+    if (!emit(w, "\r\n")) {
+      return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+      ehttp_segment *part = emit(w, "%s--%s\r\n%s%s%s"
+                                 "Content-Range: bytes %" PRIu64 "-%" PRIu64
+                                 "/%" PRIu64 "\r\n\r\n",
+                                 i ? "\r\n" : "", boundary,
+                                 contentType ? "Content-Type: " : "",
+                                 contentType ? contentType : "",
+                                 contentType ? "\r\n" : "",
+                                 ranges[i].first, ranges[i].last, size);
+      if (!part) {
+        return -1;
+      }
+
+      body += part->len + ranges[i].last - ranges[i].first + 1;
+      if (!push(w, NULL, ranges[i].first, ranges[i].last - ranges[i].first + 1)) {
+        return -1;
+      }
+    }
+
+    body += strlen(boundary) + 8;
+    if (!emit(w, "\r\n--%s--\r\n", boundary)) {
+      return -1;
+    }
+  }
+
+  // formatted out of order: move it to the front
+  status = emit(w, "HTTP/1.1 206 Partial Content\r\n");
+  if (!status) {
+    return -1;
+  }
+  w->segments[0] = *status;
+  w->count--;
+
+  if (n == 1) {
+    status = emit(w, "Content-Range: bytes %" PRIu64 "-%" PRIu64 "/%" PRIu64
+                  "\r\n%s%s%sContent-Length: %" PRIu64 "\r\n",
+                  ranges[0].first, ranges[0].last, size,
+                  contentType ? "Content-Type: " : "",
+                  contentType ? contentType : "",
+                  contentType ? "\r\n" : "", body);
+  }
+  else {
+    status = emit(w, "Content-Type: multipart/byteranges; boundary=%s\r\n"
+                  "Content-Length: %" PRIu64 "\r\n", boundary, body);
+  }
+  if (!status) {
+    return -1;
+  }
+
+  // status line and range headers are contiguous in scratch
+  w->segments[0].len += status->len;
+  w->count--;
+
+  w->contentLength = body;
+  return 0;
+}
+
+/**
+ * Sends the response on a (non-blocking) socket with writev() and sendfile()
+ * from file. Returns 1 when everything was sent, 0 when the socket would
+ * block and -1 on error.
+ */
+int ehttp_range_send(ehttp_range_writer * const w, int sock, int file) {
+  struct iovec iov[EHTTP_RANGE_IOV];
+  ssize_t r;
+  size_t i, n;
+
+  while (w->next < w->count) {
+    ehttp_segment *seg = &w->segments[w->next];
+
+    if (seg->data) {
+      // gather consecutive memory segments
+      for (n = 0, i = w->next;
+           i < w->count && n < EHTTP_RANGE_IOV && w->segments[i].data; i++) {
+        if (w->segments[i].len) {
+          iov[n].iov_base = (void *) w->segments[i].data;
+          iov[n].iov_len = w->segments[i].len;
+          if (i == w->next) {
+            iov[n].iov_base = (uint8_t *) iov[n].iov_base + w->sent;
+            iov[n].iov_len -= w->sent;
+          }
+          n++;
+        }
+      }
+
+      r = n ? writev(sock, iov, n) : 0;
+    }
+    else if (seg->len) {
+      off_t off = seg->offset + w->sent;
+      uint64_t left = seg->len - w->sent;
+
+      r = sendfile(sock, file, &off, left > (1 << 30) ? (1 << 30) : left);
+      if (r == 0) {
+        // file shorter than announced
+        return -1;
+      }
+    }
+    else {
+      r = 0;
+    }
+
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+
+    // advance past what was written
+    for (; w->next < w->count; w->next++, w->sent = 0) {
+      uint64_t left = w->segments[w->next].len - w->sent;
+
+      if ((uint64_t) r < left) {
+        w->sent += r;
+        break;
+      }
+      r -= left;
+      if (!w->segments[w->next].data && left) {
+        // one file segment per sendfile()
+        w->next++, w->sent = 0;
+        break;
+      }
+    }
+  }
+
+  return 1;
+}
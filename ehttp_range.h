@@ -0,0 +1,122 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_RANGE_VESTOL
+#define EHTTP_RANGE_VESTOL
+
+#include "ehttp.h"
+
+/*
+ * Range / If-Range parsing and 206 responses.
+ *
+ * ehttp_range_parse() works on the value span delivered by on_header_value
+ * and fills a caller array: nothing is allocated. The writer describes a
+ * 206 response as a list of segments, either memory (status line, headers,
+ * multipart framing, formatted into a caller scratch buffer) or file ranges
+ * sent with sendfile(), so file data is never copied to user space.
+ */
+
+typedef enum {
+  EHTTP_RANGE_TOO_MANY = -2,
+  EHTTP_RANGE_UNSATISFIABLE = -1,
+  // no usable Range header: serve the whole representation
+  EHTTP_RANGE_IGNORE = 0,
+} ehttp_range_status;
+
+typedef struct _ehttp_range ehttp_range;
+struct _ehttp_range {
+  uint64_t first;
+  uint64_t last;
+};
+
+typedef struct _ehttp_segment ehttp_segment;
+struct _ehttp_segment {
+  // NULL for a file range starting at offset
+  const uint8_t *data;
+  uint64_t offset;
+  uint64_t len;
+};
+
+typedef struct _ehttp_range_writer ehttp_range_writer;
+struct _ehttp_range_writer {
+  ehttp_segment *segments;
+  size_t count;
+  size_t max;
+  char *scratch;
+  size_t scratchSize;
+  size_t scratchUsed;
+  uint64_t contentLength;
+  // send progress
+  size_t next;
+  uint64_t sent;
+};
+
+/**
+ * Parses a Range value against a representation of size bytes. Returns the
+ * number of ranges stored in out, sorted with overlapping and adjacent ranges
+ * merged, or an ehttp_range_status. More than max ranges in the header give
+ * EHTTP_RANGE_TOO_MANY.
+ */
+int ehttp_range_parse(const uint8_t * const restrict, size_t, uint64_t size,
+                      ehttp_range * const restrict out, size_t max);
+
+/**
+ * True when an If-Range value (entity-tag or HTTP-date) matches the current
+ * strong etag or Last-Modified date, either of which may be NULL.
+ */
+bool ehttp_if_range(const uint8_t * const restrict, size_t,
+                    const char * const restrict etag,
+                    const char * const restrict lastModified);
+
+/**
+ * Prepares a writer using max segments and a scratch buffer for framing.
+ */
+ehttp_range_writer *ehttp_range_writer_init(ehttp_range_writer * const restrict,
+                                            ehttp_segment * const restrict,
+                                            size_t max,
+                                            char * const restrict, size_t);
+
+/**
+ * Lays out a 206 response for n ranges of a size bytes file. headers holds
+ * extra CRLF terminated header lines and is referenced, not copied. With
+ * several ranges, the body is multipart/byteranges delimited by boundary.
+ * Returns -1 when segments or scratch space run out.
+ */
+int ehttp_range_response(ehttp_range_writer * const restrict,
+                         const ehttp_range * const restrict, size_t n,
+                         uint64_t size,
+                         const char * const restrict contentType,
+                         const char * const restrict boundary,
+                         const uint8_t * const restrict headers, size_t);
+
+/**
+ * Sends the response on a (non-blocking) socket with writev() and sendfile()
+ * from file. Returns 1 when everything was sent, 0 when the socket would
+ * block and -1 on error.
+ */
+int ehttp_range_send(ehttp_range_writer * const, int sock, int file);
+
+#endif
@@ -0,0 +1,558 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifdef EHTTP_ROUTER_BENCH
+// clock_gettime() and rand_r() for the benchmark at the end
+#define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+#include "ehttp_router.h"
+
+#define NO_HANDLERS UINT32_MAX
+
+typedef struct _ehttp_router_bnode bnode;
+struct _ehttp_router_bnode {
+  char *label;
+  size_t len;
+  bnode **children;
+  size_t count;
+  bnode *param;
+  bnode *wildcard;
+  void *handlers[EHTTP_METHOD_MAX];
+  bool terminal;
+};
+
+static bnode *bnode_new(const char *label, size_t len) {
+  bnode *n = calloc(1, sizeof(*n));
+
+  if (!n) {
+    return NULL;
+  }
+
+  n->label = malloc(len + 1);
+  if (!n->label) {
+    free(n);
+    return NULL;
+  }
+
+  memcpy(n->label, label, len);
+  n->label[len] = '\0';
+  n->len = len;
+  return n;
+}
+
+static void bnode_free(bnode *n) {
+  size_t i;
+
+  if (!n) {
+    return;
+  }
+
+  for (i = 0; i < n->count; i++) {
+    bnode_free(n->children[i]);
+  }
+
+  bnode_free(n->param);
+  bnode_free(n->wildcard);
+  free(n->children);
+  free(n->label);
+  free(n);
+}
+
+static bool bnode_append(bnode *n, bnode *child) {
+  bnode **children = realloc(n->children, (n->count + 1) * sizeof(*children));
+
+  if (!children) {
+    return false;
+  }
+
+  children[n->count++] = child;
+  n->children = children;
+  return true;
+}
+
+// returns the node ending exactly after the static text s
+static bnode *insert_static(bnode *n, const char *s, size_t len) {
+  bnode *child, *mid;
+  size_t i, l;
+
+  while (len) {
+    for (i = 0, child = NULL; i < n->count; i++) {
+      if (n->children[i]->label[0] == s[0]) {
+        child = n->children[i];
+        break;
+      }
+    }
+
+    if (!child) {
+      if (!(child = bnode_new(s, len)) || !bnode_append(n, child)) {
+        bnode_free(child);
+        return NULL;
+      }
+      return child;
+    }
+
+    for (l = 0; l < child->len && l < len && child->label[l] == s[l]; l++);
+
+    // split the edge at the common prefix
+    if (l < child->len) {
+      if (!(mid = bnode_new(child->label, l)) || !bnode_append(mid, child)) {
+        bnode_free(mid);
+        return NULL;
+      }
+
+      memmove(child->label, child->label + l, child->len - l + 1);
+      child->len -= l;
+      n->children[i] = mid;
+      child = mid;
+    }
+
+    n = child;
+    s += l;
+    len -= l;
+  }
+
+  return n;
+}
+
+// the capture child of a node, created on first use
+static bnode *insert_capture(bnode **slot, const char *name, size_t len) {
+  if (!*slot) {
+    return *slot = bnode_new(name, len);
+  }
+
+  if ((*slot)->len != len || memcmp((*slot)->label, name, len) != 0) {
+    return NULL;
+  }
+
+  return *slot;
+}
+
+/**
+ * Prepares an empty route builder.
+ */
+ehttp_router_builder *ehttp_router_builder_init(ehttp_router_builder * const out) {
+  *out = (ehttp_router_builder) {
+    .root = NULL,
+  };
+
+  return out;
+}
+
+/**
+ * Adds a route. EHTTP_METHOD_UNKNOWN registers the handler for every method
+ * without a handler of its own. Returns -1 on a conflicting or invalid
+ * pattern, or when out of memory.
+ */
+int ehttp_router_add(ehttp_router_builder * const restrict b,
+                     ehttp_method method, const char * const restrict pattern,
+                     void * const restrict handler) {
+  const char *p = pattern, *q;
+  size_t params = 0;
+  bnode *n;
+
+  if (!handler || pattern[0] != '/' || method >= EHTTP_METHOD_MAX) {
+    return -1;
+  }
+
+  if (!b->root && !(b->root = bnode_new("", 0))) {
+    return -1;
+  }
+
+  n = b->root;
+
+  while (*p && n) {
+    // captures start a segment
+    if ((*p == ':' || *p == '*') && p[-1] == '/') {
+      for (q = p + 1; *q && *q != '/'; q++);
+
+      if (q == p + 1 || ++params > EHTTP_ROUTER_MAX_PARAMS) {
+        return -1;
+      }
+
+      if (*p == '*') {
+        // rest of the path
+        if (*q) {
+          return -1;
+        }
+        n = insert_capture(&n->wildcard, p + 1, q - p - 1);
+      }
+      else {
+        n = insert_capture(&n->param, p + 1, q - p - 1);
+      }
+
+      p = q;
+      continue;
+    }
+
+    for (q = p; *q && !((*q == ':' || *q == '*') && q[-1] == '/'); q++);
+
+    if (q - p > UINT16_MAX) {
+      return -1;
+    }
+
+    n = insert_static(n, p, q - p);
+    p = q;
+  }
+
+  if (!n || n->handlers[method]) {
+    return -1;
+  }
+
+  n->handlers[method] = handler;
+  n->terminal = true;
+  return 0;
+}
+
+static void count(const bnode *n, size_t *nodes, size_t *labels,
+                  size_t *terminals) {
+  size_t i;
+
+  if (!n) {
+    return;
+  }
+
+  *nodes += 1;
+  *labels += n->len;
+  *terminals += n->terminal;
+
+  for (i = 0; i < n->count; i++) {
+    count(n->children[i], nodes, labels, terminals);
+  }
+
+  count(n->param, nodes, labels, terminals);
+  count(n->wildcard, nodes, labels, terminals);
+}
+
+static int by_first(const void *a, const void *b) {
+  return (uint8_t) (*(bnode * const *) a)->label[0]
+       - (uint8_t) (*(bnode * const *) b)->label[0];
+}
+
+/**
+ * Compiles the routes into out and releases the builder.
+ */
+int ehttp_router_compile(ehttp_router_builder * const restrict b,
+                         ehttp_router * const restrict out) {
+  size_t nodes = 0, labels = 0, terminals = 0, head, tail, i, m;
+  size_t label = 0, handlers = 0;
+  bnode **queue;
+
+  if (!b->root && !(b->root = bnode_new("", 0))) {
+    return -1;
+  }
+
+  count(b->root, &nodes, &labels, &terminals);
+
+  *out = (ehttp_router) {
+    .nodes = calloc(nodes, sizeof(*out->nodes)),
+    .firsts = calloc(nodes, 1),
+    .labels = malloc(labels + 1),
+    .handlers = calloc(terminals * EHTTP_METHOD_MAX + 1, sizeof(void *)),
+    .nodeCount = nodes,
+  };
+  queue = malloc(nodes * sizeof(*queue));
+
+  if (!out->nodes || !out->firsts || !out->labels || !out->handlers || !queue) {
+    free(queue);
+    ehttp_router_free(out);
+    return -1;
+  }
+
+  // breadth first: the static children of a node get consecutive indexes
+  queue[0] = b->root;
+  for (head = 0, tail = 1; head < tail; head++) {
+    const bnode *bn = queue[head];
+    ehttp_route_node *n = &out->nodes[head];
+
+    if (bn->count > 1) {
+      qsort(bn->children, bn->count, sizeof(*bn->children), by_first);
+    }
+
+    *n = (ehttp_route_node) {
+      .label = label,
+      .labelLen = bn->len,
+      .staticCount = bn->count,
+      .children = tail,
+      .handlers = NO_HANDLERS,
+    };
+
+    memcpy(out->labels + label, bn->label, bn->len);
+    out->firsts[head] = bn->label[0];
+    label += bn->len;
+
+    for (i = 0; i < bn->count; i++) {
+      queue[tail++] = bn->children[i];
+    }
+
+    if (bn->param) {
+      n->param = tail;
+      queue[tail++] = bn->param;
+    }
+
+    if (bn->wildcard) {
+      n->wildcard = tail;
+      queue[tail++] = bn->wildcard;
+    }
+
+    if (bn->terminal) {
+      n->handlers = handlers;
+      for (m = 0; m < EHTTP_METHOD_MAX; m++) {
+        out->handlers[handlers + m] = bn->handlers[m]
+          ? bn->handlers[m]
+          : bn->handlers[EHTTP_METHOD_UNKNOWN];
+      }
+      handlers += EHTTP_METHOD_MAX;
+    }
+  }
+
+  free(queue);
+  ehttp_router_builder_free(b);
+  return 0;
+}
+
+/**
+ * Releases a builder that will not be compiled.
+ */
+void ehttp_router_builder_free(ehttp_router_builder * const b) {
+  bnode_free(b->root);
+  b->root = NULL;
+}
+
+static void *lookup(const ehttp_router * const r, uint32_t idx,
+                    ehttp_method method, const uint8_t *p,
+                    const uint8_t * const end, ehttp_route_match * const m) {
+  const ehttp_route_node *n = &r->nodes[idx];
+  const ehttp_route_node *c;
+  const uint8_t *f, *q;
+  void *h;
+
+  if (p == end) {
+    if (n->handlers != NO_HANDLERS && (h = r->handlers[n->handlers + method])) {
+      return h;
+    }
+  }
+  else if (n->staticCount) {
+    f = memchr(r->firsts + n->children, *p, n->staticCount);
+    if (f) {
+      idx = f - r->firsts;
+      c = &r->nodes[idx];
+      if ((size_t) (end - p) >= c->labelLen
+          && memcmp(r->labels + c->label, p, c->labelLen) == 0
+          && (h = lookup(r, idx, method, p + c->labelLen, end, m))) {
+        return h;
+      }
+    }
+  }
+
+  if (n->param && p < end && *p != '/' && m->count < EHTTP_ROUTER_MAX_PARAMS) {
+    c = &r->nodes[n->param];
+    q = memchr(p, '/', end - p);
+    q = q ? q : end;
+
+    m->params[m->count++] = (ehttp_route_param) {
+      .name = r->labels + c->label,
+      .nameLen = c->labelLen,
+      .at = p,
+      .len = q - p,
+    };
+
+    if ((h = lookup(r, n->param, method, q, end, m))) {
+      return h;
+    }
+
+    m->count--;
+  }
+
+  if (n->wildcard && m->count < EHTTP_ROUTER_MAX_PARAMS) {
+    c = &r->nodes[n->wildcard];
+
+    if (c->handlers != NO_HANDLERS && (h = r->handlers[c->handlers + method])) {
+      m->params[m->count++] = (ehttp_route_param) {
+        .name = r->labels + c->label,
+        .nameLen = c->labelLen,
+        .at = p,
+        .len = end - p,
+      };
+      return h;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Returns the handler for a request URI span (origin or absolute form) and
+ * fills the captures, NULL when no route matches.
+ */
+void *ehttp_router_match(const ehttp_router * const restrict r,
+                         ehttp_method method,
+                         const uint8_t * const restrict uri, size_t len,
+                         ehttp_route_match * const restrict m) {
+  static const uint8_t root[] = "/";
+  const uint8_t *p = uri, *end = uri + len, *q;
+
+  m->count = 0;
+
+  if (method >= EHTTP_METHOD_MAX) {
+    method = EHTTP_METHOD_UNKNOWN;
+  }
+
+  // absolute-form: skip scheme and authority
+  if (p < end && *p != '/') {
+    q = memchr(p, ':', end - p);
+    if (!q || end - q < 3 || q[1] != '/' || q[2] != '/') {
+      return NULL;
+    }
+
+    p = memchr(q + 3, '/', end - q - 3);
+    if (!p) {
+      p = root;
+      end = root + 1;
+    }
+  }
+
+  if ((q = memchr(p, '?', end - p))) {
+    end = q;
+  }
+
+  if ((q = memchr(p, '#', end - p))) {
+    end = q;
+  }
+
+  return lookup(r, 0, method, p, end, m);
+}
+
+/**
+ * Releases a compiled router.
+ */
+void ehttp_router_free(ehttp_router * const r) {
+  free(r->nodes);
+  free(r->firsts);
+  free(r->labels);
+  free(r->handlers);
+  *r = (ehttp_router) { .nodes = NULL };
+}
+
+#ifdef EHTTP_ROUTER_BENCH
+#include <stdio.h>
+#include <time.h>
+
+/*
+ * Matches request URIs, prepared beforehand and taken in random order,
+ * against 1k to 10k routes of static segments, captures and wildcards.
+ * Usage: [lookups]
+ */
+
+#define BENCH_URI 64
+
+static double bench_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// route i, and a URI it matches
+static void bench_route(unsigned i, char *pattern, char *uri) {
+  if (i % 50 == 0) {
+    snprintf(pattern, BENCH_URI, "/assets%u/*path", i);
+    snprintf(uri, BENCH_URI, "/assets%u/css/site-%u.css", i, i * 7);
+  }
+  else if (i % 3 == 0) {
+    snprintf(pattern, BENCH_URI, "/api/v%u/res%u/list", i % 7, i);
+    snprintf(uri, BENCH_URI, "/api/v%u/res%u/list?page=2", i % 7, i);
+  }
+  else {
+    snprintf(pattern, BENCH_URI, "/api/v%u/res%u/:id/item%u", i % 7, i,
+             i % 13);
+    snprintf(uri, BENCH_URI, "/api/v%u/res%u/%u/item%u", i % 7, i, i * 31,
+             i % 13);
+  }
+}
+
+int main(int argc, char **argv) {
+  static const unsigned counts[] = { 1000, 2000, 5000, 10000 };
+  size_t lookups = argc > 1 ? (size_t) atol(argv[1]) : 2000000;
+  char (*uris)[BENCH_URI] = malloc(10000 * sizeof(*uris));
+  unsigned *order = malloc(lookups * sizeof(*order));
+
+  if (!uris || !order) {
+    perror("malloc");
+    return 1;
+  }
+
+  for (size_t k = 0; k < sizeof(counts) / sizeof(*counts); k++) {
+    unsigned count = counts[k];
+    ehttp_router_builder builder;
+    ehttp_router router;
+    ehttp_route_match match;
+    char pattern[BENCH_URI];
+    unsigned seed = count;
+    size_t hits = 0;
+    double elapsed;
+
+    ehttp_router_builder_init(&builder);
+    for (unsigned i = 0; i < count; i++) {
+      bench_route(i, pattern, uris[i]);
+      if (ehttp_router_add(&builder, EHTTP_METHOD_GET, pattern,
+                           &uris[i]) < 0) {
+        fprintf(stderr, "cannot add %s\n", pattern);
+        return 1;
+      }
+    }
+    if (ehttp_router_compile(&builder, &router) < 0) {
+      perror("compile");
+      return 1;
+    }
+
+    for (size_t i = 0; i < lookups; i++) {
+      order[i] = rand_r(&seed) % count;
+    }
+
+    elapsed = bench_now();
+    for (size_t i = 0; i < lookups; i++) {
+      const char *uri = uris[order[i]];
+
+      hits += ehttp_router_match(&router, EHTTP_METHOD_GET,
+                                 (const uint8_t *) uri, strlen(uri),
+                                 &match) == &uris[order[i]];
+    }
+    elapsed = bench_now() - elapsed;
+
+    printf("%5u routes, %zu nodes of %zu bytes: %.1f ns per lookup%s\n",
+           count, router.nodeCount, sizeof(ehttp_route_node),
+           elapsed * 1e9 / lookups, hits == lookups ? "" : ", WRONG ROUTES");
+    ehttp_router_free(&router);
+  }
+
+  free(uris);
+  free(order);
+  return 0;
+}
+#endif
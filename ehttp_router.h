@@ -0,0 +1,133 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_ROUTER_VESTOL
+#define EHTTP_ROUTER_VESTOL
+
+#include "ehttp.h"
+
+/*
+ * Radix trie router.
+ *
+ * Routes are added to a builder at startup, then compiled into a flat,
+ * read-only array of nodes: static children of a node are contiguous and
+ * their first bytes are kept in a separate array scanned with memchr().
+ *
+ * Patterns are made of static text, ":name" captures matching one non empty
+ * path segment and a trailing "*name" capture matching the rest of the path.
+ * Captures are spans into the URI given to ehttp_router_match(), the query
+ * string is not part of the match.
+ *
+ * Build ehttp_router.c with -DEHTTP_ROUTER_BENCH for a lookup benchmark.
+ */
+
+#ifndef EHTTP_ROUTER_MAX_PARAMS
+#define EHTTP_ROUTER_MAX_PARAMS 8
+#endif
+
+typedef struct _ehttp_route_param ehttp_route_param;
+struct _ehttp_route_param {
+  const uint8_t *name;
+  size_t nameLen;
+  const uint8_t *at;
+  size_t len;
+};
+
+typedef struct _ehttp_route_match ehttp_route_match;
+struct _ehttp_route_match {
+  ehttp_route_param params[EHTTP_ROUTER_MAX_PARAMS];
+  size_t count;
+};
+
+typedef struct _ehttp_route_node ehttp_route_node;
+struct _ehttp_route_node {
+  // static text, or the capture name
+  uint32_t label;
+  uint16_t labelLen;
+  uint16_t staticCount;
+  // static children are nodes[children .. children + staticCount)
+  uint32_t children;
+  // 0 when missing: the root is never a child
+  uint32_t param;
+  uint32_t wildcard;
+  // handlers[handlers .. handlers + EHTTP_METHOD_MAX), UINT32_MAX for none
+  uint32_t handlers;
+};
+
+typedef struct _ehttp_router ehttp_router;
+struct _ehttp_router {
+  ehttp_route_node *nodes;
+  // first byte of each node label, indexed like nodes
+  uint8_t *firsts;
+  uint8_t *labels;
+  void **handlers;
+  size_t nodeCount;
+};
+
+typedef struct _ehttp_router_builder ehttp_router_builder;
+struct _ehttp_router_builder {
+  struct _ehttp_router_bnode *root;
+};
+
+/**
+ * Prepares an empty route builder.
+ */
+ehttp_router_builder *ehttp_router_builder_init(ehttp_router_builder * const);
+
+/**
+ * Adds a route. EHTTP_METHOD_UNKNOWN registers the handler for every method
+ * without a handler of its own. Returns -1 on a conflicting or invalid
+ * pattern, or when out of memory.
+ */
+int ehttp_router_add(ehttp_router_builder * const restrict, ehttp_method,
+                     const char * const restrict pattern,
+                     void * const restrict handler);
+
+/**
+ * Compiles the routes into out and releases the builder.
+ */
+int ehttp_router_compile(ehttp_router_builder * const restrict,
+                         ehttp_router * const restrict out);
+
+/**
+ * Releases a builder that will not be compiled.
+ */
+void ehttp_router_builder_free(ehttp_router_builder * const);
+
+/**
+ * Returns the handler for a request URI span (origin or absolute form) and
+ * fills the captures, NULL when no route matches.
+ */
+void *ehttp_router_match(const ehttp_router * const restrict, ehttp_method,
+                         const uint8_t * const restrict, size_t,
+                         ehttp_route_match * const restrict);
+
+/**
+ * Releases a compiled router.
+ */
+void ehttp_router_free(ehttp_router * const);
+
+#endif
@@ -0,0 +1,239 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ehttp_sink.h"
+
+// writes iov completely at offset, retrying short writes
+static int write_at(ehttp_sink * const sink, struct iovec *iov, int n,
+                    uint64_t offset) {
+  while (n) {
+    ssize_t r;
+
+    if (!iov->iov_len) {
+      iov++;
+      n--;
+      continue;
+    }
+
+    r = pwritev(sink->fd, iov, n, offset);
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    // no progress would loop forever
+    if (r == 0) {
+      errno = ENOSPC;
+      return -1;
+    }
+
+    sink->writes++;
+    sink->written += r;
+    offset += r;
+
+    while (n && (size_t) r >= iov->iov_len) {
+      r -= iov->iov_len;
+      iov++;
+      n--;
+    }
+
+    if (n) {
+      iov->iov_base = (uint8_t *) iov->iov_base + r;
+      iov->iov_len -= r;
+    }
+  }
+
+  return 0;
+}
+
+static int set_direct(int fd, bool on) {
+  int fl = fcntl(fd, F_GETFL);
+
+  if (fl < 0) {
+    return -1;
+  }
+
+  return fcntl(fd, F_SETFL, on ? fl | O_DIRECT : fl & ~O_DIRECT);
+}
+
+/**
+ * Prepares a sink writing the body of parser to fd from offset 0. Call it
+ * from on_headers_done: a Content-Length body is preallocated. bufferSize is
+ * rounded up to EHTTP_SINK_ALIGN. Returns NULL when the buffer cannot be
+ * allocated or O_DIRECT cannot be set.
+ */
+ehttp_sink *ehttp_sink_init(ehttp_sink * const restrict sink, int fd,
+                            const ehttp_parser * const restrict parser,
+                            size_t bufferSize, int flags) {
+  bufferSize = (bufferSize + EHTTP_SINK_ALIGN - 1) & ~(size_t) (EHTTP_SINK_ALIGN - 1);
+  if (!bufferSize) {
+    bufferSize = EHTTP_SINK_ALIGN;
+  }
+
+  *sink = (ehttp_sink) {
+    .fd = fd,
+    .flags = flags,
+    .bufferSize = bufferSize,
+    .expected = parser->isChunked ? 0 : parser->contentLength,
+  };
+
+  // not worth it when the whole body fits the buffer
+  if (sink->expected && sink->expected <= bufferSize) {
+    sink->flags &= ~EHTTP_SINK_DIRECT;
+  }
+
+  sink->buffer = aligned_alloc(EHTTP_SINK_ALIGN, bufferSize);
+  if (!sink->buffer) {
+    return NULL;
+  }
+
+  if ((sink->flags & EHTTP_SINK_DIRECT) && set_direct(fd, true) < 0) {
+    free(sink->buffer);
+    sink->buffer = NULL;
+    return NULL;
+  }
+
+  // reserve extents without changing the file size, best effort
+  if (sink->expected) {
+    (void) fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, sink->expected);
+  }
+
+  return sink;
+}
+
+/**
+ * Appends a body fragment. Returns -1 with errno set on error.
+ */
+int ehttp_sink_write(ehttp_sink * const restrict sink,
+                     const uint8_t * const restrict data, size_t len) {
+  size_t room = sink->bufferSize - sink->used;
+
+  if (len < room) {
+    memcpy(sink->buffer + sink->used, data, len);
+    sink->used += len;
+    return 0;
+  }
+
+  // gather the buffer and the fragment in one call
+  if (!(sink->flags & EHTTP_SINK_DIRECT)) {
+    struct iovec iov[2] = {
+      { .iov_base = sink->buffer, .iov_len = sink->used },
+      { .iov_base = (void *) data, .iov_len = len },
+    };
+    uint64_t offset = sink->offset;
+
+    sink->offset += sink->used + len;
+    sink->used = 0;
+    return write_at(sink, iov, 2, offset);
+  }
+
+  // O_DIRECT needs whole aligned buffers
+  for (size_t done = 0; done < len; room = sink->bufferSize - sink->used) {
+    size_t n = (len - done < room) ? len - done : room;
+
+    memcpy(sink->buffer + sink->used, data + done, n);
+    sink->used += n;
+    done += n;
+
+    if (sink->used == sink->bufferSize) {
+      struct iovec iov = { .iov_base = sink->buffer, .iov_len = sink->used };
+
+      if (write_at(sink, &iov, 1, sink->offset) < 0) {
+        return -1;
+      }
+      sink->offset += sink->used;
+      sink->used = 0;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Writes what is buffered, with O_DIRECT cleared for an unaligned tail, and
+ * with EHTTP_SINK_SYNC calls fdatasync() timing it in syncNanos. Returns -1
+ * with errno set on error, or when less than Content-Length was written.
+ */
+int ehttp_sink_finish(ehttp_sink * const sink) {
+  if (sink->used) {
+    struct iovec iov = { .iov_base = sink->buffer, .iov_len = sink->used };
+
+    if ((sink->flags & EHTTP_SINK_DIRECT) && (sink->used % EHTTP_SINK_ALIGN)) {
+      if (set_direct(sink->fd, false) < 0) {
+        return -1;
+      }
+      sink->flags &= ~EHTTP_SINK_DIRECT;
+    }
+
+    if (write_at(sink, &iov, 1, sink->offset) < 0) {
+      return -1;
+    }
+    sink->offset += sink->used;
+    sink->used = 0;
+  }
+
+  if (sink->flags & EHTTP_SINK_SYNC) {
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (fdatasync(sink->fd) < 0) {
+      return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    sink->syncNanos = (uint64_t) (end.tv_sec - start.tv_sec) * 1000000000u
+                    + end.tv_nsec - start.tv_nsec;
+  }
+
+  if (sink->expected && sink->written < sink->expected) {
+    errno = EPIPE;
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Frees the buffer; the file descriptor is left open.
+ */
+void ehttp_sink_end(ehttp_sink * const sink) {
+  if (sink->flags & EHTTP_SINK_DIRECT) {
+    (void) set_direct(sink->fd, false);
+  }
+
+  free(sink->buffer);
+  sink->buffer = NULL;
+}
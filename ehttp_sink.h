@@ -0,0 +1,100 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_SINK_VESTOL
+#define EHTTP_SINK_VESTOL
+
+#include "ehttp.h"
+
+/*
+ * Body to file sink.
+ *
+ * Fed from on_content, fragments are gathered in an aligned buffer and
+ * written at increasing offsets with pwrite(); a fragment that does not fit
+ * is written together with the buffer by one pwritev(), without copying it.
+ * When the length is known up front the file is preallocated so extents are
+ * reserved once.
+ */
+
+#ifndef EHTTP_SINK_ALIGN
+// O_DIRECT alignment of buffer address, size and file offsets
+#define EHTTP_SINK_ALIGN 4096
+#endif
+
+enum {
+  // bypass the page cache while the buffer is full, see ehttp_sink_finish()
+  EHTTP_SINK_DIRECT = 1 << 0,
+  // ehttp_sink_finish() waits for the data to be durable
+  EHTTP_SINK_SYNC = 1 << 1,
+};
+
+typedef struct _ehttp_sink ehttp_sink;
+struct _ehttp_sink {
+  int fd;
+  int flags;
+  uint8_t *buffer;
+  size_t bufferSize;
+  size_t used;
+  // file offset of buffer[0]
+  uint64_t offset;
+  // Content-Length, 0 for chunked bodies
+  uint64_t expected;
+  /* stats */
+  uint64_t written;
+  uint32_t writes;
+  // time spent in fdatasync(), nanoseconds
+  uint64_t syncNanos;
+};
+
+/**
+ * Prepares a sink writing the body of parser to fd from offset 0. Call it
+ * from on_headers_done: a Content-Length body is preallocated. bufferSize is
+ * rounded up to EHTTP_SINK_ALIGN. Returns NULL when the buffer cannot be
+ * allocated or O_DIRECT cannot be set.
+ */
+ehttp_sink *ehttp_sink_init(ehttp_sink * const restrict, int fd,
+                            const ehttp_parser * const restrict,
+                            size_t bufferSize, int flags);
+
+/**
+ * Appends a body fragment. Returns -1 with errno set on error.
+ */
+int ehttp_sink_write(ehttp_sink * const restrict,
+                     const uint8_t * const restrict, size_t);
+
+/**
+ * Writes what is buffered, with O_DIRECT cleared for an unaligned tail, and
+ * with EHTTP_SINK_SYNC calls fdatasync() timing it in syncNanos. Returns -1
+ * with errno set on error, or when less than Content-Length was written.
+ */
+int ehttp_sink_finish(ehttp_sink * const);
+
+/**
+ * Frees the buffer; the file descriptor is left open.
+ */
+void ehttp_sink_end(ehttp_sink * const);
+
+#endif
@@ -0,0 +1,223 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#include <errno.h>
+#include <string.h>
+
+#include "ehttp_snapshot.h"
+#include "ehttp_internal.h"
+
+#define NO_OFFSET UINT32_MAX
+
+static const uint8_t magic[3] = { 'E', 'H', 'S' };
+
+_Static_assert(S_STATE_END <= 0xff, "states are stored in a byte");
+
+static uint8_t *put16(uint8_t *out, uint16_t v) {
+  out[0] = v;
+  out[1] = v >> 8;
+  return out + 2;
+}
+
+static uint8_t *put32(uint8_t *out, uint32_t v) {
+  out = put16(out, v);
+  return put16(out, v >> 16);
+}
+
+static uint8_t *put64(uint8_t *out, uint64_t v) {
+  out = put32(out, v);
+  return put32(out, v >> 32);
+}
+
+static uint16_t get16(const uint8_t *in) {
+  return in[0] | in[1] << 8;
+}
+
+static uint32_t get32(const uint8_t *in) {
+  return get16(in) | (uint32_t) get16(in + 2) << 16;
+}
+
+static uint64_t get64(const uint8_t *in) {
+  return get32(in) | (uint64_t) get32(in + 4) << 32;
+}
+
+static uint32_t offset_of(const uint8_t *at, const uint8_t *pending,
+                          size_t len) {
+  if (!pending || at < pending || at > pending + len) {
+    return NO_OFFSET;
+  }
+
+  return at - pending;
+}
+
+/**
+ * Writes the snapshot of a parser with pendingLen unparsed bytes to out.
+ * Returns its size, EHTTP_SNAPSHOT_SIZE + pendingLen, or 0 when out is
+ * too small.
+ */
+size_t ehttp_snapshot(const ehttp_parser * const restrict s,
+                      const uint8_t * const restrict pending,
+                      size_t pendingLen, uint8_t * const restrict out,
+                      size_t outSize) {
+  uint8_t *o = out;
+
+  if (pendingLen >= NO_OFFSET ||
+      outSize < EHTTP_SNAPSHOT_SIZE + pendingLen) {
+    return 0;
+  }
+
+  memcpy(o, magic, sizeof(magic));
+  o += sizeof(magic);
+  *o++ = EHTTP_SNAPSHOT_VERSION;
+  *o++ = S_STATE_END;
+
+  *o++ = s->state;
+  *o++ = s->hnstate;
+  *o++ = s->hvstate;
+  *o++ = s->mode;
+  *o++ = s->requestType;
+  *o++ = s->method;
+  *o++ = s->requestMethod;
+  *o++ = s->majorVersion;
+  *o++ = s->minorVersion;
+  o = put16(o, s->statusCode);
+  *o++ = s->hasContent;
+  *o++ = s->isChunked;
+  *o++ = s->isUpgrade;
+  *o++ = s->shouldClose;
+  *o++ = s->haveHostHeader;
+  *o++ = s->contentEncoding;
+  *o++ = s->haveContentLength;
+  *o++ = s->haveTransferEncoding;
+  *o++ = s->haveChunked;
+  *o++ = s->flags;
+  *o++ = s->error;
+  *o++ = s->expectContinue;
+  *o++ = s->skipBody;
+  *o++ = s->traced;
+  *o++ = s->keepAlive;
+  o = put64(o, s->contentLength);
+
+  o = put32(o, offset_of(s->p, pending, pendingLen));
+  o = put32(o, offset_of(s->end, pending, pendingLen));
+  o = put32(o, offset_of(s->mark, pending, pendingLen));
+  o = put32(o, pendingLen);
+
+  if (pendingLen) {
+    memcpy(o, pending, pendingLen);
+  }
+
+  return o - out + pendingLen;
+}
+
+/**
+ * Restores a parser from a snapshot of size bytes and copies its pending
+ * bytes to buffer, where the restored pointers point; *pendingLen is set
+ * to their count and they must be parsed first. Returns -1 with errno
+ * EINVAL for a truncated or foreign snapshot and ENOBUFS when buffer is
+ * too small.
+ */
+int ehttp_restore(ehttp_parser * const restrict s,
+                  const uint8_t * const restrict in, size_t size,
+                  void * const restrict ctx, uint8_t * const restrict buffer,
+                  size_t bufferSize, size_t * const restrict pendingLen) {
+  const uint8_t *i = in;
+  uint32_t offsets[3];
+  uint32_t len;
+  ehttp_parser r;
+  size_t k;
+
+  if (size < EHTTP_SNAPSHOT_SIZE || memcmp(i, magic, sizeof(magic)) ||
+      i[3] != EHTTP_SNAPSHOT_VERSION || i[4] != S_STATE_END) {
+    errno = EINVAL;
+    return -1;
+  }
+  i += 5;
+
+  r = (ehttp_parser) {
+    .state = i[0],
+    .hnstate = i[1],
+    .hvstate = i[2],
+    .mode = i[3],
+    .requestType = i[4],
+    .method = i[5],
+    .requestMethod = i[6],
+    .majorVersion = i[7],
+    .minorVersion = i[8],
+    .statusCode = get16(i + 9),
+    .hasContent = i[11],
+    .isChunked = i[12],
+    .isUpgrade = i[13],
+    .shouldClose = i[14],
+    .haveHostHeader = i[15],
+    .contentEncoding = i[16],
+    .haveContentLength = i[17],
+    .haveTransferEncoding = i[18],
+    .haveChunked = i[19],
+    .flags = i[20],
+    .error = i[21],
+    .expectContinue = i[22],
+    .skipBody = i[23],
+    .traced = i[24],
+    .keepAlive = i[25],
+    .contentLength = get64(i + 26),
+    .context = ctx,
+  };
+  i += 34;
+
+  for (k = 0; k < 3; k++, i += 4) {
+    offsets[k] = get32(i);
+  }
+  len = get32(i);
+  i += 4;
+
+  if (r.state > S_STATE_END || r.mode < EHTTP_MODE_REQUEST ||
+      r.mode > EHTTP_MODE_DETECT || len > size - (i - in)) {
+    errno = EINVAL;
+    return -1;
+  }
+  for (k = 0; k < 3; k++) {
+    if (offsets[k] != NO_OFFSET && offsets[k] > len) {
+      errno = EINVAL;
+      return -1;
+    }
+  }
+  if (len > bufferSize) {
+    errno = ENOBUFS;
+    return -1;
+  }
+
+  if (len) {
+    memcpy(buffer, i, len);
+  }
+  r.p = offsets[0] == NO_OFFSET ? NULL : buffer + offsets[0];
+  r.end = offsets[1] == NO_OFFSET ? NULL : buffer + offsets[1];
+  r.mark = offsets[2] == NO_OFFSET ? NULL : buffer + offsets[2];
+
+  *s = r;
+  *pendingLen = len;
+  return 0;
+}
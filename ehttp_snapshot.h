@@ -0,0 +1,74 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_SNAPSHOT_VESTOL
+#define EHTTP_SNAPSHOT_VESTOL
+
+#include "ehttp.h"
+
+/*
+ * Parser snapshots, to hand a live connection over to another thread or
+ * process (the socket itself travels with SCM_RIGHTS).
+ *
+ * A snapshot is taken between two ehttp_parse() calls. It holds every
+ * parser field in a fixed little-endian layout, followed by the bytes
+ * read from the socket but not parsed yet: the rest of a buffer after
+ * EHTTP_PARSER_RETURN, or a pipelined request. The parser pointers are
+ * stored as offsets into those pending bytes, or as none when they point
+ * elsewhere. The context pointer is not stored.
+ *
+ * The layout starts with a version, and snapshots are only restored by a
+ * build with the same version and the same parser states.
+ */
+
+#define EHTTP_SNAPSHOT_VERSION 1
+
+// size of a snapshot with no pending bytes
+#define EHTTP_SNAPSHOT_SIZE 55
+
+/**
+ * Writes the snapshot of a parser with pendingLen unparsed bytes to out.
+ * Returns its size, EHTTP_SNAPSHOT_SIZE + pendingLen, or 0 when out is
+ * too small.
+ */
+size_t ehttp_snapshot(const ehttp_parser * const restrict,
+                      const uint8_t * const restrict pending,
+                      size_t pendingLen, uint8_t * const restrict out,
+                      size_t outSize);
+
+/**
+ * Restores a parser from a snapshot of size bytes and copies its pending
+ * bytes to buffer, where the restored pointers point; *pendingLen is set
+ * to their count and they must be parsed first. Returns -1 with errno
+ * EINVAL for a truncated or foreign snapshot and ENOBUFS when buffer is
+ * too small.
+ */
+int ehttp_restore(ehttp_parser * const restrict,
+                  const uint8_t * const restrict in, size_t size,
+                  void * const restrict ctx, uint8_t * const restrict buffer,
+                  size_t bufferSize, size_t * const restrict pendingLen);
+
+#endif
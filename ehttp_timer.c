@@ -0,0 +1,340 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifdef EHTTP_TIMER_BENCH
+// clock_gettime() and rand_r() for the benchmark at the end
+#define _GNU_SOURCE
+#endif
+#include <string.h>
+
+#include "ehttp_timer.h"
+#include "ehttp_internal.h"
+
+#define SLOT_MASK (EHTTP_WHEEL_SLOTS - 1)
+// furthest expiry from the current tick
+#define SPAN ((1ull << (EHTTP_WHEEL_BITS * EHTTP_WHEEL_LEVELS)) - 1)
+
+_Static_assert(EHTTP_WHEEL_LEVELS * EHTTP_WHEEL_BITS < 64,
+               "the wheel span must fit a tick");
+
+static void link_timer(ehttp_wheel *wheel, ehttp_timer *timer) {
+  uint64_t delta;
+  unsigned level = 0;
+  unsigned slot;
+  ehttp_timer **head;
+
+  if (timer->expires < wheel->tick) {
+    timer->expires = wheel->tick;
+  }
+  delta = timer->expires - wheel->tick;
+  if (delta > SPAN) {
+    timer->expires = wheel->tick + SPAN;
+    delta = SPAN;
+  }
+
+  while (delta >> (EHTTP_WHEEL_BITS * (level + 1))) {
+    level++;
+  }
+
+  slot = (timer->expires >> (EHTTP_WHEEL_BITS * level)) & SLOT_MASK;
+  head = &wheel->slots[level][slot];
+
+  timer->next = *head;
+  if (*head) {
+    (*head)->pprev = &timer->next;
+  }
+  timer->pprev = head;
+  *head = timer;
+  wheel->occupied[level] |= 1ull << slot;
+}
+
+static void unlink_timer(ehttp_wheel *wheel, ehttp_timer *timer) {
+  ehttp_timer **pprev = timer->pprev;
+
+  *pprev = timer->next;
+  if (timer->next) {
+    timer->next->pprev = pprev;
+  }
+  timer->pprev = NULL;
+
+  // the slot is empty when the timer was its only entry
+  if (!*pprev && pprev >= &wheel->slots[0][0] &&
+      pprev <= &wheel->slots[EHTTP_WHEEL_LEVELS - 1][SLOT_MASK]) {
+    size_t index = pprev - &wheel->slots[0][0];
+
+    wheel->occupied[index / EHTTP_WHEEL_SLOTS] &=
+        ~(1ull << (index & SLOT_MASK));
+  }
+}
+
+/**
+ * Prepares an empty wheel starting at tick now, with the idle, header and
+ * body timeouts used by ehttp_timer_track().
+ */
+ehttp_wheel *ehttp_wheel_init(ehttp_wheel * const wheel, uint64_t now,
+                              uint64_t idle, uint64_t header, uint64_t body) {
+  memset(wheel, 0, sizeof(*wheel));
+  wheel->tick = now;
+  wheel->timeouts[EHTTP_DEADLINE_IDLE] = idle;
+  wheel->timeouts[EHTTP_DEADLINE_HEADER] = header;
+  wheel->timeouts[EHTTP_DEADLINE_BODY] = body;
+
+  return wheel;
+}
+
+/**
+ * Prepares an unarmed timer.
+ */
+ehttp_timer *ehttp_timer_init(ehttp_timer * const restrict timer,
+                              void (*fire)(ehttp_timer *),
+                              void * const restrict context) {
+  *timer = (ehttp_timer) {
+    .fire = fire,
+    .context = context,
+  };
+
+  return timer;
+}
+
+/**
+ * Arms the timer to fire ticks from now, re-arming it if needed.
+ */
+void ehttp_timer_arm(ehttp_wheel * const restrict wheel,
+                     ehttp_timer * const restrict timer, uint64_t ticks) {
+  if (timer->pprev) {
+    unlink_timer(wheel, timer);
+  }
+  else {
+    wheel->count++;
+  }
+
+  timer->expires = wheel->tick + (ticks < SPAN ? ticks : SPAN);
+  link_timer(wheel, timer);
+}
+
+/**
+ * Disarms the timer, if armed.
+ */
+void ehttp_timer_cancel(ehttp_wheel * const restrict wheel,
+                        ehttp_timer * const restrict timer) {
+  if (timer->pprev) {
+    unlink_timer(wheel, timer);
+    wheel->count--;
+  }
+}
+
+/**
+ * Arms the timer for the phase the parser is in: the header deadline is
+ * set when a message head starts and kept until it is complete, the body
+ * and idle deadlines restart on every call.
+ */
+void ehttp_timer_track(ehttp_wheel * const restrict wheel,
+                       ehttp_timer * const restrict timer,
+                       const ehttp_parser * const restrict s) {
+  ehttp_deadline deadline;
+
+  if (ehttp_is_idle(s)) {
+    deadline = EHTTP_DEADLINE_IDLE;
+  }
+  else if (s->state < S_HEADERS_DONE) {
+    deadline = EHTTP_DEADLINE_HEADER;
+  }
+  else {
+    deadline = EHTTP_DEADLINE_BODY;
+  }
+
+  if (deadline == EHTTP_DEADLINE_HEADER && timer->deadline == deadline &&
+      timer->pprev) {
+    return;
+  }
+
+  timer->deadline = deadline;
+  if (wheel->timeouts[deadline]) {
+    ehttp_timer_arm(wheel, timer, wheel->timeouts[deadline]);
+  }
+  else {
+    ehttp_timer_cancel(wheel, timer);
+  }
+}
+
+// moves the timers of a slot to lower levels
+static void cascade(ehttp_wheel *wheel, unsigned level, unsigned slot) {
+  ehttp_timer *timer = wheel->slots[level][slot];
+
+  wheel->slots[level][slot] = NULL;
+  wheel->occupied[level] &= ~(1ull << slot);
+
+  while (timer) {
+    ehttp_timer *next = timer->next;
+
+    link_timer(wheel, timer);
+    timer = next;
+  }
+}
+
+/**
+ * Fires every timer expiring at or before tick now. Returns their count.
+ */
+size_t ehttp_wheel_advance(ehttp_wheel * const wheel, uint64_t now) {
+  size_t fired = 0;
+
+  while (wheel->tick <= now) {
+    unsigned slot = wheel->tick & SLOT_MASK;
+    ehttp_timer *timer;
+
+    if (!wheel->count) {
+      wheel->tick = now + 1;
+      break;
+    }
+
+    if (!slot) {
+      unsigned level;
+
+      for (level = 1; level < EHTTP_WHEEL_LEVELS; level++) {
+        unsigned index = (wheel->tick >> (EHTTP_WHEEL_BITS * level)) &
+                         SLOT_MASK;
+
+        cascade(wheel, level, index);
+        if (index) {
+          break;
+        }
+      }
+    }
+
+    // fire may arm timers in this very slot: they are due now
+    while ((timer = wheel->slots[0][slot])) {
+      unlink_timer(wheel, timer);
+      wheel->count--;
+      fired++;
+      timer->fire(timer);
+    }
+
+    wheel->tick++;
+  }
+
+  return fired;
+}
+
+/**
+ * Ticks until the wheel must be advanced, e.g. for the epoll_wait()
+ * timeout: at the next expiry or earlier. UINT64_MAX when no timer is
+ * armed.
+ */
+uint64_t ehttp_wheel_next(const ehttp_wheel * const wheel) {
+  unsigned slot = wheel->tick & SLOT_MASK;
+  uint64_t ahead;
+
+  if (!wheel->count) {
+    return UINT64_MAX;
+  }
+
+  ahead = wheel->occupied[0] >> slot;
+  if (ahead) {
+    return __builtin_ctzll(ahead);
+  }
+
+  // the next cascade may bring timers down
+  return EHTTP_WHEEL_SLOTS - slot;
+}
+
+#ifdef EHTTP_TIMER_BENCH
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Arms millions of timers spread like header, body and idle deadlines,
+ * cancels and re-arms a quarter of them as a connection making progress
+ * would, then advances the wheel to its next deadline until every timer
+ * fired, checking each fires on its own tick. Usage: [timers]
+ */
+
+static ehttp_wheel benchWheel;
+static size_t benchFired;
+static size_t benchLate;
+
+static void bench_fire(ehttp_timer *timer) {
+  benchFired++;
+  benchLate += timer->expires != benchWheel.tick;
+}
+
+static double bench_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  size_t count = argc > 1 ? (size_t) atol(argv[1]) : 2000000;
+  ehttp_timer *timers = malloc(sizeof(*timers) * count);
+  uint64_t *ticks = malloc(sizeof(*ticks) * count);
+  unsigned seed = 1;
+  uint64_t next;
+  double elapsed;
+
+  if (!timers || !ticks) {
+    perror("malloc");
+    return 1;
+  }
+
+  ehttp_wheel_init(&benchWheel, 12345, 0, 0, 0);
+  // a third each of short, medium and long deadlines
+  for (size_t i = 0; i < count; i++) {
+    ticks[i] = rand_r(&seed) % (i % 3 == 0 ? 100 : i % 3 == 1 ? 5000 : 300000);
+    ehttp_timer_init(&timers[i], bench_fire, NULL);
+  }
+
+  elapsed = bench_now();
+  for (size_t i = 0; i < count; i++) {
+    ehttp_timer_arm(&benchWheel, &timers[i], ticks[i]);
+  }
+  elapsed = bench_now() - elapsed;
+  printf("arm: %.1f ns per timer\n", elapsed * 1e9 / count);
+
+  elapsed = bench_now();
+  for (size_t i = 0; i < count; i += 4) {
+    ehttp_timer_cancel(&benchWheel, &timers[i]);
+    ehttp_timer_arm(&benchWheel, &timers[i], ticks[i]);
+  }
+  elapsed = bench_now() - elapsed;
+  printf("cancel and re-arm: %.1f ns per timer\n",
+         elapsed * 1e9 / ((count + 3) / 4));
+
+  elapsed = bench_now();
+  while ((next = ehttp_wheel_next(&benchWheel)) != UINT64_MAX) {
+    ehttp_wheel_advance(&benchWheel, benchWheel.tick + next);
+  }
+  elapsed = bench_now() - elapsed;
+  printf("expire: %.1f ns per timer, cascades included; %zu fired, "
+         "%zu off their tick\n", elapsed * 1e9 / count, benchFired,
+         benchLate);
+
+  free(timers);
+  free(ticks);
+  return benchFired != count || benchLate;
+}
+#endif
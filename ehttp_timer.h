@@ -0,0 +1,140 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_TIMER_VESTOL
+#define EHTTP_TIMER_VESTOL
+
+#include "ehttp.h"
+
+/*
+ * Hierarchical timing wheel for connection timeouts.
+ *
+ * Timers are embedded in the connection and linked into the slots of
+ * EHTTP_WHEEL_LEVELS wheels of 64 slots, each level 64 times coarser than
+ * the one below: arming and cancelling are O(1) and no memory is
+ * allocated. The slot heads of all levels are one contiguous array, and a
+ * 64 bit occupancy mask per level lets ehttp_wheel_next() find the next
+ * deadline without walking slots. Time is counted in ticks of whatever
+ * unit the caller uses (e.g. milliseconds); timers further away than the
+ * wheel span are clamped to it.
+ *
+ * ehttp_timer_track() derives the deadline of a connection from its parser
+ * after every ehttp_parse(): the head of a message must be complete within
+ * the header timeout of its first byte, the body may not stall for longer
+ * than the body timeout and an idle keep-alive connection is closed after
+ * the idle timeout.
+ *
+ * Build ehttp_timer.c with -DEHTTP_TIMER_BENCH for a benchmark arming,
+ * cancelling and expiring millions of timers.
+ */
+
+#ifndef EHTTP_WHEEL_LEVELS
+#define EHTTP_WHEEL_LEVELS 4
+#endif
+
+#define EHTTP_WHEEL_BITS 6
+#define EHTTP_WHEEL_SLOTS (1 << EHTTP_WHEEL_BITS)
+
+typedef enum {
+  EHTTP_DEADLINE_NONE = 0,
+  EHTTP_DEADLINE_IDLE,
+  EHTTP_DEADLINE_HEADER,
+  EHTTP_DEADLINE_BODY,
+  EHTTP_DEADLINE_MAX,
+} ehttp_deadline;
+
+typedef struct _ehttp_timer ehttp_timer;
+struct _ehttp_timer {
+  ehttp_timer *next;
+  // NULL when not armed
+  ehttp_timer **pprev;
+  uint64_t expires;
+  // called once expired, unarmed: it may arm the timer again
+  void (*fire)(ehttp_timer *);
+  void *context;
+  // ehttp_deadline set by ehttp_timer_track()
+  uint8_t deadline;
+};
+
+typedef struct _ehttp_wheel ehttp_wheel;
+struct _ehttp_wheel {
+  // next tick to expire
+  uint64_t tick;
+  size_t count;
+  uint64_t occupied[EHTTP_WHEEL_LEVELS];
+  // ticks by ehttp_deadline, 0 for none
+  uint64_t timeouts[EHTTP_DEADLINE_MAX];
+  ehttp_timer *slots[EHTTP_WHEEL_LEVELS][EHTTP_WHEEL_SLOTS];
+};
+
+/**
+ * Prepares an empty wheel starting at tick now, with the idle, header and
+ * body timeouts used by ehttp_timer_track().
+ */
+ehttp_wheel *ehttp_wheel_init(ehttp_wheel * const, uint64_t now,
+                              uint64_t idle, uint64_t header, uint64_t body);
+
+/**
+ * Prepares an unarmed timer.
+ */
+ehttp_timer *ehttp_timer_init(ehttp_timer * const restrict,
+                              void (*fire)(ehttp_timer *),
+                              void * const restrict context);
+
+/**
+ * Arms the timer to fire ticks from now, re-arming it if needed.
+ */
+void ehttp_timer_arm(ehttp_wheel * const restrict,
+                     ehttp_timer * const restrict, uint64_t ticks);
+
+/**
+ * Disarms the timer, if armed.
+ */
+void ehttp_timer_cancel(ehttp_wheel * const restrict,
+                        ehttp_timer * const restrict);
+
+/**
+ * Arms the timer for the phase the parser is in: the header deadline is
+ * set when a message head starts and kept until it is complete, the body
+ * and idle deadlines restart on every call.
+ */
+void ehttp_timer_track(ehttp_wheel * const restrict,
+                       ehttp_timer * const restrict,
+                       const ehttp_parser * const restrict);
+
+/**
+ * Fires every timer expiring at or before tick now. Returns their count.
+ */
+size_t ehttp_wheel_advance(ehttp_wheel * const, uint64_t now);
+
+/**
+ * Ticks until the wheel must be advanced, e.g. for the epoll_wait()
+ * timeout: at the next expiry or earlier. UINT64_MAX when no timer is
+ * armed.
+ */
+uint64_t ehttp_wheel_next(const ehttp_wheel * const);
+
+#endif
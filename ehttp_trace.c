@@ -0,0 +1,247 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#include <inttypes.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "ehttp_trace.h"
+
+#define RING_MASK (EHTTP_TRACE_RING - 1)
+
+_Static_assert((EHTTP_TRACE_RING & RING_MASK) == 0,
+               "EHTTP_TRACE_RING must be a power of two");
+
+// messages traced by the dump at once
+#define OPEN_MAX 256
+
+static unsigned rate = 64;
+
+static uint64_t tsc(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+#endif
+}
+
+/**
+ * Traces one message in n on every thread, 0 disables tracing. Set it
+ * before parsing starts.
+ */
+void ehttp_trace_rate(unsigned n) {
+  rate = n;
+}
+
+/**
+ * The calling thread's ring.
+ */
+ehttp_trace_ring *ehttp_trace_local(void) {
+  static _Thread_local ehttp_trace_ring local;
+  return &local;
+}
+
+/**
+ * Called by the parser when a message starts: true when it is traced.
+ */
+bool ehttp_trace_sample(void) {
+  static _Thread_local unsigned count;
+
+  return rate && ++count % rate == 0;
+}
+
+/**
+ * Appends an event for parser to the calling thread's ring.
+ */
+void ehttp_trace_event(const ehttp_parser * const parser, uint8_t event) {
+  ehttp_trace_ring *ring = ehttp_trace_local();
+  uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+  ring->records[head & RING_MASK] = (ehttp_trace_record) {
+    .tsc = tsc(),
+    .parser = parser,
+    .event = event,
+  };
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+typedef struct {
+  const ehttp_parser *parser;
+  uint64_t last;
+  uint8_t phase;
+  bool inParse;
+  bool inCallback;
+  // ticks of the current phase: [0] parser, [1] callbacks
+  uint64_t ticks[2];
+} open_message;
+
+typedef struct {
+  uint64_t buckets[EHTTP_PHASE_MAX][2][64];
+  uint64_t count[EHTTP_PHASE_MAX];
+  open_message open[OPEN_MAX];
+} trace_stats;
+
+static unsigned log2_of(uint64_t v) {
+  unsigned n = 0;
+
+  while (v >>= 1) {
+    n++;
+  }
+
+  return n;
+}
+
+static void close_phase(trace_stats *stats, open_message *m) {
+  if (m->phase < EHTTP_PHASE_MAX) {
+    stats->buckets[m->phase][0][log2_of(m->ticks[0])]++;
+    stats->buckets[m->phase][1][log2_of(m->ticks[1])]++;
+    stats->count[m->phase]++;
+  }
+
+  m->ticks[0] = m->ticks[1] = 0;
+}
+
+static open_message *find_open(trace_stats *stats, const ehttp_parser *parser) {
+  open_message *slot = NULL;
+
+  for (size_t i = 0; i < OPEN_MAX; i++) {
+    if (stats->open[i].parser == parser) {
+      return &stats->open[i];
+    }
+    if (!slot && !stats->open[i].parser) {
+      slot = &stats->open[i];
+    }
+  }
+
+  if (slot) {
+    *slot = (open_message) { .parser = parser, .phase = EHTTP_PHASE_MAX };
+  }
+
+  return slot;
+}
+
+static void replay(trace_stats *stats, const ehttp_trace_record *r) {
+  open_message *m = find_open(stats, r->parser);
+
+  if (!m) {
+    return;
+  }
+
+  if (m->inParse && m->last) {
+    m->ticks[m->inCallback] += r->tsc - m->last;
+  }
+  m->last = r->tsc;
+
+  switch (r->event) {
+    case EHTTP_TRACE_ENTER:
+      m->inParse = true;
+      break;
+
+    case EHTTP_TRACE_EXIT:
+      m->inParse = false;
+      break;
+
+    case EHTTP_TRACE_CALLBACK:
+      m->inCallback = true;
+      break;
+
+    case EHTTP_TRACE_CALLBACK_DONE:
+      m->inCallback = false;
+      break;
+
+    case EHTTP_TRACE_DONE:
+      close_phase(stats, m);
+      m->parser = NULL;
+      break;
+
+    default:
+      close_phase(stats, m);
+      m->phase = r->event;
+      break;
+  }
+}
+
+/**
+ * Prints, for each phase, log2 histograms in TSC ticks of the parser time
+ * and the callback time of the messages found in ring. The owning thread
+ * may keep writing: records overwritten meanwhile are skipped. Returns -1
+ * when out of memory.
+ */
+int ehttp_trace_dump(const ehttp_trace_ring * const restrict ring,
+                     FILE * const restrict out) {
+  static const char *phases[EHTTP_PHASE_MAX] = {
+    [EHTTP_PHASE_REQUEST_LINE] = "request line",
+    [EHTTP_PHASE_HEADERS] = "headers",
+    [EHTTP_PHASE_EOH] = "end of headers",
+    [EHTTP_PHASE_BODY] = "body",
+  };
+  trace_stats *stats = calloc(1, sizeof(*stats));
+  uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  // the oldest slot may be rewritten by the next record
+  uint64_t first = head >= EHTTP_TRACE_RING ? head - EHTTP_TRACE_RING + 1 : 0;
+
+  if (!stats) {
+    return -1;
+  }
+
+  for (uint64_t i = first; i < head; i++) {
+    ehttp_trace_record r = ring->records[i & RING_MASK];
+
+    // the copy is done before head is read again, as in a seqlock
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    // overwritten, or being overwritten, while reading
+    if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - i >= EHTTP_TRACE_RING) {
+      continue;
+    }
+
+    replay(stats, &r);
+  }
+
+  for (unsigned phase = 0; phase < EHTTP_PHASE_MAX; phase++) {
+    fprintf(out, "%s: %" PRIu64 " samples\n", phases[phase], stats->count[phase]);
+
+    for (unsigned bucket = 0; bucket < 64; bucket++) {
+      const uint64_t *b = &stats->buckets[phase][0][0];
+
+      if (!b[bucket] && !b[64 + bucket]) {
+        continue;
+      }
+
+      fprintf(out, "  >= %20" PRIu64 " ticks  parser %10" PRIu64
+              "  callbacks %10" PRIu64 "\n",
+              bucket ? UINT64_C(1) << bucket : 0, b[bucket], b[64 + bucket]);
+    }
+  }
+
+  free(stats);
+  return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <http://unlicense.org/>
+ */
+#ifndef EHTTP_TRACE_VESTOL
+#define EHTTP_TRACE_VESTOL
+
+#include <stdio.h>
+
+#include "ehttp.h"
+
+/*
+ * Parser latency tracing.
+ *
+ * A parser instantiated with EHTTP_TRACE defined (ehttp.c built with
+ * -DEHTTP_TRACE, or a template instance, see ehttp_parse.h) samples one
+ * message in ehttp_trace_rate() and stamps it with the TSC when ehttp_parse()
+ * is entered and left, when a phase starts and around every callback.
+ * Records go to a ring owned by the parsing thread; ehttp_trace_dump() turns
+ * them into per phase histograms of time spent in the parser and time spent
+ * in callbacks. Time between ehttp_parse() calls is not counted.
+ */
+
+typedef enum {
+  EHTTP_PHASE_REQUEST_LINE = 0,
+  EHTTP_PHASE_HEADERS,
+  // from the end of headers to the first body byte, on_headers_done
+  EHTTP_PHASE_EOH,
+  EHTTP_PHASE_BODY,
+
+  EHTTP_PHASE_MAX,
+} ehttp_phase;
+
+// record events, a phase start is recorded as its ehttp_phase
+enum {
+  EHTTP_TRACE_ENTER = EHTTP_PHASE_MAX,
+  EHTTP_TRACE_EXIT,
+  EHTTP_TRACE_CALLBACK,
+  EHTTP_TRACE_CALLBACK_DONE,
+  // message parsed or failed
+  EHTTP_TRACE_DONE,
+};
+
+#ifndef EHTTP_TRACE_RING
+// records per thread, a power of two
+#define EHTTP_TRACE_RING 2048
+#endif
+
+typedef struct _ehttp_trace_record ehttp_trace_record;
+struct _ehttp_trace_record {
+  uint64_t tsc;
+  const ehttp_parser *parser;
+  uint8_t event;
+};
+
+typedef struct _ehttp_trace_ring ehttp_trace_ring;
+struct _ehttp_trace_ring {
+  // records written, published by the owning thread only
+  uint64_t head;
+  ehttp_trace_record records[EHTTP_TRACE_RING];
+};
+
+/**
+ * Traces one message in n on every thread, 0 disables tracing. Set it
+ * before parsing starts.
+ */
+void ehttp_trace_rate(unsigned n);
+
+/**
+ * The calling thread's ring.
+ */
+ehttp_trace_ring *ehttp_trace_local(void);
+
+/**
+ * Called by the parser when a message starts: true when it is traced.
+ */
+bool ehttp_trace_sample(void);
+
+/**
+ * Appends an event for parser to the calling thread's ring.
+ */
+void ehttp_trace_event(const ehttp_parser * const, uint8_t event);
+
+static inline ehttp_ctrl ehttp_trace_ctrl(const ehttp_parser * const parser,
+                                          ehttp_ctrl ctrl) {
+  if (parser->traced) {
+    ehttp_trace_event(parser, EHTTP_TRACE_CALLBACK_DONE);
+  }
+
+  return ctrl;
+}
+
+/**
+ * Prints, for each phase, log2 histograms in TSC ticks of the parser time
+ * and the callback time of the messages found in ring. The owning thread
+ * may keep writing: records overwritten meanwhile are skipped. Returns -1
+ * when out of memory.
+ */
+int ehttp_trace_dump(const ehttp_trace_ring * const restrict,
+                     FILE * const restrict);
+
+#endif